@@ -0,0 +1,410 @@
+#include "Promise_Error.h"
+#include "Metrics.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+#ifndef ALLOCATOR_H
+#define ALLOCATOR_H
+
+//blocks carved out of every chunk the pool takes from upstream,
+//and the batch size moved between a thread's cache and the shared depot.
+#ifndef ARENA_SIZE
+#define ARENA_SIZE 256
+#endif
+
+namespace Promises {
+
+	//memory_resource - same shape as std::pmr::memory_resource (C++17),
+	//so an arena written for pmr can be wrapped in a few lines.
+	//BytesAllocated/BytesFreed count what is asked of the outermost
+	//resource; one resource taking memory from another does not count it twice.
+	class memory_resource {
+	public:
+		virtual ~memory_resource(void) {}
+
+		void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+			PROMISE_METRIC(BytesAllocated, bytes);
+			return do_allocate(bytes, alignment);
+		}
+
+		void deallocate(void* p, size_t bytes, size_t alignment = alignof(std::max_align_t)) {
+			PROMISE_METRIC(BytesFreed, bytes);
+			do_deallocate(p, bytes, alignment);
+		}
+
+		bool is_equal(const memory_resource &other) const noexcept {
+			return do_is_equal(other);
+		}
+
+	protected:
+		virtual void* do_allocate(size_t bytes, size_t alignment) = 0;
+		virtual void do_deallocate(void* p, size_t bytes, size_t alignment) = 0;
+
+		virtual bool do_is_equal(const memory_resource &other) const noexcept {
+			return this == &other;
+		}
+
+		//_upstream_allocate / _upstream_deallocate - for a resource
+		//built on another one, without counting the bytes again.
+		static void* _upstream_allocate(memory_resource &upstream, size_t bytes, size_t alignment) {
+			return upstream.do_allocate(bytes, alignment);
+		}
+
+		static void _upstream_deallocate(memory_resource &upstream, void* p, size_t bytes, size_t alignment) {
+			upstream.do_deallocate(p, bytes, alignment);
+		}
+	};
+
+	//new_delete_resource - the global allocator. An over-aligned request
+	//uses aligned operator new where the compiler has it (C++17), and
+	//before that takes a bigger block and aligns inside it.
+	class new_delete_resource : public memory_resource {
+	public:
+		static new_delete_resource& instance(void) {
+			static new_delete_resource resource;
+			return resource;
+		}
+
+	protected:
+		virtual void* do_allocate(size_t bytes, size_t alignment) {
+			if (alignment <= _plain) {
+				return ::operator new(bytes);
+			}
+
+#ifdef __cpp_aligned_new
+			return ::operator new(bytes, std::align_val_t(alignment));
+#else
+			//the block operator new gave back sits just below the aligned pointer
+			void* raw = ::operator new(bytes + alignment + sizeof(void*));
+			uintptr_t start = reinterpret_cast<uintptr_t>(raw) + sizeof(void*);
+			uintptr_t aligned = (start + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+
+			reinterpret_cast<void**>(aligned)[-1] = raw;
+			return reinterpret_cast<void*>(aligned);
+#endif
+		}
+
+		virtual void do_deallocate(void* p, size_t, size_t alignment) {
+			if (alignment <= _plain) {
+				::operator delete(p);
+				return;
+			}
+
+#ifdef __cpp_aligned_new
+			::operator delete(p, std::align_val_t(alignment));
+#else
+			::operator delete(static_cast<void**>(p)[-1]);
+#endif
+		}
+
+	private:
+		//what plain operator new already guarantees
+#ifdef __cpp_aligned_new
+		static const size_t _plain = __STDCPP_DEFAULT_NEW_ALIGNMENT__;
+#else
+		static const size_t _plain = alignof(std::max_align_t);
+#endif
+	};
+
+	//block_pool_resource - fixed-size blocks in 16 byte size classes up to 1 KiB.
+	//Every thread keeps its own free list per class, so a steady-state chain
+	//allocates and frees without locks and without calling upstream.
+	//Surplus blocks move to a shared depot in batches of ARENA_SIZE,
+	//which is also where an exiting thread leaves its cache.
+	//Bigger or over-aligned requests go straight to upstream.
+	class block_pool_resource : public memory_resource {
+	public:
+		static const size_t granularity = 16;
+		static const size_t max_block = 1024;
+		static const size_t classes = max_block / granularity;
+
+		//the pool lives for the whole process, blocks may be
+		//freed by static destructors after main() returns.
+		static block_pool_resource& instance(void) {
+			static block_pool_resource* pool = new block_pool_resource(new_delete_resource::instance());
+			return *pool;
+		}
+
+		//chunks taken from upstream so far.
+		size_t chunks(void) {
+			std::unique_lock<std::mutex> lock(_lock);
+			return _chunks.size();
+		}
+
+	protected:
+		virtual void* do_allocate(size_t bytes, size_t alignment) {
+			if (bytes > max_block || alignment > granularity) {
+				return _upstream_allocate(_upstream, bytes, alignment);
+			}
+
+			size_t index = _index(bytes);
+
+			//the calling thread is exiting and its cache is gone,
+			//the block joins the pool when it is freed
+			if (_cacheGone()) {
+				return _upstream_allocate(_upstream, (index + 1) * granularity, granularity);
+			}
+
+			FreeList &list = _cache().lists[index];
+
+			if (list.head == nullptr) {
+				_refill(list, index);
+			}
+
+			Block* block = list.head;
+			list.head = block->next;
+			--list.count;
+
+			return block;
+		}
+
+		virtual void do_deallocate(void* p, size_t bytes, size_t alignment) {
+			if (p == nullptr) {
+				return;
+			}
+
+			if (bytes > max_block || alignment > granularity) {
+				_upstream_deallocate(_upstream, p, bytes, alignment);
+				return;
+			}
+
+			size_t index = _index(bytes);
+			Block* block = static_cast<Block*>(p);
+
+			//the calling thread is exiting and its cache is gone
+			if (_cacheGone()) {
+				block->next = nullptr;
+				_give(index, block, 1);
+				return;
+			}
+
+			FreeList &list = _cache().lists[index];
+			block->next = list.head;
+			list.head = block;
+			++list.count;
+
+			if (list.count >= 2 * ARENA_SIZE) {
+				_spill(list, index);
+			}
+		}
+
+	private:
+		struct Block {
+			Block* next;
+		};
+
+		struct FreeList {
+			FreeList(void)
+				:head(nullptr),
+				count(0)
+			{ }
+
+			Block* head;
+			size_t count;
+		};
+
+		struct Batch {
+			Block* head;
+			size_t count;
+		};
+
+		struct Cache {
+			~Cache(void) {
+				block_pool_resource &pool = block_pool_resource::instance();
+
+				for (size_t i = 0; i < classes; ++i) {
+					if (lists[i].head != nullptr) {
+						pool._give(i, lists[i].head, lists[i].count);
+					}
+				}
+
+				_cacheGone() = true;
+			}
+
+			FreeList lists[classes];
+		};
+
+		memory_resource &_upstream;
+		std::mutex _lock;
+		std::vector<void*> _chunks;
+		std::vector<Batch> _depot[classes];
+
+		explicit block_pool_resource(memory_resource &upstream)
+			:_upstream(upstream)
+		{ }
+
+		static size_t _index(size_t bytes) {
+			return (bytes == 0) ? 0 : (bytes - 1) / granularity;
+		}
+
+		static Cache& _cache(void) {
+			static thread_local Cache cache;
+			return cache;
+		}
+
+		static bool& _cacheGone(void) {
+			static thread_local bool gone = false;
+			return gone;
+		}
+
+		//_refill - a batch from the depot, or a fresh chunk from upstream.
+		void _refill(FreeList &list, size_t index) {
+			std::unique_lock<std::mutex> lock(_lock);
+
+			if (!_depot[index].empty()) {
+				Batch batch = _depot[index].back();
+				_depot[index].pop_back();
+
+				list.head = batch.head;
+				list.count = batch.count;
+				return;
+			}
+
+			size_t size = (index + 1) * granularity;
+			char* chunk = static_cast<char*>(_upstream_allocate(_upstream, size * ARENA_SIZE, granularity));
+			_chunks.push_back(chunk);
+			lock.unlock();
+
+			Block* head = nullptr;
+			for (size_t i = ARENA_SIZE; i > 0; --i) {
+				Block* block = reinterpret_cast<Block*>(chunk + (i - 1) * size);
+				block->next = head;
+				head = block;
+			}
+
+			list.head = head;
+			list.count = ARENA_SIZE;
+		}
+
+		//_spill - hand the newest ARENA_SIZE blocks to the depot.
+		void _spill(FreeList &list, size_t index) {
+			Block* head = list.head;
+			Block* tail = head;
+
+			for (size_t i = 1; i < ARENA_SIZE; ++i) {
+				tail = tail->next;
+			}
+
+			list.head = tail->next;
+			list.count -= ARENA_SIZE;
+			tail->next = nullptr;
+
+			_give(index, head, ARENA_SIZE);
+		}
+
+		void _give(size_t index, Block* head, size_t count) {
+			Batch batch;
+			batch.head = head;
+			batch.count = count;
+
+			std::unique_lock<std::mutex> lock(_lock);
+			_depot[index].push_back(batch);
+		}
+	};
+
+	inline std::atomic<memory_resource*>& _memory_resource(void) {
+		static std::atomic<memory_resource*> resource(&block_pool_resource::instance());
+		return resource;
+	}
+
+	//get_memory_resource - where Promise, State and Lambda nodes come from.
+	inline memory_resource* get_memory_resource(void) {
+		return _memory_resource().load(std::memory_order_acquire);
+	}
+
+	//set_memory_resource - pass in your own arena.
+	//Each node remembers the resource it came from, so switching
+	//while promises are alive is safe; resource must outlive them.
+	//nullptr restores the default block pool.
+	inline void set_memory_resource(memory_resource* resource) {
+		if (resource == nullptr) {
+			resource = &block_pool_resource::instance();
+		}
+
+		_memory_resource().store(resource, std::memory_order_release);
+	}
+
+	//PoolAllocator - std allocator over a memory_resource,
+	//used with std::allocate_shared so the object and its
+	//control block share one pooled block.
+	template <typename T>
+	class PoolAllocator {
+	public:
+		typedef T value_type;
+
+		PoolAllocator(void)
+			:_resource(get_memory_resource())
+		{ }
+
+		explicit PoolAllocator(memory_resource* resource)
+			:_resource(resource)
+		{ }
+
+		template <typename U>
+		PoolAllocator(const PoolAllocator<U> &other)
+			:_resource(other.resource())
+		{ }
+
+		T* allocate(size_t n) {
+			return static_cast<T*>(_resource->allocate(n * sizeof(T), alignof(T)));
+		}
+
+		void deallocate(T* p, size_t n) {
+			_resource->deallocate(p, n * sizeof(T), alignof(T));
+		}
+
+		memory_resource* resource(void) const {
+			return _resource;
+		}
+
+	private:
+		memory_resource* _resource;
+	};
+
+	template <typename T, typename U>
+	bool operator == (const PoolAllocator<T> &a, const PoolAllocator<U> &b) {
+		return a.resource()->is_equal(*b.resource());
+	}
+
+	template <typename T, typename U>
+	bool operator != (const PoolAllocator<T> &a, const PoolAllocator<U> &b) {
+		return !(a == b);
+	}
+
+	//make_pooled - std::make_shared through the node memory resource.
+	template <typename T, typename... ARGS>
+	std::shared_ptr<T> make_pooled(ARGS&&... args) {
+		return std::allocate_shared<T>(PoolAllocator<T>(), std::forward<ARGS>(args)...);
+	}
+
+	//pool_new / pool_delete - raw objects from the block pool,
+	//for internal nodes that never leave the library (e.g. queued tasks).
+	template <typename T, typename... ARGS>
+	T* pool_new(ARGS&&... args) {
+		void* p = block_pool_resource::instance().allocate(sizeof(T), alignof(T));
+
+		try {
+			return new (p) T(std::forward<ARGS>(args)...);
+		} catch (...) {
+			block_pool_resource::instance().deallocate(p, sizeof(T), alignof(T));
+			throw;
+		}
+	}
+
+	template <typename T>
+	void pool_delete(T* p) {
+		if (p != nullptr) {
+			p->~T();
+			block_pool_resource::instance().deallocate(p, sizeof(T), alignof(T));
+		}
+	}
+}
+
+#endif // !ALLOCATOR_H
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "../Allocator.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <string>
+
+#ifndef BENCH_H
+#define BENCH_H
+
+//Bench - what every benchmark reports: time, pooled and heap allocations,
+//and threads started, all per operation.
+namespace Bench {
+
+	typedef std::chrono::steady_clock bench_clock;
+
+	inline double elapsed_ns(bench_clock::time_point start) {
+		return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::now() - start).count();
+	}
+
+	//heap_allocations - calls to the global operator new, see Benchmarks.cpp.
+	inline std::atomic<size_t>& heap_allocations(void) {
+		static std::atomic<size_t> count(0);
+		return count;
+	}
+
+	//threads_created - threads started through pthread_create, see Benchmarks.cpp.
+	inline std::atomic<size_t>& threads_created(void) {
+		static std::atomic<size_t> count(0);
+		return count;
+	}
+
+	//counting_resource - the default block pool, counting what it hands out.
+	class counting_resource : public Promises::memory_resource {
+	public:
+		static counting_resource& instance(void) {
+			static counting_resource resource;
+			return resource;
+		}
+
+		size_t allocations(void) const {
+			return _allocations.load(std::memory_order_relaxed);
+		}
+
+	protected:
+		virtual void* do_allocate(size_t bytes, size_t alignment) {
+			_allocations.fetch_add(1, std::memory_order_relaxed);
+			return Promises::block_pool_resource::instance().allocate(bytes, alignment);
+		}
+
+		virtual void do_deallocate(void* p, size_t bytes, size_t alignment) {
+			Promises::block_pool_resource::instance().deallocate(p, bytes, alignment);
+		}
+
+	private:
+		std::atomic<size_t> _allocations;
+
+		counting_resource(void)
+			:_allocations(0)
+		{ }
+	};
+
+	inline void header(void) {
+		printf("%-28s %12s %14s %9s %9s %10s\n", "benchmark", "ns/op", "ops/s", "pool/op", "heap/op", "threads/op");
+	}
+
+	//measure - run body, which times its own operations and returns the ns
+	//they took, and print one row for ops operations. Setup the body keeps
+	//out of its timing still counts towards allocations and threads.
+	inline void measure(const std::string &name, size_t ops, std::function<double(void)> body) {
+		size_t pool = counting_resource::instance().allocations();
+		size_t heap = heap_allocations().load();
+		size_t threads = threads_created().load();
+
+		double ns = body();
+
+		double per_op = ns / (double)ops;
+		printf("%-28s %12.1f %14.0f %9.2f %9.2f %10.3f\n", name.c_str(), per_op, 1e9 / per_op,
+			(double)(counting_resource::instance().allocations() - pool) / (double)ops,
+			(double)(heap_allocations().load() - heap) / (double)ops,
+			(double)(threads_created().load() - threads) / (double)ops);
+	}
+}
+
+void executor_bench(void);
+void promise_bench(void);
+
+#endif // !BENCH_H
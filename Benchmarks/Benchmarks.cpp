@@ -0,0 +1,69 @@
+#include "Bench.h"
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#if defined(__linux__)
+#include <dlfcn.h>
+#include <pthread.h>
+#endif
+
+//every heap allocation in the process, the library's and the baselines' alike
+void* operator new(size_t bytes) {
+	Bench::heap_allocations().fetch_add(1, std::memory_order_relaxed);
+
+	void* p = malloc(bytes == 0 ? 1 : bytes);
+	if (p == nullptr) {
+		throw std::bad_alloc();
+	}
+
+	return p;
+}
+
+void* operator new[](size_t bytes) {
+	return operator new(bytes);
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+void operator delete[](void* p) noexcept {
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+	free(p);
+}
+
+#if defined(__linux__)
+//std::thread starts its threads here, so counting them needs no help from the executors
+extern "C" int pthread_create(pthread_t* thread, const pthread_attr_t* attr, void* (*start)(void*), void* arg) noexcept {
+	typedef int (*create_type)(pthread_t*, const pthread_attr_t*, void* (*)(void*), void*);
+	static create_type real = (create_type)dlsym(RTLD_NEXT, "pthread_create");
+
+	Bench::threads_created().fetch_add(1, std::memory_order_relaxed);
+	return real(thread, attr, start, arg);
+}
+#endif
+
+//Benchmarks [promises|executors] - runs both suites when given neither.
+int main(int argc, char* argv[]) {
+	const char* suite = (argc > 1) ? argv[1] : "";
+
+	Promises::set_memory_resource(&Bench::counting_resource::instance());
+
+	if (strcmp(suite, "executors") != 0) {
+		promise_bench();
+	}
+
+	if (strcmp(suite, "promises") != 0) {
+		executor_bench();
+	}
+
+	return 0;
+}
@@ -0,0 +1,144 @@
+#include "Bench.h"
+#include "../Promise.h"
+#include "../Typed.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+//Executor_Bench - compares promise chains run on the pooled executors
+//with the old model of one std::thread per handler.
+//Installs each executor as the default, so it runs after Promise_Bench.
+
+using Bench::bench_clock;
+using Bench::elapsed_ns;
+
+//chain_latency - time to run a chain of depth links to its end, per link.
+static double chain_latency(size_t depth, size_t rounds) {
+	double total = 0;
+
+	for (size_t r = 0; r < rounds; ++r) {
+		bench_clock::time_point start = bench_clock::now();
+
+		Promises::PROM_TYPE root = promise([](Promises::Settlement settle) {
+			settle.resolve<int>(0);
+		});
+
+		std::vector<Promises::PROM_TYPE> links;
+		links.push_back(root);
+
+		for (size_t i = 0; i < depth; ++i) {
+			links.push_back(links.back()->then([](int value) {
+				return Promises::Resolve<int>(value + 1);
+			}));
+		}
+
+		Promises::await<int>(links.back());
+		total += elapsed_ns(start);
+	}
+
+	return total / (double)(rounds * (depth + 1));
+}
+
+//typed_chain_latency - chain_latency for Typed::Promise<int>.
+static double typed_chain_latency(size_t depth, size_t rounds) {
+	double total = 0;
+
+	for (size_t r = 0; r < rounds; ++r) {
+		bench_clock::time_point start = bench_clock::now();
+
+		Promises::Typed::Promise<int> prom = Promises::Typed::promise<int>([](Promises::Typed::Settlement<int> settle) {
+			settle.resolve(0);
+		});
+
+		for (size_t i = 0; i < depth; ++i) {
+			prom = prom.then([](int value) {
+				return value + 1;
+			});
+		}
+
+		Promises::Typed::await(prom);
+		total += elapsed_ns(start);
+	}
+
+	return total / (double)(rounds * (depth + 1));
+}
+
+//throughput - independent promises per second.
+static double throughput(size_t count) {
+	bench_clock::time_point start = bench_clock::now();
+
+	std::vector<Promises::PROM_TYPE> proms;
+	proms.reserve(count);
+
+	for (size_t i = 0; i < count; ++i) {
+		proms.push_back(promise([i](Promises::Settlement settle) {
+			settle.resolve<size_t>(i);
+		}));
+	}
+
+	for (size_t i = 0; i < count; ++i) {
+		Promises::await<size_t>(proms[i]);
+	}
+
+	proms.clear();
+	return (double)count / (elapsed_ns(start) / 1e9);
+}
+
+//fan_out - width continuations on one root, per continuation.
+static double fan_out(size_t width, size_t rounds) {
+	double total = 0;
+
+	for (size_t r = 0; r < rounds; ++r) {
+		std::atomic<size_t> done(0);
+		bench_clock::time_point start = bench_clock::now();
+
+		Promises::PROM_TYPE root = promise([](Promises::Settlement settle) {
+			settle.resolve<int>(1);
+		});
+
+		std::vector<Promises::PROM_TYPE> children;
+		children.reserve(width);
+
+		for (size_t i = 0; i < width; ++i) {
+			children.push_back(root->then([&done](int value) {
+				//a little work per continuation so stealing has something to balance
+				volatile int x = value;
+				for (int k = 0; k < 2000; ++k) {
+					x = x * 3 + k;
+				}
+				done.fetch_add(1);
+			}));
+		}
+
+		while (done.load() != width) {
+			std::this_thread::yield();
+		}
+
+		total += elapsed_ns(start);
+	}
+
+	return total / (double)(rounds * width);
+}
+
+static void run(const std::string &name, Promises::IEXEC_TYPE exec) {
+	Promises::set_default_executor(exec);
+
+	printf("%-16s chain(64)   %12.0f ns/link\n", name.c_str(), chain_latency(64, 20));
+	printf("%-16s chain(1024) %12.0f ns/link\n", name.c_str(), chain_latency(1024, 2));
+	printf("%-16s typed(1024) %12.0f ns/link\n", name.c_str(), typed_chain_latency(1024, 2));
+	printf("%-16s promises    %12.0f ops/s\n", name.c_str(), throughput(20000));
+	printf("%-16s fan-out(512) %11.0f ns/continuation\n", name.c_str(), fan_out(512, 20));
+}
+
+void executor_bench(void) {
+	run("thread-per-task", std::make_shared<Promises::ThreadPerTaskExecutor>());
+	run("thread-pool", std::make_shared<Promises::ThreadPool>());
+	run("thread-pool(2)", std::make_shared<Promises::ThreadPool>(Promises::ExecutorConfig(2)));
+	run("work-stealing", std::make_shared<Promises::WorkStealingPool>());
+
+	Promises::set_continuation_policy(Promises::Inline);
+	run("inline", std::make_shared<Promises::WorkStealingPool>());
+	Promises::set_continuation_policy(Promises::Dispatch);
+}
@@ -0,0 +1,383 @@
+#include "Bench.h"
+#include "../Promise.h"
+#include <atomic>
+#include <future>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+//Promise_Bench - the cost of the common promise shapes on the default
+//executor, next to the same shape built from std::async and std::future.
+
+using Bench::bench_clock;
+using Bench::elapsed_ns;
+using Bench::measure;
+
+static Promises::PROM_TYPE pending(void) {
+	return Promises::make_pooled<Promises::Promise>(Promises::pending_state);
+}
+
+//link - settle a root and run one continuation to the end.
+static double link(size_t rounds) {
+	bench_clock::time_point start = bench_clock::now();
+
+	for (size_t r = 0; r < rounds; ++r) {
+		Promises::PROM_TYPE root = pending();
+		Promises::PROM_TYPE next = root->then([](int value) {
+			return Promises::Resolve<int>(value + 1);
+		});
+
+		Promises::Settlement(root.get()).resolve<int>(1);
+		Promises::await<int>(next);
+	}
+
+	return elapsed_ns(start);
+}
+
+//chain - build depth links on a pending root, settle it and wait for the end.
+static double chain(size_t depth, size_t rounds) {
+	double total = 0;
+
+	for (size_t r = 0; r < rounds; ++r) {
+		std::vector<Promises::PROM_TYPE> links;
+		links.reserve(depth + 1);
+
+		bench_clock::time_point start = bench_clock::now();
+		links.push_back(pending());
+
+		for (size_t i = 0; i < depth; ++i) {
+			links.push_back(links.back()->then([](int value) {
+				return Promises::Resolve<int>(value + 1);
+			}));
+		}
+
+		Promises::Settlement(links.front().get()).resolve<int>(0);
+		Promises::await<int>(links.back());
+		total += elapsed_ns(start);
+	}
+
+	return total;
+}
+
+//fan_out - width continuations on one root, until every one has run.
+static double fan_out(size_t width, size_t rounds) {
+	double total = 0;
+
+	for (size_t r = 0; r < rounds; ++r) {
+		std::atomic<size_t> done(0);
+		std::vector<Promises::PROM_TYPE> children;
+		children.reserve(width);
+
+		bench_clock::time_point start = bench_clock::now();
+		Promises::PROM_TYPE root = pending();
+
+		for (size_t i = 0; i < width; ++i) {
+			children.push_back(root->then([&done](int) {
+				done.fetch_add(1, std::memory_order_relaxed);
+			}));
+		}
+
+		Promises::Settlement(root.get()).resolve<int>(1);
+
+		while (done.load() != width) {
+			std::this_thread::yield();
+		}
+
+		total += elapsed_ns(start);
+	}
+
+	return total;
+}
+
+//fan_in_all - all() over count inputs settled after it was called.
+static double fan_in_all(size_t count, size_t rounds) {
+	double total = 0;
+
+	for (size_t r = 0; r < rounds; ++r) {
+		std::vector<Promises::PROM_TYPE> inputs;
+		inputs.reserve(count);
+
+		bench_clock::time_point start = bench_clock::now();
+
+		for (size_t i = 0; i < count; ++i) {
+			inputs.push_back(pending());
+		}
+
+		Promises::PROM_TYPE prom = Promises::all<int>(inputs);
+
+		for (size_t i = 0; i < count; ++i) {
+			Promises::Settlement(inputs[i].get()).resolve<int>((int)i);
+		}
+
+		Promises::await<std::vector<int>>(prom);
+		total += elapsed_ns(start);
+	}
+
+	return total;
+}
+
+//fan_in_hash - hash() over count keyed inputs settled after it was called.
+static double fan_in_hash(size_t count, size_t rounds) {
+	double total = 0;
+
+	for (size_t r = 0; r < rounds; ++r) {
+		std::map<int, Promises::PROM_TYPE> inputs;
+
+		bench_clock::time_point start = bench_clock::now();
+
+		for (size_t i = 0; i < count; ++i) {
+			inputs[(int)i] = pending();
+		}
+
+		Promises::PROM_TYPE prom = Promises::hash<int, int>(inputs);
+
+		for (std::map<int, Promises::PROM_TYPE>::iterator it = inputs.begin(); it != inputs.end(); ++it) {
+			Promises::Settlement(it->second.get()).resolve<int>(it->first);
+		}
+
+		Promises::await<std::map<int, int>>(prom);
+		total += elapsed_ns(start);
+	}
+
+	return total;
+}
+
+//reject - a rejection passed down depth then() links to a _catch.
+static double reject(size_t depth, size_t rounds) {
+	double total = 0;
+
+	for (size_t r = 0; r < rounds; ++r) {
+		std::vector<Promises::PROM_TYPE> links;
+		links.reserve(depth + 2);
+
+		bench_clock::time_point start = bench_clock::now();
+		links.push_back(pending());
+
+		for (size_t i = 0; i < depth; ++i) {
+			links.push_back(links.back()->then([](int value) {
+				return Promises::Resolve<int>(value + 1);
+			}));
+		}
+
+		links.push_back(links.back()->_catch([](const std::exception &) { }));
+
+		Promises::Settlement(links.front().get()).reject(Promises::Promise_Error("bench"));
+		Promises::await<int>(links.back());
+		total += elapsed_ns(start);
+	}
+
+	return total;
+}
+
+//timeouts - count timeouts armed on pending promises, all pending at
+//once, then beaten by their promise and taken off the wheel.
+static double timeouts(size_t count, size_t rounds) {
+	double total = 0;
+
+	for (size_t r = 0; r < rounds; ++r) {
+		std::vector<Promises::PROM_TYPE> inputs;
+		std::vector<Promises::PROM_TYPE> timed;
+		inputs.reserve(count);
+		timed.reserve(count);
+
+		bench_clock::time_point start = bench_clock::now();
+
+		for (size_t i = 0; i < count; ++i) {
+			inputs.push_back(pending());
+			timed.push_back(Promises::timeout<int>(inputs.back(), std::chrono::seconds(60)));
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			Promises::Settlement(inputs[i].get()).resolve<int>((int)i);
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			Promises::await<int>(timed[i]);
+		}
+
+		total += elapsed_ns(start);
+	}
+
+	return total;
+}
+
+//wakeup - from settling a promise on another thread to the return
+//of the await() parked on it.
+static double wakeup(size_t rounds) {
+	std::atomic<Promises::Promise*> target(nullptr);
+	std::atomic<int64_t> settled_at(0);
+	std::atomic<bool> stop(false);
+
+	std::thread settler([&target, &settled_at, &stop]() {
+		while (!stop.load()) {
+			Promises::Promise* prom = target.exchange(nullptr);
+
+			if (prom == nullptr) {
+				std::this_thread::yield();
+				continue;
+			}
+
+			//long enough for the waiter to be parked, not just spinning
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+			settled_at.store(bench_clock::now().time_since_epoch().count());
+			Promises::Settlement(prom).resolve<int>(1);
+		}
+	});
+
+	double total = 0;
+
+	for (size_t r = 0; r < rounds; ++r) {
+		Promises::PROM_TYPE prom = pending();
+		target.store(prom.get());
+
+		Promises::await<int>(prom);
+		int64_t woken_at = bench_clock::now().time_since_epoch().count();
+
+		total += (double)std::chrono::duration_cast<std::chrono::nanoseconds>(bench_clock::duration(woken_at - settled_at.load())).count();
+	}
+
+	stop.store(true);
+	settler.join();
+
+	return total;
+}
+
+//the baselines: one std::async thread per link, blocking on the previous future.
+
+static double async_link(size_t rounds) {
+	bench_clock::time_point start = bench_clock::now();
+
+	for (size_t r = 0; r < rounds; ++r) {
+		std::promise<int> root;
+		std::shared_future<int> value = root.get_future().share();
+
+		std::future<int> next = std::async(std::launch::async, [value]() {
+			return value.get() + 1;
+		});
+
+		root.set_value(1);
+		next.get();
+	}
+
+	return elapsed_ns(start);
+}
+
+static double async_chain(size_t depth, size_t rounds) {
+	double total = 0;
+
+	for (size_t r = 0; r < rounds; ++r) {
+		bench_clock::time_point start = bench_clock::now();
+
+		std::promise<int> root;
+		std::shared_future<int> last = root.get_future().share();
+
+		for (size_t i = 0; i < depth; ++i) {
+			std::shared_future<int> prev = last;
+			last = std::async(std::launch::async, [prev]() {
+				return prev.get() + 1;
+			}).share();
+		}
+
+		root.set_value(0);
+		last.get();
+		total += elapsed_ns(start);
+	}
+
+	return total;
+}
+
+static double async_fan_out(size_t width, size_t rounds) {
+	double total = 0;
+
+	for (size_t r = 0; r < rounds; ++r) {
+		bench_clock::time_point start = bench_clock::now();
+
+		std::promise<int> root;
+		std::shared_future<int> value = root.get_future().share();
+		std::vector<std::future<void>> children;
+		children.reserve(width);
+
+		for (size_t i = 0; i < width; ++i) {
+			children.push_back(std::async(std::launch::async, [value]() {
+				value.get();
+			}));
+		}
+
+		root.set_value(1);
+
+		for (size_t i = 0; i < width; ++i) {
+			children[i].get();
+		}
+
+		total += elapsed_ns(start);
+	}
+
+	return total;
+}
+
+static double async_fan_in(size_t count, size_t rounds) {
+	double total = 0;
+
+	for (size_t r = 0; r < rounds; ++r) {
+		bench_clock::time_point start = bench_clock::now();
+
+		std::vector<std::promise<int>> inputs(count);
+		std::vector<std::future<int>> futures;
+		futures.reserve(count);
+
+		for (size_t i = 0; i < count; ++i) {
+			futures.push_back(inputs[i].get_future());
+		}
+
+		for (size_t i = 0; i < count; ++i) {
+			inputs[i].set_value((int)i);
+		}
+
+		std::vector<int> values;
+		values.reserve(count);
+
+		for (size_t i = 0; i < count; ++i) {
+			values.push_back(futures[i].get());
+		}
+
+		total += elapsed_ns(start);
+	}
+
+	return total;
+}
+
+void promise_bench(void) {
+	Bench::header();
+
+	//warm the executor and the block pool, so neither start-up is measured
+	chain(1000, 1);
+
+	measure("link", 10000, []() { return link(10000); });
+	measure("std::async link", 1000, []() { return async_link(1000); });
+
+	static const size_t depths[] = { 1, 10, 100, 1000, 10000 };
+	for (size_t i = 0; i < sizeof(depths) / sizeof(depths[0]); ++i) {
+		size_t depth = depths[i];
+		size_t rounds = std::max<size_t>(1, 20000 / depth);
+
+		measure("chain(" + std::to_string(depth) + ") per link", depth * rounds, [depth, rounds]() { return chain(depth, rounds); });
+	}
+
+	//a thread per link, so the baseline stops well short of 10k
+	measure("std::async chain(100) per link", 100 * 10, []() { return async_chain(100, 10); });
+
+	measure("fan-out(1000) per then", 1000 * 20, []() { return fan_out(1000, 20); });
+	measure("std::async fan-out(1000)", 1000 * 2, []() { return async_fan_out(1000, 2); });
+
+	measure("all(1000) per input", 1000 * 20, []() { return fan_in_all(1000, 20); });
+	measure("hash(1000) per input", 1000 * 20, []() { return fan_in_hash(1000, 20); });
+	measure("std::future fan-in(1000)", 1000 * 20, []() { return async_fan_in(1000, 20); });
+
+	measure("reject(100) per link", 101 * 100, []() { return reject(100, 100); });
+
+	measure("timeout(100000) per input", 100000 * 5, []() { return timeouts(100000, 5); });
+
+	measure("await wakeup", 200, []() { return wakeup(200); });
+}
@@ -0,0 +1,202 @@
+#include "Promise_Error.h"
+#include "State.h"
+#include "Allocator.h"
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+#ifndef CANCELLATION_H
+#define CANCELLATION_H
+
+namespace Promises {
+
+	//Cancelled - the reason a cancelled promise is rejected with.
+	class Cancelled : public Promise_Error {
+	public:
+		Cancelled(void)
+			:Promise_Error("cancelled")
+		{ }
+	};
+
+	//cancelled_state - the one rejected state every cancelled promise shares.
+	//Never destroyed, promises may still be cancelled while statics are torn down.
+	inline std::shared_ptr<State> cancelled_state(void) {
+		static std::shared_ptr<State>* state = new std::shared_ptr<State>(std::make_shared<RejectedState>(Cancelled()));
+		return *state;
+	}
+
+	//CancelLink - an intrusive registration with a CancelState.
+	//fire runs once, on the cancelling thread, with no lock held.
+	struct CancelLink {
+		explicit CancelLink(void (*f)(CancelLink*))
+			:prev(nullptr),
+			next(nullptr),
+			fire(f),
+			linked(false)
+		{ }
+
+		CancelLink* prev;
+		CancelLink* next;
+		void (*fire)(CancelLink* self);
+		bool linked;
+	};
+
+	//CancelState - what a CancelSource and its tokens share: the flag,
+	//and the links to fire when it is set. The lock is only taken to
+	//attach, detach and cancel, never to check the flag.
+	class CancelState {
+	public:
+		CancelState(void)
+			:_cancelled(false),
+			_head(nullptr),
+			_firing(nullptr)
+		{ }
+
+		bool cancelled(void) const {
+			return _cancelled.load(std::memory_order_acquire);
+		}
+
+		//attach - false, and link left alone, once cancelled.
+		bool attach(CancelLink* link) {
+			std::unique_lock<std::mutex> lock(_lock);
+
+			if (cancelled()) {
+				return false;
+			}
+
+			link->prev = nullptr;
+			link->next = _head;
+			link->linked = true;
+
+			if (_head != nullptr) {
+				_head->prev = link;
+			}
+			_head = link;
+
+			return true;
+		}
+
+		//detach - take link off the list. If it is being fired right now,
+		//wait for that to finish, so its owner can be destroyed afterwards.
+		void detach(CancelLink* link) {
+			std::unique_lock<std::mutex> lock(_lock);
+
+			if (link->linked) {
+				_unlink(link);
+			}
+
+			while (_firing == link) {
+				_fired.wait(lock);
+			}
+		}
+
+		//cancel - set the flag, then fire every link, newest first.
+		//Later calls do nothing.
+		void cancel(void) {
+			std::unique_lock<std::mutex> lock(_lock);
+
+			if (cancelled()) {
+				return;
+			}
+			_cancelled.store(true, std::memory_order_release);
+
+			//one at a time, so a link detached meanwhile is never fired
+			while (_head != nullptr) {
+				CancelLink* link = _head;
+				_unlink(link);
+				_firing = link;
+
+				lock.unlock();
+				link->fire(link);
+				lock.lock();
+
+				_firing = nullptr;
+				_fired.notify_all();
+			}
+		}
+
+	private:
+		std::atomic<bool> _cancelled;
+		std::mutex _lock;
+		std::condition_variable _fired;
+		CancelLink* _head;
+		CancelLink* _firing;
+
+		void _unlink(CancelLink* link) {
+			if (link->prev != nullptr) {
+				link->prev->next = link->next;
+			} else {
+				_head = link->next;
+			}
+
+			if (link->next != nullptr) {
+				link->next->prev = link->prev;
+			}
+
+			link->prev = nullptr;
+			link->next = nullptr;
+			link->linked = false;
+		}
+	};
+
+	//CancelToken - the side of a cancellation that watches. Copies are
+	//cheap and all see the same flag. A default token is never cancelled.
+	class CancelToken {
+	public:
+		CancelToken(void)
+			:_state(nullptr)
+		{ }
+
+		explicit CancelToken(std::shared_ptr<CancelState> state)
+			:_state(state)
+		{ }
+
+		//cancelled - for a running handler to poll.
+		bool cancelled(void) const {
+			return _state != nullptr && _state->cancelled();
+		}
+
+		void throw_if_cancelled(void) const {
+			if (cancelled()) {
+				throw Cancelled();
+			}
+		}
+
+		std::shared_ptr<CancelState> state(void) const {
+			return _state;
+		}
+
+	private:
+		std::shared_ptr<CancelState> _state;
+	};
+
+	//CancelSource - the side of a cancellation that cancels.
+	//Promises given one of its tokens are cancelled along with it:
+	//those whose handler has not started are rejected with Cancelled
+	//and let go of their handlers and input right away. A handler
+	//already running finishes, and can poll its token to stop early.
+	class CancelSource {
+	public:
+		CancelSource(void)
+			:_state(make_pooled<CancelState>())
+		{ }
+
+		CancelToken token(void) const {
+			return CancelToken(_state);
+		}
+
+		bool cancelled(void) const {
+			return _state->cancelled();
+		}
+
+		void cancel(void) {
+			_state->cancel();
+		}
+
+	private:
+		std::shared_ptr<CancelState> _state;
+	};
+}
+
+#endif // !CANCELLATION_H
@@ -0,0 +1,730 @@
+#include "Promise.h"
+#include "Allocator.h"
+#include "Scheduler.h"
+#include "State.h"
+#include "Park.h"
+#include "Trace.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#ifndef CORE_H
+#define CORE_H
+
+namespace Promises {
+
+	//Core<T> - a chain link in one allocation with one refcount: status,
+	//value or rejection, and an intrusive waiter list, with handlers stored
+	//in the waiters. Typed::Promise<T> and the coroutine types sit on it.
+	//The dynamic Promise behind PROM_TYPE does not: it still holds a
+	//shared_ptr<State> and its handlers, allocated apart from the link.
+	//to_promise/from_promise bridge the two, at the cost of one pooled
+	//Promise, its State and a pinned waiter per crossing.
+
+	class CoreBase;
+
+	//Waiter - intrusive node in a core's continuation list.
+	//notify is a plain function pointer, called once when the core settles.
+	//sole is true when nothing else can read the value any more,
+	//so the waiter may move it out.
+	//A pinned waiter owns the reference whoever subscribed it gave up,
+	//and drops it with release_pinned() once notified.
+	struct Waiter {
+		explicit Waiter(void (*n)(Waiter*, CoreBase*, bool))
+			:next(nullptr),
+			notify(n),
+			pinned(false)
+		{ }
+
+		Waiter* next;
+		void (*notify)(Waiter* self, CoreBase* settled, bool sole);
+		bool pinned;
+	};
+
+	//CoreBase - everything about a chain link except its value:
+	//one refcount, the status word, the rejection and the waiter list.
+	//The most derived type provides _destroy, so there is no vtable.
+	//The refcount keeps holders (handles, settlers, running handlers)
+	//in the low half and pinned waiters in the high half.
+	class CoreBase : private Metrics::Live {
+	public:
+		void add_ref(void) {
+			_refs.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		void release(void) {
+			uint64_t refs = _refs.load(std::memory_order_acquire);
+
+			while (true) {
+				//the last holder of a pending core with waiters:
+				//nobody is left to settle it, they would wait forever
+				if ((refs & _Holders) == 1 && _abandoned()) {
+					reject(std::make_exception_ptr(Promise_Error("Core.release(): abandoned before settling")));
+					refs = _refs.load(std::memory_order_acquire);
+				}
+
+				if (_refs.compare_exchange_weak(refs, refs - 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+					break;
+				}
+
+				PROMISE_METRIC(CasRetries, 1);
+			}
+
+			if (refs == 1) {
+				_destroy(this);
+			}
+		}
+
+		//release_pinned - drop the reference a pinned waiter owns.
+		void release_pinned(void) {
+			if (_refs.fetch_sub(_Pin, std::memory_order_acq_rel) == _Pin) {
+				_destroy(this);
+			}
+		}
+
+		Status status(void) const {
+			int status = _status.load(std::memory_order_acquire);
+			return (status == _Settling) ? Pending : (Status)status;
+		}
+
+		bool settled(void) const {
+			int status = _status.load(std::memory_order_acquire);
+			return status == Resolved || status == Rejected;
+		}
+
+		std::exception_ptr error(void) const {
+			return _error;
+		}
+
+		//reject - false if the core was already settled.
+		bool reject(std::exception_ptr e) {
+			if (!_claim()) {
+				return false;
+			}
+
+			_error = e;
+			_publish(Rejected);
+			return true;
+		}
+
+		//subscribe - w->notify runs once this core settles,
+		//on the calling thread right away if it already has.
+		//consume - the caller gives up its reference, and with it
+		//any further reads; a pinned w takes that reference over.
+		void subscribe(Waiter* w, bool consume = false) {
+			if (w->pinned) {
+				_pin();
+			}
+
+			Waiter* head = _waiters.load(std::memory_order_acquire);
+
+			while (true) {
+				if (head == _closed()) {
+					uint64_t left = w->pinned ? _Pin : 1;
+					w->notify(w, this, consume && _refs.load(std::memory_order_acquire) == left);
+					return;
+				}
+
+				w->next = head;
+
+				if (_waiters.compare_exchange_weak(head, w, std::memory_order_acq_rel, std::memory_order_acquire)) {
+					break;
+				}
+
+				PROMISE_METRIC(CasRetries, 1);
+			}
+		}
+
+		//wait - block until settled. Threads that own queued work
+		//keep running it, like Promise::Join().
+		void wait(void) {
+			PROMISE_TRACE_EVENT(AwaitBegin, _trace_id, 0, 0);
+			PROMISE_METRIC_START(blocked);
+
+			if (!settled()) {
+				SyncWaiter waiter;
+				subscribe(&waiter);
+				waiter.wait();
+			}
+
+			PROMISE_METRIC_SINCE(AwaitBlock, blocked);
+			PROMISE_TRACE_EVENT(AwaitEnd, _trace_id, 0, 0);
+		}
+
+#ifdef PROMISE_TRACE
+		uint64_t trace_id(void) const {
+			return _trace_id;
+		}
+#endif
+
+	protected:
+		explicit CoreBase(void (*destroy)(CoreBase*))
+			:_refs(1),
+			_status(Pending),
+			_waiters(nullptr),
+			_destroy(destroy),
+			_resource(nullptr)
+		{ }
+
+		~CoreBase(void) {
+			if (_status.load(std::memory_order_relaxed) == Pending) {
+				PROMISE_METRIC(PromisesAbandoned, 1);
+			}
+		}
+
+		//set between _claim() and _publish(Rejected)
+		std::exception_ptr _error;
+
+		//_claim - the one transition out of Pending.
+		bool _claim(void) {
+			int expected = Pending;
+			return _status.compare_exchange_strong(expected, _Settling, std::memory_order_acq_rel, std::memory_order_acquire);
+		}
+
+		//_publish - make the outcome visible, then close the list and fire it.
+		void _publish(Status outcome) {
+			_status.store(outcome, std::memory_order_release);
+			PROMISE_TRACE_EVENT(Settled, _trace_id, 0, outcome);
+			PROMISE_METRIC(PromisesSettled, 1);
+
+			if (outcome == Rejected) {
+				PROMISE_METRIC(Rejections, 1);
+			}
+
+			Waiter* list = _waiters.exchange(_closed(), std::memory_order_acq_rel);
+
+			//the list is newest first, fire in registration order
+			Waiter* ordered = nullptr;
+			while (list != nullptr) {
+				Waiter* next = list->next;
+				list->next = ordered;
+				ordered = list;
+				list = next;
+			}
+
+			//whoever settles holds one reference and cannot read through it,
+			//so the last waiter is the sole reader if that and its own pin are all
+			while (ordered != nullptr) {
+				Waiter* next = ordered->next;
+				uint64_t left = ordered->pinned ? _Pin + 1 : 1;
+				ordered->notify(ordered, this, next == nullptr && _refs.load(std::memory_order_acquire) == left);
+				ordered = next;
+			}
+		}
+
+		template <typename NODE, typename... ARGS>
+		friend NODE* core_new(ARGS&&... args);
+
+		template <typename NODE>
+		friend void core_destroy(CoreBase* base);
+
+	private:
+		static const int _Settling = 3;
+		static const uint64_t _Pin = uint64_t(1) << 32;
+		static const uint64_t _Holders = _Pin - 1;
+
+		std::atomic<uint64_t> _refs;
+		std::atomic<int> _status;
+		std::atomic<Waiter*> _waiters;
+		void (*_destroy)(CoreBase*);
+		memory_resource* _resource;
+
+#ifdef PROMISE_TRACE
+		uint64_t _trace_id = Trace::created();
+#endif
+
+		static Waiter* _closed(void) {
+			static Waiter closed(nullptr);
+			return &closed;
+		}
+
+		//_abandoned - still pending with someone waiting on it,
+		//only meaningful to the last holder.
+		bool _abandoned(void) const {
+			return _status.load(std::memory_order_acquire) == Pending &&
+				(_waiters.load(std::memory_order_acquire) != nullptr || (_refs.load(std::memory_order_acquire) >> 32) != 0);
+		}
+
+		//_pin - turn the caller's holder reference into a pinned one.
+		void _pin(void) {
+			uint64_t refs = _refs.load(std::memory_order_acquire);
+
+			while (true) {
+				//the caller was the last holder, same as release()
+				if ((refs & _Holders) == 1 && _status.load(std::memory_order_acquire) == Pending) {
+					reject(std::make_exception_ptr(Promise_Error("Core.release(): abandoned before settling")));
+					refs = _refs.load(std::memory_order_acquire);
+				}
+
+				if (_refs.compare_exchange_weak(refs, refs - 1 + _Pin, std::memory_order_acq_rel, std::memory_order_acquire)) {
+					break;
+				}
+
+				PROMISE_METRIC(CasRetries, 1);
+			}
+		}
+
+		//SyncWaiter - lives on the stack of a thread blocked in wait().
+		//Spins briefly, then parks on its own word; _wake only makes
+		//a wake-up call if the waiter actually parked.
+		struct SyncWaiter : public Waiter {
+			enum {
+				Waiting,
+				Parked,
+				Done
+			};
+
+			SyncWaiter(void)
+				:Waiter(&SyncWaiter::_wake),
+				state(Waiting)
+			{ }
+
+			void wait(void) {
+				while (state.load(std::memory_order_acquire) != Done) {
+					if (help_pending()) {
+						continue;
+					}
+
+					if (spin_until([this]() { return this->state.load(std::memory_order_acquire) == Done; })) {
+						break;
+					}
+
+					int expected = Waiting;
+					if (!state.compare_exchange_strong(expected, Parked, std::memory_order_acq_rel, std::memory_order_acquire) && expected == Done) {
+						break;
+					}
+
+					//a worker wakes up now and then to pick up new work
+					if (current_executor() == nullptr) {
+						park(state, Parked);
+					} else {
+						park(state, Parked, std::chrono::microseconds(100));
+					}
+				}
+			}
+
+			static void _wake(Waiter* w, CoreBase*, bool) {
+				SyncWaiter* self = static_cast<SyncWaiter*>(w);
+
+				//the waiter may return as soon as it sees Done,
+				//unpark_all() only needs the address
+				if (self->state.exchange(Done, std::memory_order_acq_rel) == Parked) {
+					unpark_all(self->state);
+				}
+			}
+
+			std::atomic<int> state;
+		};
+	};
+
+	//core_new - one allocation from the node memory resource per core.
+	template <typename NODE, typename... ARGS>
+	NODE* core_new(ARGS&&... args) {
+		memory_resource* resource = get_memory_resource();
+		void* p = resource->allocate(sizeof(NODE), alignof(NODE));
+
+		NODE* node = nullptr;
+		try {
+			node = new (p) NODE(std::forward<ARGS>(args)...);
+		} catch (...) {
+			resource->deallocate(p, sizeof(NODE), alignof(NODE));
+			throw;
+		}
+
+		node->_resource = resource;
+		return node;
+	}
+
+	template <typename NODE>
+	void core_destroy(CoreBase* base) {
+		NODE* node = static_cast<NODE*>(base);
+		memory_resource* resource = node->_resource;
+
+		node->~NODE();
+		resource->deallocate(node, sizeof(NODE), alignof(NODE));
+	}
+
+	//Core - a chain link holding a T once resolved.
+	template <typename T>
+	class Core : public CoreBase {
+	public:
+		typedef T value_type;
+
+		explicit Core(void (*destroy)(CoreBase*) = &core_destroy<Core<T>>)
+			:CoreBase(destroy)
+		{ }
+
+		~Core(void) {
+			if (status() == Resolved) {
+				value().~T();
+			}
+		}
+
+		//resolve - false if the core was already settled.
+		template <typename U>
+		bool resolve(U &&v) {
+			if (!this->_claim()) {
+				return false;
+			}
+
+			try {
+				new (&_storage) T(std::forward<U>(v));
+			} catch (...) {
+				this->_error = std::current_exception();
+				this->_publish(Rejected);
+				return true;
+			}
+
+			this->_publish(Resolved);
+			return true;
+		}
+
+		//value - only valid once status() == Resolved.
+		T& value(void) {
+			return *reinterpret_cast<T*>(&_storage);
+		}
+
+	private:
+		typename std::aligned_storage<sizeof(T), alignof(T)>::type _storage;
+	};
+
+	template <>
+	class Core<void> : public CoreBase {
+	public:
+		typedef void value_type;
+
+		explicit Core(void (*destroy)(CoreBase*) = &core_destroy<Core<void>>)
+			:CoreBase(destroy)
+		{ }
+
+		bool resolve(void) {
+			if (!this->_claim()) {
+				return false;
+			}
+
+			this->_publish(Resolved);
+			return true;
+		}
+	};
+
+	//CorePtr - owning handle, one refcount per copy.
+	template <typename T>
+	class CorePtr {
+	public:
+		CorePtr(void)
+			:_core(nullptr)
+		{ }
+
+		//takes over the reference the caller holds on core.
+		explicit CorePtr(Core<T>* core)
+			:_core(core)
+		{ }
+
+		CorePtr(const CorePtr &other)
+			:_core(other._core)
+		{
+			if (_core != nullptr) {
+				_core->add_ref();
+			}
+		}
+
+		CorePtr(CorePtr &&other)
+			:_core(other._core)
+		{
+			other._core = nullptr;
+		}
+
+		~CorePtr(void) {
+			reset();
+		}
+
+		CorePtr& operator = (CorePtr other) {
+			std::swap(_core, other._core);
+			return (*this);
+		}
+
+		void reset(void) {
+			if (_core != nullptr) {
+				_core->release();
+				_core = nullptr;
+			}
+		}
+
+		//detach - give up ownership without dropping the reference.
+		Core<T>* detach(void) {
+			Core<T>* core = _core;
+			_core = nullptr;
+			return core;
+		}
+
+		Core<T>* get(void) const {
+			return _core;
+		}
+
+		Core<T>* operator -> (void) const {
+			return _core;
+		}
+
+		explicit operator bool (void) const {
+			return _core != nullptr;
+		}
+
+		bool operator == (const CorePtr &other) const {
+			return _core == other._core;
+		}
+
+		bool operator != (const CorePtr &other) const {
+			return _core != other._core;
+		}
+
+	private:
+		Core<T>* _core;
+	};
+
+	template <typename T>
+	CorePtr<T> make_core(void) {
+		return CorePtr<T>(core_new<Core<T>>());
+	}
+
+	//ContinuationNode - a link and the handler that settles it, in one allocation.
+	//When the parent settles, handler(parent, self, sole) runs on continuation_executor();
+	//it must settle self, and may move the parent's value out if sole is true.
+	//handler(parent, self) works too. If it throws, self is rejected with the exception.
+	template <typename T, typename HANDLER>
+	class ContinuationNode : public Core<T>, public Waiter {
+	public:
+		explicit ContinuationNode(HANDLER &&handler)
+			:Core<T>(&core_destroy<ContinuationNode<T, HANDLER>>),
+			Waiter(&ContinuationNode<T, HANDLER>::_notify),
+			_handler(std::move(handler)),
+			_parent(nullptr),
+			_sole(false)
+		{ }
+
+	private:
+		HANDLER _handler;
+		CoreBase* _parent;
+		bool _sole;
+
+#ifdef PROMISE_METRICS
+		uint64_t _settled_at = 0;
+#endif
+
+		static void _notify(Waiter* w, CoreBase* parent, bool sole) {
+			ContinuationNode<T, HANDLER>* self = static_cast<ContinuationNode<T, HANDLER>*>(w);
+
+			//a pinned node already owns a reference
+			if (!self->pinned) {
+				parent->add_ref();
+			}
+
+			self->_parent = parent;
+			self->_sole = sole;
+
+			PROMISE_TRACE_EVENT(Scheduled, self->trace_id(), 0, 0);
+			PROMISE_METRIC_STAMP(self->_settled_at);
+
+			//the parent list's reference on self moves to the task
+			continuation_executor()->submit([self]() {
+				self->_run();
+			});
+		}
+
+		void _run(void) {
+			PROMISE_TRACE_EVENT(HandlerBegin, this->trace_id(), 0, 0);
+			PROMISE_METRIC(ContinuationsRun, 1);
+			PROMISE_METRIC_SINCE(SettleToContinuation, _settled_at);
+
+			try {
+				_call(_handler, _parent, static_cast<Core<T>*>(this), _sole, 0);
+			} catch (...) {
+				this->reject(std::current_exception());
+			}
+
+			PROMISE_TRACE_EVENT(HandlerEnd, this->trace_id(), 0, 0);
+
+			if (this->pinned) {
+				_parent->release_pinned();
+			} else {
+				_parent->release();
+			}
+
+			_parent = nullptr;
+			this->release();
+		}
+
+		template <typename H>
+		static auto _call(H &h, CoreBase* parent, Core<T>* self, bool sole, int) -> decltype(h(parent, self, sole), void()) {
+			h(parent, self, sole);
+		}
+
+		template <typename H>
+		static void _call(H &h, CoreBase* parent, Core<T>* self, bool, long) {
+			h(parent, self);
+		}
+	};
+
+	//continue_with - register handler on parent, returns the new link.
+	//consume - the caller hands its reference on parent over to the link.
+	template <typename T, typename HANDLER>
+	CorePtr<T> continue_with(CoreBase* parent, HANDLER handler, bool consume = false) {
+		typedef ContinuationNode<T, HANDLER> node_type;
+
+		if (parent == nullptr) {
+			throw Promise_Error("continue_with(): parent is null");
+		}
+
+		node_type* node = core_new<node_type>(std::move(handler));
+
+		//one reference for the caller, one for the parent's list
+		node->add_ref();
+		node->pinned = consume;
+
+		PROMISE_TRACE_EVENT(Chained, node->trace_id(), parent->trace_id(), 0);
+		parent->subscribe(node, consume);
+
+		return CorePtr<T>(node);
+	}
+
+	//ForwardWaiter - settles target with whatever source settles with.
+	//It is pinned: source stays alive until the value is forwarded.
+	template <typename T>
+	class ForwardWaiter : public Waiter {
+	public:
+		explicit ForwardWaiter(Core<T>* target)
+			:Waiter(&ForwardWaiter<T>::_notify),
+			_target(target)
+		{
+			_target->add_ref();
+			pinned = true;
+		}
+
+		~ForwardWaiter(void) {
+			_target->release();
+		}
+
+	private:
+		Core<T>* _target;
+
+		static void _notify(Waiter* w, CoreBase* source, bool sole) {
+			ForwardWaiter<T>* self = static_cast<ForwardWaiter<T>*>(w);
+
+			if (source->status() == Resolved) {
+				try {
+					_forward(self->_target, static_cast<Core<T>*>(source), sole);
+				} catch (...) {
+					self->_target->reject(std::current_exception());
+				}
+			} else {
+				self->_target->reject(source->error());
+			}
+
+			pool_delete(self);
+			source->release_pinned();
+		}
+
+		template <typename U>
+		static void _forward(Core<U>* target, Core<U>* source, bool sole) {
+			if (sole) {
+				target->resolve(std::move(source->value()));
+			} else {
+				target->resolve(copy_value(source->value()));
+			}
+		}
+
+		static void _forward(Core<void>* target, Core<void>*, bool) {
+			target->resolve();
+		}
+	};
+
+	//adopt - target settles the way source does.
+	//Takes over the caller's reference on source.
+	template <typename T>
+	void adopt(Core<T>* target, Core<T>* source) {
+		source->subscribe(pool_new<ForwardWaiter<T>>(target), true);
+	}
+
+	//_bridge_resolve - moved across when the bridge is the core's only reader.
+	template <typename T>
+	void _bridge_resolve(Settlement &settle, Core<T>* core, bool sole) {
+		if (sole) {
+			settle.resolve(std::move(core->value()));
+		} else {
+			settle.resolve(copy_value(core->value()));
+		}
+	}
+
+	//a void core resolves its promise with a null value
+	inline void _bridge_resolve(Settlement &settle, Core<void>*, bool) {
+		settle.resolve<void*>(nullptr);
+	}
+
+	//to_promise - a PROM_TYPE that settles with core,
+	//so a core can be used with then(), _catch(), all() and await().
+	//Every call allocates a Promise and, on settling, a State.
+	//The bridge takes over this reference to core, so once nothing else
+	//holds the core its value is moved across rather than copied.
+	template <typename T>
+	PROM_TYPE to_promise(CorePtr<T> core) {
+		struct Bridge : public Waiter {
+			Bridge(PROM_TYPE p)
+				:Waiter(&Bridge::_notify),
+				prom(p)
+			{
+				pinned = true;
+			}
+
+			static void _notify(Waiter* w, CoreBase* settled, bool sole) {
+				Bridge* self = static_cast<Bridge*>(w);
+				Settlement settle(self->prom.get());
+
+				if (settled->status() == Resolved) {
+					try {
+						_bridge_resolve(settle, static_cast<Core<T>*>(settled), sole);
+					} catch (...) {
+						settle.reject(std::current_exception());
+					}
+				} else {
+					settle.reject(settled->error());
+				}
+
+				pool_delete(self);
+				settled->release_pinned();
+			}
+
+			PROM_TYPE prom;
+		};
+
+		PROM_TYPE prom = make_pooled<Promise>(pending_state);
+		core->subscribe(pool_new<Bridge>(prom), true);
+		core.detach();
+
+		return prom;
+	}
+
+	//from_promise - a core that settles with prom, T is the resolved value type.
+	//Costs a then() continuation on prom besides the core.
+	template <typename T>
+	CorePtr<T> from_promise(PROM_TYPE prom) {
+		CorePtr<T> core = make_core<T>();
+		CorePtr<T> resolver(core);
+		CorePtr<T> rejecter(core);
+
+		//the handlers are the only owners of these references,
+		//the other one is dropped when its promise is.
+		//T&& takes the value out of the resolved state once, moved if it can be.
+		prom->then([resolver](T &&value) {
+			resolver->resolve(std::move(value));
+		}, [rejecter](const STATE_TYPE &reason) {
+			rejecter->reject(reason->get_error());
+		});
+
+		return core;
+	}
+}
+
+#endif // !CORE_H
\ No newline at end of file
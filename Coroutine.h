@@ -0,0 +1,373 @@
+#include "Promise.h"
+#include "Core.h"
+#include "Typed.h"
+#include "Executor.h"
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <utility>
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include <coroutine>
+#endif
+
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#define PROMISE_HAS_COROUTINES 1
+#endif
+
+//C++20 coroutines on top of both promise types. Compiled out before C++20,
+//so the rest of the library keeps building as C++11.
+#ifdef PROMISE_HAS_COROUTINES
+
+namespace Promises {
+
+	//Resumer - hands a suspended coroutine back once a promise settles.
+	//If the promise settles while await_suspend() is still registering,
+	//the coroutine just carries on instead of suspending.
+	//exec, if set, runs the rest of the coroutine, otherwise it
+	//runs on whichever thread settled the promise.
+	class Resumer {
+	public:
+		explicit Resumer(IEXEC_TYPE exec)
+			:_state(Waiting),
+			_exec(std::move(exec))
+		{ }
+
+		//suspend - true if the coroutine should stay suspended.
+		bool suspend(std::coroutine_handle<> handle) {
+			_handle = handle;
+
+			int expected = Waiting;
+			return _state.compare_exchange_strong(expected, Suspended, std::memory_order_acq_rel, std::memory_order_acquire);
+		}
+
+		//wake - the promise settled. If the coroutine has not suspended yet
+		//it may already be running past the awaiter, so nothing is touched.
+		void wake(void) {
+			if (_state.exchange(Woken, std::memory_order_acq_rel) != Suspended) {
+				return;
+			}
+
+			std::coroutine_handle<> handle = _handle;
+
+			//let go of exec here, the frame may be torn down on one of its threads
+			IEXEC_TYPE exec = std::move(_exec);
+
+			if (exec != nullptr) {
+				exec->submit([handle]() {
+					handle.resume();
+				});
+			} else {
+				handle.resume();
+			}
+		}
+
+	private:
+		enum {
+			Waiting,
+			Suspended,
+			Woken
+		};
+
+		std::atomic<int> _state;
+		IEXEC_TYPE _exec;
+		std::coroutine_handle<> _handle;
+	};
+
+	//PromiseAwaiter - co_await on a PROM_TYPE. Registers a finally()
+	//continuation instead of blocking a thread in Join().
+	class PromiseAwaiter {
+	public:
+		PromiseAwaiter(PROM_TYPE prom, IEXEC_TYPE exec)
+			:_prom(std::move(prom)),
+			_resumer(std::move(exec))
+		{
+			if (_prom == nullptr) {
+				throw Promise_Error("PromiseAwaiter(): promise is null");
+			}
+		}
+
+		//nothing to wait for once the chain has ended
+		bool await_ready(void) {
+			return _prom->get_state() == nullptr;
+		}
+
+		bool await_suspend(std::coroutine_handle<> handle) {
+			PROM_TYPE prom = _prom;
+			Resumer* resumer = &_resumer;
+
+			prom->finally([resumer]() {
+				resumer->wake();
+			});
+
+			return _resumer.suspend(handle);
+		}
+
+		void await_resume(void) {
+			_rethrow();
+		}
+
+	protected:
+		PROM_TYPE _prom;
+		Resumer _resumer;
+
+		//_rethrow - a rejection comes back as the type it was rejected with, like await().
+		std::shared_ptr<State> _rethrow(void) {
+			std::shared_ptr<State> state = _prom->get_state();
+
+			if (state != nullptr && *state == Rejected) {
+				state->rethrow();
+			}
+
+			return state;
+		}
+	};
+
+	//ValueAwaiter - co_await that produces a copy of the resolved T.
+	template <typename T>
+	class ValueAwaiter : public PromiseAwaiter {
+	public:
+		ValueAwaiter(PROM_TYPE prom, IEXEC_TYPE exec)
+			:PromiseAwaiter(std::move(prom), std::move(exec))
+		{ }
+
+		T await_resume(void) {
+			std::shared_ptr<State> state = _rethrow();
+
+			if (state == nullptr || *state != Resolved) {
+				throw Promise_Error("awaitable(): promise ended without a value");
+			}
+
+			return copy_value(*(T*)state->get_value());
+		}
+	};
+
+	//co_await prom - suspend until prom settles, a rejection is thrown.
+	inline PromiseAwaiter operator co_await(PROM_TYPE prom) {
+		return PromiseAwaiter(std::move(prom), nullptr);
+	}
+
+	//awaitable - co_await awaitable<T>(prom) produces prom's value.
+	//With exec, the coroutine resumes on it.
+	template <typename T>
+	ValueAwaiter<T> awaitable(PROM_TYPE prom, IEXEC_TYPE exec = nullptr) {
+		return ValueAwaiter<T>(std::move(prom), std::move(exec));
+	}
+
+	//PromiseCoroutine - promise_type of a coroutine returning PROM_TYPE.
+	//co_return value resolves it, an escaping exception rejects it.
+	class PromiseCoroutine {
+	public:
+		PromiseCoroutine(void)
+			:_prom(make_pooled<Promise>(pending_state))
+		{ }
+
+		PROM_TYPE get_return_object(void) {
+			return _prom;
+		}
+
+		std::suspend_never initial_suspend(void) noexcept {
+			return std::suspend_never();
+		}
+
+		std::suspend_never final_suspend(void) noexcept {
+			return std::suspend_never();
+		}
+
+		template <typename U>
+		void return_value(U &&value) {
+			Settlement settle(_prom.get());
+			settle.resolve(std::forward<U>(value));
+		}
+
+		void unhandled_exception(void) {
+			Settlement settle(_prom.get());
+			settle.reject(std::current_exception());
+		}
+
+	private:
+		PROM_TYPE _prom;
+	};
+
+namespace Typed {
+
+	//CoreAwaiter - co_await on a Typed::Promise<T>, a pinned Waiter on its core.
+	//co_await produces a copy of the value, or the value itself when
+	//nothing else can read it any more, e.g. after co_await std::move(p).
+	template <typename T>
+	class CoreAwaiter : public Waiter {
+	public:
+		CoreAwaiter(const Promise<T> &prom, IEXEC_TYPE exec)
+			:Waiter(&CoreAwaiter<T>::_notify),
+			_core(_checked(prom)),
+			_consume(false),
+			_subscribed(false),
+			_sole(false),
+			_resumer(std::move(exec))
+		{
+			_core->add_ref();
+			pinned = true;
+		}
+
+		CoreAwaiter(Promise<T> &&prom, IEXEC_TYPE exec)
+			:Waiter(&CoreAwaiter<T>::_notify),
+			_core(_checked(prom)),
+			_consume(true),
+			_subscribed(false),
+			_sole(false),
+			_resumer(std::move(exec))
+		{
+			prom.detach().detach();
+			pinned = true;
+		}
+
+		CoreAwaiter(const CoreAwaiter &other) = delete;
+
+		~CoreAwaiter(void) {
+			if (_subscribed) {
+				_core->release_pinned();
+			} else {
+				_core->release();
+			}
+		}
+
+		//always subscribes, that is what tells whether the value can move
+		bool await_ready(void) {
+			return false;
+		}
+
+		bool await_suspend(std::coroutine_handle<> handle) {
+			_subscribed = true;
+			_core->subscribe(this, _consume);
+			return _resumer.suspend(handle);
+		}
+
+		T await_resume(void) {
+			if (_core->status() == Rejected) {
+				std::rethrow_exception(_core->error());
+			}
+
+			return _take(_core, _sole);
+		}
+
+	private:
+		Core<T>* _core;
+		bool _consume;
+		bool _subscribed;
+		bool _sole;
+		Resumer _resumer;
+
+		static Core<T>* _checked(const Promise<T> &prom) {
+			if (!prom.valid()) {
+				throw Promise_Error("CoreAwaiter(): promise is empty");
+			}
+
+			return prom.core().get();
+		}
+
+		static void _notify(Waiter* w, CoreBase*, bool sole) {
+			CoreAwaiter<T>* self = static_cast<CoreAwaiter<T>*>(w);
+
+			self->_sole = sole;
+			self->_resumer.wake();
+		}
+
+		template <typename U>
+		static U _take(Core<U>* core, bool sole) {
+			if (sole) {
+				return std::move(core->value());
+			}
+
+			return copy_value(core->value());
+		}
+
+		static void _take(Core<void>*, bool) { }
+	};
+
+	template <typename T>
+	CoreAwaiter<T> operator co_await(const Promise<T> &prom) {
+		return CoreAwaiter<T>(prom, nullptr);
+	}
+
+	template <typename T>
+	CoreAwaiter<T> operator co_await(Promise<T> &&prom) {
+		return CoreAwaiter<T>(std::move(prom), nullptr);
+	}
+
+	//awaitable - co_await awaitable(prom, exec) resumes on exec.
+	template <typename T>
+	CoreAwaiter<T> awaitable(const Promise<T> &prom, IEXEC_TYPE exec) {
+		return CoreAwaiter<T>(prom, std::move(exec));
+	}
+
+	template <typename T>
+	CoreAwaiter<T> awaitable(Promise<T> &&prom, IEXEC_TYPE exec) {
+		return CoreAwaiter<T>(std::move(prom), std::move(exec));
+	}
+
+	//CoreCoroutine - promise_type of a coroutine returning Typed::Promise<T>.
+	template <typename T>
+	class CoreCoroutineBase {
+	public:
+		CoreCoroutineBase(void)
+			:_core(make_core<T>())
+		{ }
+
+		Promise<T> get_return_object(void) {
+			return Promise<T>(_core);
+		}
+
+		std::suspend_never initial_suspend(void) noexcept {
+			return std::suspend_never();
+		}
+
+		std::suspend_never final_suspend(void) noexcept {
+			return std::suspend_never();
+		}
+
+		void unhandled_exception(void) {
+			_core->reject(std::current_exception());
+		}
+
+	protected:
+		CorePtr<T> _core;
+	};
+
+	template <typename T>
+	class CoreCoroutine : public CoreCoroutineBase<T> {
+	public:
+		template <typename U>
+		void return_value(U &&value) {
+			this->_core->resolve(std::forward<U>(value));
+		}
+	};
+
+	template <>
+	class CoreCoroutine<void> : public CoreCoroutineBase<void> {
+	public:
+		void return_void(void) {
+			this->_core->resolve();
+		}
+	};
+}
+}
+
+namespace std {
+
+	template <typename... ARGS>
+	struct coroutine_traits<Promises::PROM_TYPE, ARGS...> {
+		typedef Promises::PromiseCoroutine promise_type;
+	};
+
+	template <typename T, typename... ARGS>
+	struct coroutine_traits<Promises::Typed::Promise<T>, ARGS...> {
+		typedef Promises::Typed::CoreCoroutine<T> promise_type;
+	};
+}
+
+#endif // PROMISE_HAS_COROUTINES
+
+#endif // !COROUTINE_H
@@ -0,0 +1,411 @@
+#include "Promise_Error.h"
+#include "Metrics.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+namespace Promises {
+
+	//ExecutorConfig - sizing of a pooled executor.
+	//threads == 0 uses std::thread::hardware_concurrency(),
+	//queue_capacity == 0 leaves the task queue unbounded.
+	struct ExecutorConfig {
+		ExecutorConfig(void)
+			:threads(0),
+			queue_capacity(0)
+		{ }
+
+		ExecutorConfig(size_t t, size_t capacity = 0)
+			:threads(t),
+			queue_capacity(capacity)
+		{ }
+
+		size_t thread_count(void) const {
+			if (threads != 0) {
+				return threads;
+			}
+
+			size_t hw = std::thread::hardware_concurrency();
+			return (hw == 0) ? 4 : hw;
+		}
+
+		size_t threads;
+		size_t queue_capacity;
+	};
+
+	class IExecutor {
+	public:
+		virtual ~IExecutor(void) {}
+
+		//queue task to be run by one of the executor's threads.
+		virtual void submit(std::function<void(void)> task) = 0;
+
+		//run one queued task on the calling thread.
+		//returns false if there was nothing to run.
+		virtual bool try_run_pending(void) = 0;
+
+		//how many tasks it runs at once, for callers sizing their work.
+		virtual size_t thread_count(void) const {
+			return 1;
+		}
+	};
+
+	typedef std::shared_ptr<IExecutor> IEXEC_TYPE;
+
+	//the executor whose worker is the calling thread, nullptr otherwise.
+	inline IExecutor*& current_executor(void) {
+		static thread_local IExecutor* current = nullptr;
+		return current;
+	}
+
+	//TaskErrorHandler - called with an exception a task let escape.
+	//Promise handlers never get here, their exceptions reject the promise.
+	//It runs on the worker and must not throw.
+	typedef void (*TaskErrorHandler)(std::exception_ptr);
+
+	inline std::atomic<TaskErrorHandler>& _task_error_handler(void) {
+		static std::atomic<TaskErrorHandler> handler(nullptr);
+		return handler;
+	}
+
+	//set_task_error_handler - nullptr, the default, drops such exceptions.
+	inline void set_task_error_handler(TaskErrorHandler handler) {
+		_task_error_handler().store(handler, std::memory_order_release);
+	}
+
+	//run_task - runs a task the way every executor does,
+	//so an escaping exception cannot take the worker down with it.
+	inline void run_task(std::function<void(void)> &task) {
+		PROMISE_METRIC(TasksRun, 1);
+
+		try {
+			task();
+		} catch (...) {
+			TaskErrorHandler handler = _task_error_handler().load(std::memory_order_acquire);
+
+			if (handler != nullptr) {
+				handler(std::current_exception());
+			}
+		}
+	}
+
+	//InlineExecutor - runs a task on the submitting thread.
+	//Nested submissions run synchronously until max_depth is reached,
+	//deeper ones go onto the thread's microtask queue, which the
+	//outermost inline task drains before returning. The stack stays bounded
+	//while short synchronous chains never touch another thread.
+	class InlineExecutor : public IExecutor {
+	public:
+		explicit InlineExecutor(size_t max_depth = 16)
+			:_maxDepth(max_depth == 0 ? 1 : max_depth)
+		{ }
+
+		virtual ~InlineExecutor(void) {}
+
+		virtual void submit(std::function<void(void)> task) {
+			PROMISE_METRIC(TasksSubmitted, 1);
+
+			Frame &frame = _frame();
+
+			if (frame.depth >= _maxDepth) {
+				frame.microtasks.push_back(std::move(task));
+				return;
+			}
+
+			++frame.depth;
+			run_task(task);
+			task = nullptr;
+			--frame.depth;
+
+			if (frame.depth == 0) {
+				_drain();
+			}
+		}
+
+		//runs one of the calling thread's microtasks.
+		virtual bool try_run_pending(void) {
+			return run_microtask();
+		}
+
+		size_t max_depth(void) const {
+			return _maxDepth;
+		}
+
+		static bool run_microtask(void) {
+			Frame &frame = _frame();
+
+			if (frame.microtasks.empty()) {
+				return false;
+			}
+
+			std::function<void(void)> task = std::move(frame.microtasks.front());
+			frame.microtasks.pop_front();
+
+			++frame.depth;
+			run_task(task);
+			--frame.depth;
+
+			return true;
+		}
+
+	private:
+		struct Frame {
+			Frame(void)
+				:depth(0)
+			{ }
+
+			size_t depth;
+			std::deque<std::function<void(void)>> microtasks;
+		};
+
+		size_t _maxDepth;
+
+		static Frame& _frame(void) {
+			static thread_local Frame frame;
+			return frame;
+		}
+
+		static void _drain(void) {
+			while (run_microtask()) { }
+		}
+	};
+
+	//help_pending - called by a thread that would otherwise block.
+	//Runs the thread's own microtasks first, then, on a worker, queued pool work.
+	//Sleeping instead could deadlock a fixed-size pool whose workers all
+	//wait on a promise that is still queued behind them.
+	inline bool help_pending(void) {
+		if (InlineExecutor::run_microtask()) {
+			return true;
+		}
+
+		IExecutor* exec = current_executor();
+		return (exec != nullptr) && exec->try_run_pending();
+	}
+
+	//ContinuationPolicy - where resolve/reject handlers run.
+	//Dispatch: on the promise's executor (the default).
+	//Inline: on the thread that settles the promise, or the thread calling
+	//then() if the promise is already settled, see InlineExecutor.
+	//The handler given to promise() always goes to the executor.
+	enum ContinuationPolicy {
+		Dispatch,
+		Inline
+	};
+
+	inline std::atomic<int>& _continuation_policy(void) {
+		static std::atomic<int> policy(Dispatch);
+		return policy;
+	}
+
+	inline ContinuationPolicy continuation_policy(void) {
+		return (ContinuationPolicy)_continuation_policy().load(std::memory_order_relaxed);
+	}
+
+	inline void set_continuation_policy(ContinuationPolicy policy) {
+		_continuation_policy().store(policy, std::memory_order_relaxed);
+	}
+
+	inline InlineExecutor& inline_executor(void) {
+		static InlineExecutor exec;
+		return exec;
+	}
+
+	//ThreadPool - fixed number of workers sharing one FIFO queue.
+	//When the queue is bounded and full, submit() blocks the producer,
+	//unless the producer is one of the workers, in which case the task
+	//runs inline so the pool cannot wait on itself.
+	class ThreadPool : public IExecutor {
+	public:
+		explicit ThreadPool(const ExecutorConfig &config = ExecutorConfig())
+			:_capacity(config.queue_capacity),
+			_stop(false)
+		{
+			size_t count = config.thread_count();
+			_workers.reserve(count);
+
+			for (size_t i = 0; i < count; ++i) {
+				_workers.push_back(std::thread(&ThreadPool::_work, this));
+			}
+		}
+
+		virtual ~ThreadPool(void) {
+			{
+				std::unique_lock<std::mutex> lock(_lock);
+				_stop = true;
+			}
+
+			_notEmpty.notify_all();
+			_notFull.notify_all();
+
+			for (size_t i = 0; i < _workers.size(); ++i) {
+				if (_workers[i].joinable()) {
+					_workers[i].join();
+				}
+			}
+		}
+
+		virtual void submit(std::function<void(void)> task) {
+			PROMISE_METRIC(TasksSubmitted, 1);
+
+			std::unique_lock<std::mutex> lock(_lock);
+
+			//a pool being torn down still accepts the continuations
+			//of its last tasks, they just run on the producer
+			if (_stop) {
+				lock.unlock();
+				run_task(task);
+				return;
+			}
+
+			while (_capacity != 0 && _tasks.size() >= _capacity) {
+				if (current_executor() == this) {
+					lock.unlock();
+					run_task(task);
+					return;
+				}
+
+				_notFull.wait(lock);
+			}
+
+			_tasks.push_back(std::move(task));
+			lock.unlock();
+
+			_notEmpty.notify_one();
+		}
+
+		virtual bool try_run_pending(void) {
+			std::function<void(void)> task;
+
+			if (!_pop(task, false)) {
+				return false;
+			}
+
+			run_task(task);
+			return true;
+		}
+
+		size_t size(void) const {
+			return _workers.size();
+		}
+
+		virtual size_t thread_count(void) const {
+			return _workers.size();
+		}
+
+	private:
+		size_t _capacity;
+		bool _stop;
+		std::mutex _lock;
+		std::condition_variable _notEmpty;
+		std::condition_variable _notFull;
+		std::deque<std::function<void(void)>> _tasks;
+		std::vector<std::thread> _workers;
+
+		bool _pop(std::function<void(void)> &task, bool wait) {
+			std::unique_lock<std::mutex> lock(_lock);
+
+			while (wait && _tasks.empty() && !_stop) {
+				_notEmpty.wait(lock);
+			}
+
+			if (_tasks.empty()) {
+				return false;
+			}
+
+			task = std::move(_tasks.front());
+			_tasks.pop_front();
+			lock.unlock();
+
+			if (_capacity != 0) {
+				_notFull.notify_one();
+			}
+
+			return true;
+		}
+
+		void _work(void) {
+			PROMISE_METRIC(ThreadsStarted, 1);
+			current_executor() = this;
+
+			std::function<void(void)> task;
+
+			//drain whatever is left before honoring _stop
+			while (_pop(task, true)) {
+				run_task(task);
+				task = nullptr;
+			}
+
+			current_executor() = nullptr;
+			PROMISE_METRIC(ThreadsExited, 1);
+		}
+	};
+
+	//ThreadPerTaskExecutor - one new std::thread per task.
+	//This is how promises used to run; kept for comparison in the benchmarks.
+	class ThreadPerTaskExecutor : public IExecutor {
+	public:
+		ThreadPerTaskExecutor(void)
+			:_running(0)
+		{ }
+
+		virtual ~ThreadPerTaskExecutor(void) {
+			std::unique_lock<std::mutex> lock(_lock);
+
+			while (_running != 0) {
+				_done.wait(lock);
+			}
+		}
+
+		virtual void submit(std::function<void(void)> task) {
+			PROMISE_METRIC(TasksSubmitted, 1);
+
+			{
+				std::unique_lock<std::mutex> lock(_lock);
+				++_running;
+			}
+
+			std::thread th(&ThreadPerTaskExecutor::_work, this, std::move(task));
+			th.detach();
+		}
+
+		virtual bool try_run_pending(void) {
+			return false;
+		}
+
+		//as many as there are tasks, so a split is sized for the hardware
+		virtual size_t thread_count(void) const {
+			return ExecutorConfig().thread_count();
+		}
+
+	private:
+		size_t _running;
+		std::mutex _lock;
+		std::condition_variable _done;
+
+		void _work(std::function<void(void)> task) {
+			PROMISE_METRIC(ThreadsStarted, 1);
+
+			run_task(task);
+			task = nullptr;
+
+			PROMISE_METRIC(ThreadsExited, 1);
+
+			std::unique_lock<std::mutex> lock(_lock);
+			if (--_running == 0) {
+				_done.notify_all();
+			}
+		}
+	};
+}
+
+#endif // !EXECUTOR_H
\ No newline at end of file
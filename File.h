@@ -0,0 +1,848 @@
+#include "Promise.h"
+#include "Promise_Error.h"
+#include "Executor.h"
+#include "Allocator.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__) && !defined(PROMISE_NO_URING)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#define PROMISE_HAS_URING 1
+#endif
+
+#ifndef FILE_H
+#define FILE_H
+
+//submission queue entries; reads and writes in flight past this wait their turn.
+#ifndef FS_RING_ENTRIES
+#define FS_RING_ENTRIES 256
+#endif
+
+//registered buffers, and the size of each. Reads that fit land in one.
+#ifndef FS_FIXED_BUFFERS
+#define FS_FIXED_BUFFERS 16
+#endif
+
+#ifndef FS_FIXED_SIZE
+#define FS_FIXED_SIZE 65536
+#endif
+
+//the blocking fallback: its threads, and tasks queued before producers block.
+#ifndef FS_POOL_THREADS
+#define FS_POOL_THREADS 4
+#endif
+
+#ifndef FS_POOL_QUEUE
+#define FS_POOL_QUEUE 1024
+#endif
+
+namespace Promises {
+namespace fs {
+
+	//Buffer - bytes a read put straight into memory the promise hands over.
+	//Copies share the bytes; the memory goes back where it came from,
+	//the heap or a registered slot, once the last copy is gone.
+	class Buffer {
+	public:
+		Buffer(void)
+			:_size(0),
+			_owner(nullptr),
+			_slot(-1)
+		{ }
+
+		//a copy of s, for writes
+		explicit Buffer(const std::string &s)
+			:_bytes(heap(s.size())),
+			_size(s.size()),
+			_owner(nullptr),
+			_slot(-1)
+		{
+			if (!s.empty()) {
+				memcpy(_bytes.get(), s.data(), s.size());
+			}
+		}
+
+		Buffer(std::shared_ptr<char> bytes, size_t size, const void* owner = nullptr, int slot = -1)
+			:_bytes(std::move(bytes)),
+			_size(size),
+			_owner(owner),
+			_slot(slot)
+		{ }
+
+		const char* data(void) const {
+			return _bytes.get();
+		}
+
+		char* data(void) {
+			return _bytes.get();
+		}
+
+		size_t size(void) const {
+			return _size;
+		}
+
+		bool empty(void) const {
+			return _size == 0;
+		}
+
+		std::string str(void) const {
+			return std::string(data(), _size);
+		}
+
+		//owner and slot - the registered buffer the bytes live in, if any
+		const void* owner(void) const {
+			return _owner;
+		}
+
+		int slot(void) const {
+			return _slot;
+		}
+
+		//truncated - the same bytes, only the first size of them
+		Buffer truncated(size_t size) const {
+			return Buffer(_bytes, std::min(size, _size), _owner, _slot);
+		}
+
+		static std::shared_ptr<char> heap(size_t size) {
+			return std::shared_ptr<char>(new char[size == 0 ? 1 : size], std::default_delete<char[]>(), PoolAllocator<char>());
+		}
+
+	private:
+		std::shared_ptr<char> _bytes;
+		size_t _size;
+		const void* _owner;
+		int _slot;
+	};
+
+	//IBackend - how the fs functions reach the disk.
+	//read_at and write_at loop over short transfers, so a read only comes
+	//back short at end of file, and a write writes all of data.
+	class IBackend {
+	public:
+		virtual ~IBackend(void) {}
+
+		//read_at - resolves with a Buffer of up to length bytes from offset.
+		std::shared_ptr<Promise> read_at(int fd, uint64_t offset, size_t length) {
+			return _read(fd, offset, length, false);
+		}
+
+		//write_at - resolves with the number of bytes written.
+		virtual std::shared_ptr<Promise> write_at(int fd, uint64_t offset, Buffer data) = 0;
+
+		//read_file - resolves with a Buffer of the whole file.
+		//The open and fstat run on the caller, only the read is queued.
+		std::shared_ptr<Promise> read_file(const std::string &path) {
+			int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+
+			if (fd < 0) {
+				return Reject(std::system_error(errno, std::generic_category(), "fs::read_file(): " + path));
+			}
+
+			struct stat st;
+			if (fstat(fd, &st) != 0) {
+				int error = errno;
+				::close(fd);
+				return Reject(std::system_error(error, std::generic_category(), "fs::read_file(): " + path));
+			}
+
+			return _read(fd, 0, (size_t)st.st_size, true);
+		}
+
+	protected:
+		//_read - close_after hands fd over, it is closed once the read is done.
+		virtual std::shared_ptr<Promise> _read(int fd, uint64_t offset, size_t length, bool close_after) = 0;
+	};
+
+	//PoolBackend - blocking pread/pwrite on a small ThreadPool. The queue
+	//is bounded, so a producer far ahead of the disk blocks, rather than
+	//queueing without limit.
+	class PoolBackend : public IBackend {
+	public:
+		PoolBackend(size_t threads = FS_POOL_THREADS, size_t queue = FS_POOL_QUEUE)
+			:_pool(ExecutorConfig(threads, queue))
+		{ }
+
+		virtual std::shared_ptr<Promise> write_at(int fd, uint64_t offset, Buffer data) {
+			std::shared_ptr<Promise> prom = make_pooled<Promise>(pending_state);
+
+			_pool.submit([prom, fd, offset, data]() {
+				size_t done = 0;
+
+				while (done < data.size()) {
+					ssize_t n = ::pwrite(fd, data.data() + done, data.size() - done, (off_t)(offset + done));
+
+					if (n < 0 && errno == EINTR) {
+						continue;
+					}
+
+					if (n <= 0) {
+						Settlement(prom.get()).reject(std::system_error(n < 0 ? errno : EIO, std::generic_category(), "fs::write_at()"));
+						return;
+					}
+
+					done += (size_t)n;
+				}
+
+				Settlement(prom.get()).resolve<size_t>(done);
+			});
+
+			return prom;
+		}
+
+	protected:
+		virtual std::shared_ptr<Promise> _read(int fd, uint64_t offset, size_t length, bool close_after) {
+			std::shared_ptr<Promise> prom = make_pooled<Promise>(pending_state);
+
+			_pool.submit([prom, fd, offset, length, close_after]() {
+				std::shared_ptr<char> bytes = Buffer::heap(length);
+				size_t done = 0;
+				int error = 0;
+
+				while (done < length) {
+					ssize_t n = ::pread(fd, bytes.get() + done, length - done, (off_t)(offset + done));
+
+					if (n < 0 && errno == EINTR) {
+						continue;
+					}
+
+					if (n < 0) {
+						error = errno;
+						break;
+					}
+
+					if (n == 0) {
+						break;
+					}
+
+					done += (size_t)n;
+				}
+
+				if (close_after) {
+					::close(fd);
+				}
+
+				if (error != 0) {
+					Settlement(prom.get()).reject(std::system_error(error, std::generic_category(), "fs::read_at()"));
+				} else {
+					Settlement(prom.get()).resolve(Buffer(bytes, done));
+				}
+			});
+
+			return prom;
+		}
+
+	private:
+		ThreadPool _pool;
+	};
+
+#ifdef PROMISE_HAS_URING
+	static_assert(sizeof(std::atomic<unsigned>) == sizeof(unsigned), "ring indices are shared with the kernel as plain unsigned");
+
+	//_Slots - the registered buffers. Shared with every Buffer taken from
+	//it, so the memory outlives the ring if a Buffer does.
+	class _Slots {
+	public:
+		_Slots(size_t count, size_t size)
+			:_memory(nullptr),
+			_size(size)
+		{
+			if (posix_memalign(&_memory, 4096, count * size) != 0) {
+				_memory = nullptr;
+				return;
+			}
+
+			for (size_t i = count; i > 0; --i) {
+				_free.push_back((int)(i - 1));
+			}
+		}
+
+		~_Slots(void) {
+			free(_memory);
+		}
+
+		bool valid(void) const {
+			return _memory != nullptr;
+		}
+
+		size_t size(void) const {
+			return _size;
+		}
+
+		size_t count(void) const {
+			return _free.size();
+		}
+
+		char* at(int slot) const {
+			return static_cast<char*>(_memory) + (size_t)slot * _size;
+		}
+
+		//take - a free slot, or -1 if every one is held by a Buffer
+		int take(void) {
+			std::unique_lock<std::mutex> lock(_lock);
+
+			if (_free.empty()) {
+				return -1;
+			}
+
+			int slot = _free.back();
+			_free.pop_back();
+			return slot;
+		}
+
+		void give(int slot) {
+			std::unique_lock<std::mutex> lock(_lock);
+			_free.push_back(slot);
+		}
+
+	private:
+		void* _memory;
+		size_t _size;
+		std::mutex _lock;
+		std::vector<int> _free;
+	};
+
+	//UringBackend - reads and writes submitted to an io_uring, completed
+	//by one thread that settles the promises. Submissions made while
+	//another thread is in io_uring_enter ride along with its call, so a
+	//burst costs a few syscalls, not one each. Reads that fit a
+	//registered buffer use it (READ_FIXED), writes of a Buffer read
+	//into one use WRITE_FIXED; the rest use plain heap memory.
+	//Either way the kernel writes straight into the Buffer resolved.
+	class UringBackend : public IBackend {
+	public:
+		//open - a ring, or nullptr if this kernel or sandbox has none, or if
+		//it lacks an opcode _prep() sends. Plain READ/WRITE came in 5.6,
+		//so older kernels with a working io_uring_setup get nullptr too.
+		static std::unique_ptr<UringBackend> open(unsigned entries = FS_RING_ENTRIES) {
+			static const uint8_t needed[] = { IORING_OP_READ, IORING_OP_WRITE, IORING_OP_READ_FIXED, IORING_OP_WRITE_FIXED };
+
+			return open(entries, std::vector<uint8_t>(needed, needed + sizeof(needed)));
+		}
+
+		//open - a ring whose kernel supports every opcode in needed.
+		static std::unique_ptr<UringBackend> open(unsigned entries, const std::vector<uint8_t> &needed) {
+			std::unique_ptr<UringBackend> ring(new UringBackend(entries, needed));
+
+			if (ring->_fd < 0) {
+				return nullptr;
+			}
+
+			return ring;
+		}
+
+		//waits for every read and write in flight
+		virtual ~UringBackend(void) {
+			if (_fd < 0) {
+				return;
+			}
+
+			{
+				std::unique_lock<std::mutex> lock(_lock);
+
+				while (_inflight != 0 || !_backlog.empty()) {
+					_idle.wait(lock);
+				}
+
+				//a no-op with no op behind it stops the completion thread
+				io_uring_sqe* sqe = _next_sqe();
+				sqe->opcode = IORING_OP_NOP;
+				sqe->user_data = 0;
+				_push_sqe();
+				_flush(lock);
+			}
+
+			_thread.join();
+			_unmap();
+		}
+
+		UringBackend(const UringBackend&) = delete;
+		UringBackend& operator = (const UringBackend&) = delete;
+
+		virtual std::shared_ptr<Promise> write_at(int fd, uint64_t offset, Buffer data) {
+			std::shared_ptr<Promise> prom = make_pooled<Promise>(pending_state);
+			_Op* op = pool_new<_Op>(prom, fd, offset, true);
+
+			op->bytes = data;
+			op->length = data.size();
+
+			//written from the registered buffer it was read into
+			if (_slots != nullptr && data.owner() == _slots.get()) {
+				op->slot = data.slot();
+			}
+
+			_queue(op);
+			return prom;
+		}
+
+		bool registered(void) const {
+			return _slots != nullptr;
+		}
+
+	protected:
+		virtual std::shared_ptr<Promise> _read(int fd, uint64_t offset, size_t length, bool close_after) {
+			std::shared_ptr<Promise> prom = make_pooled<Promise>(pending_state);
+			_Op* op = pool_new<_Op>(prom, fd, offset, false);
+
+			op->length = length;
+			op->close_after = close_after;
+
+			int slot = (_slots != nullptr && length <= _slots->size()) ? _slots->take() : -1;
+
+			if (slot >= 0) {
+				//the slot goes back when the last Buffer copy lets go
+				std::shared_ptr<_Slots> slots = _slots;
+				std::shared_ptr<char> bytes(slots->at(slot), [slots, slot](char*) {
+					slots->give(slot);
+				}, PoolAllocator<char>());
+
+				op->bytes = Buffer(bytes, length, slots.get(), slot);
+				op->slot = slot;
+			} else {
+				op->bytes = Buffer(Buffer::heap(length), length);
+			}
+
+			_queue(op);
+			return prom;
+		}
+
+	private:
+		//_Op - one read_at or write_at, resubmitted until it is done.
+		struct _Op {
+			_Op(PROM_TYPE p, int f, uint64_t o, bool w)
+				:prom(std::move(p)),
+				fd(f),
+				offset(o),
+				length(0),
+				done(0),
+				slot(-1),
+				write(w),
+				close_after(false)
+			{ }
+
+			PROM_TYPE prom;
+			int fd;
+			uint64_t offset;
+			size_t length;
+			size_t done;
+			int slot;
+			bool write;
+			bool close_after;
+			Buffer bytes;
+		};
+
+		int _fd;
+		unsigned _entries;
+		io_uring_params _params;
+
+		void* _sq_ring;
+		void* _cq_ring;
+		size_t _sq_ring_size;
+		size_t _cq_ring_size;
+		io_uring_sqe* _sqes;
+
+		std::atomic<unsigned>* _sq_head;
+		std::atomic<unsigned>* _sq_tail;
+		unsigned _sq_mask;
+		unsigned* _sq_array;
+		std::atomic<unsigned>* _cq_head;
+		std::atomic<unsigned>* _cq_tail;
+		unsigned _cq_mask;
+		io_uring_cqe* _cqes;
+
+		std::shared_ptr<_Slots> _slots;
+
+		std::mutex _lock;
+		std::condition_variable _idle;
+		unsigned _inflight;
+		unsigned _unsubmitted;
+		bool _submitting;
+		std::deque<_Op*> _backlog;
+		std::thread _thread;
+
+		UringBackend(unsigned entries, const std::vector<uint8_t> &needed)
+			:_fd(-1),
+			_entries(entries),
+			_sq_ring(MAP_FAILED),
+			_cq_ring(MAP_FAILED),
+			_sq_ring_size(0),
+			_cq_ring_size(0),
+			_sqes((io_uring_sqe*)MAP_FAILED),
+			_inflight(0),
+			_unsubmitted(0),
+			_submitting(false)
+		{
+			memset(&_params, 0, sizeof(_params));
+
+			int fd = (int)syscall(__NR_io_uring_setup, entries, &_params);
+			if (fd < 0) {
+				return;
+			}
+
+			_fd = fd;
+			if (!_probe(needed) || !_map()) {
+				_unmap();
+				_fd = -1;
+				return;
+			}
+
+			_entries = _params.sq_entries;
+			_register();
+			_thread = std::thread(&UringBackend::_work, this);
+		}
+
+		//_probe - true if the kernel supports every opcode in needed.
+		//IORING_REGISTER_PROBE is itself 5.6, an older kernel refuses it.
+		bool _probe(const std::vector<uint8_t> &needed) {
+			const unsigned count = 256;
+			std::vector<char> bytes(sizeof(io_uring_probe) + count * sizeof(io_uring_probe_op), 0);
+			io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(bytes.data());
+
+			if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_PROBE, probe, count) != 0) {
+				return false;
+			}
+
+			for (size_t i = 0; i < needed.size(); ++i) {
+				if (needed[i] > probe->last_op || !(probe->ops[needed[i]].flags & IO_URING_OP_SUPPORTED)) {
+					return false;
+				}
+			}
+
+			return true;
+		}
+
+		bool _map(void) {
+			_sq_ring_size = _params.sq_off.array + _params.sq_entries * sizeof(unsigned);
+			_cq_ring_size = _params.cq_off.cqes + _params.cq_entries * sizeof(io_uring_cqe);
+
+			//one mapping for both rings where the kernel allows it
+			if (_params.features & IORING_FEAT_SINGLE_MMAP) {
+				_sq_ring_size = _cq_ring_size = std::max(_sq_ring_size, _cq_ring_size);
+			}
+
+			_sq_ring = mmap(nullptr, _sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQ_RING);
+			if (_sq_ring == MAP_FAILED) {
+				return false;
+			}
+
+			if (_params.features & IORING_FEAT_SINGLE_MMAP) {
+				_cq_ring = _sq_ring;
+			} else {
+				_cq_ring = mmap(nullptr, _cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_CQ_RING);
+				if (_cq_ring == MAP_FAILED) {
+					return false;
+				}
+			}
+
+			_sqes = (io_uring_sqe*)mmap(nullptr, _params.sq_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, _fd, IORING_OFF_SQES);
+			if (_sqes == MAP_FAILED) {
+				return false;
+			}
+
+			char* sq = static_cast<char*>(_sq_ring);
+			_sq_head = reinterpret_cast<std::atomic<unsigned>*>(sq + _params.sq_off.head);
+			_sq_tail = reinterpret_cast<std::atomic<unsigned>*>(sq + _params.sq_off.tail);
+			_sq_mask = *reinterpret_cast<unsigned*>(sq + _params.sq_off.ring_mask);
+			_sq_array = reinterpret_cast<unsigned*>(sq + _params.sq_off.array);
+
+			char* cq = static_cast<char*>(_cq_ring);
+			_cq_head = reinterpret_cast<std::atomic<unsigned>*>(cq + _params.cq_off.head);
+			_cq_tail = reinterpret_cast<std::atomic<unsigned>*>(cq + _params.cq_off.tail);
+			_cq_mask = *reinterpret_cast<unsigned*>(cq + _params.cq_off.ring_mask);
+			_cqes = reinterpret_cast<io_uring_cqe*>(cq + _params.cq_off.cqes);
+
+			return true;
+		}
+
+		void _unmap(void) {
+			if (_sqes != MAP_FAILED) {
+				munmap(_sqes, _params.sq_entries * sizeof(io_uring_sqe));
+			}
+
+			if (_cq_ring != MAP_FAILED && _cq_ring != _sq_ring) {
+				munmap(_cq_ring, _cq_ring_size);
+			}
+
+			if (_sq_ring != MAP_FAILED) {
+				munmap(_sq_ring, _sq_ring_size);
+			}
+
+			if (_fd >= 0) {
+				::close(_fd);
+			}
+		}
+
+		//_register - pin the slots with the kernel. Without them
+		//(e.g. RLIMIT_MEMLOCK too low) every read uses the heap.
+		void _register(void) {
+			std::shared_ptr<_Slots> slots = std::make_shared<_Slots>(FS_FIXED_BUFFERS, FS_FIXED_SIZE);
+
+			if (!slots->valid()) {
+				return;
+			}
+
+			std::vector<iovec> iov(slots->count());
+			for (size_t i = 0; i < iov.size(); ++i) {
+				iov[i].iov_base = slots->at((int)i);
+				iov[i].iov_len = slots->size();
+			}
+
+			if (syscall(__NR_io_uring_register, _fd, IORING_REGISTER_BUFFERS, iov.data(), (unsigned)iov.size()) == 0) {
+				_slots = slots;
+			}
+		}
+
+		int _enter(unsigned submit, unsigned wait, unsigned flags) {
+			return (int)syscall(__NR_io_uring_enter, _fd, submit, wait, flags, nullptr, (size_t)0);
+		}
+
+		//_next_sqe / _push_sqe - fill the entry at the tail, then publish it.
+		//Only called with _lock held and fewer than _entries in flight.
+		io_uring_sqe* _next_sqe(void) {
+			unsigned tail = _sq_tail->load(std::memory_order_relaxed);
+			io_uring_sqe* sqe = &_sqes[tail & _sq_mask];
+
+			memset(sqe, 0, sizeof(*sqe));
+			return sqe;
+		}
+
+		void _push_sqe(void) {
+			unsigned tail = _sq_tail->load(std::memory_order_relaxed);
+
+			_sq_array[tail & _sq_mask] = tail & _sq_mask;
+			_sq_tail->store(tail + 1, std::memory_order_release);
+			++_unsubmitted;
+		}
+
+		void _prep(_Op* op) {
+			io_uring_sqe* sqe = _next_sqe();
+			size_t left = op->length - op->done;
+
+			sqe->fd = op->fd;
+			sqe->off = op->offset + op->done;
+			sqe->addr = (uint64_t)(uintptr_t)(op->bytes.data() + op->done);
+			sqe->len = (unsigned)std::min<size_t>(left, 1u << 30);
+			sqe->user_data = (uint64_t)(uintptr_t)op;
+
+			if (op->slot >= 0) {
+				sqe->opcode = op->write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+				sqe->buf_index = (uint16_t)op->slot;
+			} else {
+				sqe->opcode = op->write ? IORING_OP_WRITE : IORING_OP_READ;
+			}
+
+			_push_sqe();
+		}
+
+		//_queue - into the ring, or the backlog while the ring is full.
+		void _queue(_Op* op) {
+			std::unique_lock<std::mutex> lock(_lock);
+
+			if (_inflight >= _entries) {
+				_backlog.push_back(op);
+				return;
+			}
+
+			++_inflight;
+			_prep(op);
+			_flush(lock);
+		}
+
+		//_flush - submit what is queued. A thread already submitting
+		//takes everything queued meanwhile with it on its next pass.
+		void _flush(std::unique_lock<std::mutex> &lock) {
+			if (_submitting) {
+				return;
+			}
+			_submitting = true;
+
+			while (_unsubmitted != 0) {
+				unsigned count = _unsubmitted;
+				_unsubmitted = 0;
+
+				lock.unlock();
+				int n = _enter(count, 0, 0);
+				int error = errno;
+				lock.lock();
+
+				if (n < 0) {
+					_unsubmitted += count;
+
+					if (error == EINTR) {
+						continue;
+					}
+
+					//EAGAIN/EBUSY: with something in the kernel, the completion
+					//thread wakes for it and flushes again once it has reaped.
+					//With nothing there it never would, so retry here.
+					if (_inflight > _unsubmitted) {
+						break;
+					}
+
+					lock.unlock();
+					std::this_thread::yield();
+					lock.lock();
+					continue;
+				}
+
+				_unsubmitted += count - (unsigned)n;
+			}
+
+			_submitting = false;
+		}
+
+		//_complete - res is the bytes moved, or -errno. A short transfer
+		//goes back in for the rest; otherwise op settles and is freed.
+		void _complete(_Op* op, int res) {
+			if (res == -EINTR || res == -EAGAIN) {
+				_queue(op);
+				return;
+			}
+
+			if (res > 0) {
+				op->done += (size_t)res;
+
+				if (op->done < op->length) {
+					_queue(op);
+					return;
+				}
+			}
+
+			PROM_TYPE prom = std::move(op->prom);
+			Buffer bytes = std::move(op->bytes);
+			size_t done = op->done;
+			bool write = op->write;
+
+			if (op->close_after) {
+				::close(op->fd);
+			}
+			pool_delete(op);
+
+			if (res < 0 || (write && res == 0 && done < bytes.size())) {
+				int error = (res < 0) ? -res : EIO;
+				Settlement(prom.get()).reject(std::system_error(error, std::generic_category(), write ? "fs::write_at()" : "fs::read_at()"));
+			} else if (write) {
+				Settlement(prom.get()).resolve<size_t>(done);
+			} else {
+				//short only at end of file
+				Settlement(prom.get()).resolve(bytes.truncated(done));
+			}
+		}
+
+		void _work(void) {
+			std::vector<std::pair<_Op*, int>> done;
+			bool stop = false;
+
+			while (!stop) {
+				_enter(0, 1, IORING_ENTER_GETEVENTS);
+
+				unsigned head = _cq_head->load(std::memory_order_relaxed);
+				unsigned tail = _cq_tail->load(std::memory_order_acquire);
+
+				while (head != tail) {
+					io_uring_cqe* cqe = &_cqes[head & _cq_mask];
+					done.push_back(std::make_pair((_Op*)(uintptr_t)cqe->user_data, cqe->res));
+					++head;
+				}
+				_cq_head->store(head, std::memory_order_release);
+
+				{
+					std::unique_lock<std::mutex> lock(_lock);
+
+					for (size_t i = 0; i < done.size(); ++i) {
+						if (done[i].first != nullptr) {
+							--_inflight;
+						}
+					}
+				}
+
+				for (size_t i = 0; i < done.size(); ++i) {
+					if (done[i].first == nullptr) {
+						stop = true;
+					} else {
+						_complete(done[i].first, done[i].second);
+					}
+				}
+				done.clear();
+
+				std::unique_lock<std::mutex> lock(_lock);
+
+				while (!_backlog.empty() && _inflight < _entries) {
+					++_inflight;
+					_prep(_backlog.front());
+					_backlog.pop_front();
+				}
+
+				_flush(lock);
+
+				if (_inflight == 0 && _backlog.empty()) {
+					_idle.notify_all();
+				}
+			}
+		}
+	};
+#endif
+
+	//or_pool - chosen, or the blocking pool if nothing was.
+	inline std::unique_ptr<IBackend> or_pool(std::unique_ptr<IBackend> chosen) {
+		if (chosen == nullptr) {
+			chosen.reset(new PoolBackend());
+		}
+
+		return chosen;
+	}
+
+	//backend - io_uring where the kernel offers it, the blocking pool otherwise.
+	//Never destroyed, reads may still complete while statics are torn down.
+	inline IBackend& backend(void) {
+		static IBackend* chosen = nullptr;
+		static std::once_flag once;
+
+		std::call_once(once, []() {
+#ifdef PROMISE_HAS_URING
+			chosen = or_pool(UringBackend::open()).release();
+#else
+			chosen = or_pool(nullptr).release();
+#endif
+		});
+
+		return *chosen;
+	}
+
+	inline std::shared_ptr<Promise> read_file(const std::string &path) {
+		return backend().read_file(path);
+	}
+
+	inline std::shared_ptr<Promise> read_at(int fd, uint64_t offset, size_t length) {
+		return backend().read_at(fd, offset, length);
+	}
+
+	inline std::shared_ptr<Promise> write_at(int fd, uint64_t offset, Buffer data) {
+		return backend().write_at(fd, offset, std::move(data));
+	}
+
+	inline std::shared_ptr<Promise> write_at(int fd, uint64_t offset, const std::string &data) {
+		return backend().write_at(fd, offset, Buffer(data));
+	}
+}
+}
+
+#endif // !FILE_H
@@ -2,6 +2,7 @@
 #define IPROMISE_H
 
 #include "State.h"
+#include <chrono>
 #include <memory>
 
 namespace Promises {
@@ -16,11 +17,15 @@ namespace Promises {
 		virtual void _resolve(std::shared_ptr<State> state) = 0;
 		virtual void _reject(std::shared_ptr<State> state) = 0;
 		virtual void Join(void) = 0;
+		virtual bool Join(std::chrono::steady_clock::time_point deadline) = 0;
 
 		friend class Settlement;
 
 		template <typename T>
 		friend T* await(std::shared_ptr<IPromise>);
+
+		template <typename T>
+		friend T* await_until(std::shared_ptr<IPromise>, std::chrono::steady_clock::time_point);
 	};
 	
 	typedef std::shared_ptr<IPromise> IPROM_TYPE;
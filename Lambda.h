@@ -1,5 +1,12 @@
 #include "IPromise.h"
 #include "State.h"
+#include "Allocator.h"
+#include "Promise_Error.h"
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
 
 #ifndef LAMBDA_H
 #define LAMBDA_H
@@ -32,18 +39,74 @@ namespace Promises {
         typedef typename lambda_traits<LAMBDA>::result_type result_type;
         typedef typename enable_if<!std::is_same<result_type, void>::value, LAMBDA>::type type;
     };
+
+	//copy_value - copy a value a handler wants to own while others
+	//may still read it. A move-only value cannot be shared that way.
+	template <typename T>
+	typename std::enable_if<std::is_copy_constructible<T>::value, T>::type copy_value(T &value) {
+		return value;
+	}
+
+	template <typename T>
+	typename std::enable_if<!std::is_copy_constructible<T>::value, T>::type copy_value(T &) {
+		throw Promise_Error("copy_value(): value is move-only and has more than one consumer");
+	}
+
+	//own_value - a value for a handler that may change it: moved out
+	//when it is the only consumer, its own copy otherwise.
+	template <typename T>
+	T own_value(T &value, bool sole) {
+		if (sole) {
+			return std::move(value);
+		}
+
+		return copy_value(value);
+	}
+
+	//pass_value - hand a stored value to a handler taking ARG.
+	//const T& handlers read it in place. By-value and T&& handlers
+	//get it moved when they are its only consumer, copied otherwise,
+	//and so do T& handlers, which may change what they are given.
+	template <typename ARG>
+	struct pass_value {
+		template <typename LAMBDA, typename T>
+		static auto call(LAMBDA &lam, T &value, bool sole) -> decltype(lam(std::move(value))) {
+			if (sole) {
+				return lam(std::move(value));
+			}
+
+			return lam(copy_value(value));
+		}
+	};
+
+	template <typename ARG>
+	struct pass_value<ARG&> {
+		template <typename LAMBDA, typename T>
+		static auto call(LAMBDA &lam, T &value, bool sole) -> decltype(lam(value)) {
+			T own = own_value(value, sole);
+			return lam(own);
+		}
+	};
+
+	template <typename ARG>
+	struct pass_value<const ARG&> {
+		template <typename LAMBDA, typename T>
+		static auto call(LAMBDA &lam, T &value, bool) -> decltype(lam(value)) {
+			return lam(value);
+		}
+	};
 	
 	template<typename Continue>
     struct Chain {
 
-        template<typename LAMBDA, typename T>
-        std::shared_ptr<IPromise> chain (LAMBDA lam, T &value) {
-			std::shared_ptr<IPromise> prom = lam(value);
+        template<typename LAMBDA, typename ARG, typename T>
+        std::shared_ptr<IPromise> chain (LAMBDA &lam, T &value, bool sole) {
+			std::shared_ptr<IPromise> prom = pass_value<ARG>::call(lam, value, sole);
             return prom;
         }
 
 		template<typename LAMBDA>
-		std::shared_ptr<IPromise> chain (LAMBDA lam) {
+		std::shared_ptr<IPromise> chain (LAMBDA &lam) {
 			std::shared_ptr<IPromise> prom = lam();
             return prom;
         }
@@ -52,116 +115,273 @@ namespace Promises {
     template<>
     struct Chain <void> {
 
-        template<typename LAMBDA, typename T>
-        std::shared_ptr<IPromise> chain (LAMBDA lam, T &value) {
-			lam(value);
+        template<typename LAMBDA, typename ARG, typename T>
+        std::shared_ptr<IPromise> chain (LAMBDA &lam, T &value, bool sole) {
+			pass_value<ARG>::call(lam, value, sole);
             return nullptr;
         }
 
 		template<typename LAMBDA>
-		std::shared_ptr<IPromise> chain (LAMBDA lam) {
+		std::shared_ptr<IPromise> chain (LAMBDA &lam) {
 			lam();
             return nullptr;
         }
     };
 
-	class ILambda {
-	public:
-		virtual ~ILambda(void) {}
-		virtual void call(IPromise* prom) = 0;
-		virtual std::shared_ptr<IPromise> call(std::shared_ptr<State> stat) = 0;
+	//reason_arg - what a reject handler taking ARG is passed:
+	//the reason, or the rejected state itself, to pass the rejection on as is.
+	template <typename ARG>
+	struct reason_arg {
+		static const std::exception& get(std::shared_ptr<State> &stat) {
+			return stat->get_reason();
+		}
 	};
 
-	typedef std::shared_ptr<ILambda> ILAM_TYPE;
+	template <>
+	struct reason_arg<std::shared_ptr<State>> {
+		static std::shared_ptr<State>& get(std::shared_ptr<State> &stat) {
+			return stat;
+		}
+	};
 
+	//RejectedLambda, ResolvedLambda and the lambdas in Promise.h wrap a user
+	//handler with what a promise needs to run it. They are stored in a Handler,
+	//so they are plain values: no base class, nothing virtual.
 	template<typename LAMBDA>
-	class RejectedLambda : public ILambda {
+	class RejectedLambda {
 	public:
 		RejectedLambda(LAMBDA l)
-			: _lam(l)
+			: _lam(std::move(l))
 		{ }
 
-		RejectedLambda(const RejectedLambda<LAMBDA> &other)
-			:_lam(other._lam)
-		{ }
-
-		~RejectedLambda(void) { }
-
-		RejectedLambda<LAMBDA>& operator = (const RejectedLambda<LAMBDA> &other) {
-			this->_lam = other._lam;
-			return (*this);
-		}
-
-		virtual std::shared_ptr<IPromise> call(std::shared_ptr<State> stat) {
+		std::shared_ptr<IPromise> call(std::shared_ptr<State> stat) {
 			if (stat == NULL | stat == nullptr) {
 				throw std::logic_error("RejectedLambda.call(): state is null");
 			}
 			
 			typedef typename lambda_if_not_void<LAMBDA>::type chain_type;
+			typedef typename lambda_traits<LAMBDA>::arg_type arg_type;
 			Chain<chain_type> chainer;
-			const std::exception& reason = stat->get_reason();
-			std::shared_ptr<IPromise> p = chainer.template chain<LAMBDA, const std::exception>(_lam, reason);
+			std::shared_ptr<IPromise> p = chainer.template chain<LAMBDA, arg_type>(_lam, reason_arg<typename std::decay<arg_type>::type>::get(stat), false);
 
 			return p;
 		}
 
 	private:
 		LAMBDA _lam;
-
-		virtual void call(IPromise* prom) { }
 	};
 
 	template <typename LAMBDA>
-	class ResolvedLambda : public ILambda {
+	class ResolvedLambda {
 	public:
 		ResolvedLambda(LAMBDA l)
-			: _lam(l)
-		{ }
-
-		ResolvedLambda(const ResolvedLambda<LAMBDA> &other)
-			:_lam(other._lam)
+			: _lam(std::move(l))
 		{ }
 
-		~ResolvedLambda(void) { }
-
-		ResolvedLambda<LAMBDA>& operator = (const ResolvedLambda<LAMBDA> &other) {
-			this->_lam = other._lam;
-			return (*this);
-		}
-
-		virtual std::shared_ptr<IPromise> call(std::shared_ptr<State> stat) {
+		std::shared_ptr<IPromise> call(std::shared_ptr<State> stat) {
 			if (stat == NULL | stat == nullptr) {
 				throw std::logic_error("ResolvedLambda.call(): state is null");
 			}
 			
 			typedef typename lambda_if_not_void<LAMBDA>::type chain_type;
 			typedef typename lambda_traits<LAMBDA>::arg_type arg_type;
+			typedef typename std::decay<arg_type>::type value_type;
 			Chain<chain_type> chainer;
-			arg_type *value = (arg_type *)stat->get_value();
-			std::shared_ptr<IPromise> p = chainer.template chain<LAMBDA, arg_type>(_lam, *value);
+			value_type *value = (value_type *)stat->get_value();
+
+			//nobody else holds the state once the parent promise is gone,
+			//so the value can be moved into the handler
+			bool sole = stat.use_count() == 1;
+			std::shared_ptr<IPromise> p = chainer.template chain<LAMBDA, arg_type>(_lam, *value, sole);
 
 			return p;
 		}
 
 	private:
 		LAMBDA _lam;
-
-		virtual void call(IPromise* prom) { }
 	};
 
 	template<typename LAMBDA>
-	std::shared_ptr<RejectedLambda<LAMBDA>> rejected_lambda(LAMBDA lam) {
-		std::shared_ptr<RejectedLambda<LAMBDA>> rejlam = std::make_shared<RejectedLambda<LAMBDA>>(lam);
-		
-		return rejlam;
+	RejectedLambda<LAMBDA> rejected_lambda(LAMBDA lam) {
+		return RejectedLambda<LAMBDA>(std::move(lam));
 	}
 
 	template<typename LAMBDA>
-	std::shared_ptr<ResolvedLambda<LAMBDA>> resolved_lambda(LAMBDA lam) {
-		std::shared_ptr<ResolvedLambda<LAMBDA>> reslam = std::make_shared<ResolvedLambda<LAMBDA>>(lam);
+	ResolvedLambda<LAMBDA> resolved_lambda(LAMBDA lam) {
+		return ResolvedLambda<LAMBDA>(std::move(lam));
+	}
+
+	//handler_call - resolve/reject wrappers take the state, settlement wrappers the promise.
+	template <typename F>
+	auto handler_call(F &f, IPromise*, std::shared_ptr<State>* stat, int) -> decltype(f.call(std::move(*stat))) {
+		return f.call(std::move(*stat));
+	}
 
-		return reslam;
+	template <typename F>
+	auto handler_call(F &f, IPromise* prom, std::shared_ptr<State>*, long) -> decltype(f.call(prom), std::shared_ptr<IPromise>()) {
+		f.call(prom);
+		return nullptr;
 	}
+
+	//Handler - a move-only box for any of the lambda wrappers.
+	//A wrapper of up to buffer_size bytes that moves without throwing lives
+	//in the handler itself, which covers a lambda capturing a few pointers;
+	//anything bigger goes to one block from the pool.
+	//Calling it is a single indirect call through _invoke.
+	class Handler {
+	public:
+		static const size_t buffer_size = 48;
+
+		//stored_inline - whether a wrapper of type F skips the pool.
+		template <typename F>
+		static constexpr bool stored_inline(void) {
+			return sizeof(F) <= buffer_size && alignof(F) <= alignof(std::max_align_t) && std::is_nothrow_move_constructible<F>::value;
+		}
+
+		Handler(void)
+			:_invoke(nullptr),
+			_manage(nullptr)
+		{ }
+
+		Handler(std::nullptr_t)
+			:_invoke(nullptr),
+			_manage(nullptr)
+		{ }
+
+		template <typename F,
+			typename = typename std::enable_if<!std::is_same<F, Handler>::value>::type,
+			typename = decltype(handler_call(std::declval<F&>(), nullptr, nullptr, 0))>
+		Handler(F f)
+			:_invoke(&_call<F>),
+			_manage(&_Store<F>::move_or_destroy)
+		{
+			_Store<F>::put(_buffer, std::move(f));
+		}
+
+		Handler(Handler &&other)
+			:_invoke(other._invoke),
+			_manage(other._manage)
+		{
+			if (_manage != nullptr) {
+				_manage(other._buffer, _buffer);
+			}
+
+			other._invoke = nullptr;
+			other._manage = nullptr;
+		}
+
+		Handler(const Handler &other) = delete;
+
+		~Handler(void) {
+			_reset();
+		}
+
+		Handler& operator = (Handler &&other) {
+			if (this != &other) {
+				_reset();
+
+				_invoke = other._invoke;
+				_manage = other._manage;
+
+				if (_manage != nullptr) {
+					_manage(other._buffer, _buffer);
+				}
+
+				other._invoke = nullptr;
+				other._manage = nullptr;
+			}
+
+			return (*this);
+		}
+
+		Handler& operator = (std::nullptr_t) {
+			_reset();
+			return (*this);
+		}
+
+		Handler& operator = (const Handler &other) = delete;
+
+		//call - run a settlement handler on prom.
+		void call(IPromise* prom) {
+			_invoke(_buffer, prom, nullptr);
+		}
+
+		//call - run a resolve/reject handler on stat, returning what it chains to.
+		std::shared_ptr<IPromise> call(std::shared_ptr<State> stat) {
+			return _invoke(_buffer, nullptr, &stat);
+		}
+
+		friend bool operator == (const Handler &handler, std::nullptr_t) {
+			return handler._invoke == nullptr;
+		}
+
+		friend bool operator != (const Handler &handler, std::nullptr_t) {
+			return handler._invoke != nullptr;
+		}
+
+	private:
+		typedef std::shared_ptr<IPromise> (*Invoke)(void*, IPromise*, std::shared_ptr<State>*);
+		//_manage - with to, move the handler in from over to; without, destroy it.
+		typedef void (*Manage)(void* from, void* to);
+
+		Invoke _invoke;
+		Manage _manage;
+		alignas(std::max_align_t) unsigned char _buffer[buffer_size];
+
+		template <typename F, bool INLINE = stored_inline<F>()>
+		struct _Store {
+			static void put(void* buffer, F &&f) {
+				new (buffer) F(std::move(f));
+			}
+
+			static F& get(void* buffer) {
+				return *static_cast<F*>(buffer);
+			}
+
+			static void move_or_destroy(void* from, void* to) {
+				if (to != nullptr) {
+					new (to) F(std::move(get(from)));
+				}
+
+				get(from).~F();
+			}
+		};
+
+		template <typename F>
+		struct _Store<F, false> {
+			static void put(void* buffer, F &&f) {
+				*static_cast<F**>(buffer) = pool_new<F>(std::move(f));
+			}
+
+			static F& get(void* buffer) {
+				return **static_cast<F**>(buffer);
+			}
+
+			static void move_or_destroy(void* from, void* to) {
+				if (to != nullptr) {
+					*static_cast<F**>(to) = *static_cast<F**>(from);
+				} else {
+					pool_delete(*static_cast<F**>(from));
+				}
+			}
+		};
+
+		template <typename F>
+		static std::shared_ptr<IPromise> _call(void* buffer, IPromise* prom, std::shared_ptr<State>* stat) {
+			return handler_call(_Store<F>::get(buffer), prom, stat, 0);
+		}
+
+		void _reset(void) {
+			if (_manage != nullptr) {
+				_manage(_buffer, nullptr);
+			}
+
+			_invoke = nullptr;
+			_manage = nullptr;
+		}
+	};
+
+	typedef Handler ILAM_TYPE;
 }
 
 #endif // !LAMBDA_H
\ No newline at end of file
@@ -0,0 +1,236 @@
+#include "Promise.h"
+#include "Promise_Error.h"
+#include "Cancellation.h"
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+#ifndef LIMITER_H
+#define LIMITER_H
+
+namespace Promises {
+
+	//Overloaded - what a Limiter rejects a task it has no room for with.
+	class Overloaded : public Promise_Error {
+	public:
+		Overloaded(void)
+			:Promise_Error("overloaded")
+		{ }
+	};
+
+	//LimitPolicy - what a Limiter does with a task while every slot is taken.
+	//QueueExcess: waits for a slot, up to the queue's capacity.
+	//RejectExcess: rejects with Overloaded at once.
+	enum LimitPolicy {
+		QueueExcess,
+		RejectExcess
+	};
+
+	//Limiter - runs at most limit tasks at a time. A task is a factory
+	//returning the PROM_TYPE of the work it starts; it is only called once
+	//a slot is free, and the slot is held until that promise settles.
+	//The promise submit() returns settles like the task's promise.
+	class Limiter {
+	public:
+		//queue_capacity - tasks that may wait for a slot, 0 for no limit.
+		//Past it, QueueExcess rejects with Overloaded too.
+		Limiter(size_t limit, LimitPolicy policy = QueueExcess, size_t queue_capacity = 0)
+			:_shared(std::make_shared<_Shared>(limit == 0 ? 1 : limit, policy, queue_capacity))
+		{ }
+
+		//tasks still waiting for a slot are rejected with Cancelled,
+		//those already running finish as usual.
+		~Limiter(void) {
+			std::deque<_Waiting> dropped;
+
+			{
+				std::unique_lock<std::mutex> lock(_shared->lock);
+				dropped.swap(_shared->waiting);
+			}
+
+			for (size_t i = 0; i < dropped.size(); ++i) {
+				Settlement(dropped[i].result.get()).reject(cancelled_state());
+			}
+		}
+
+		Limiter(const Limiter&) = delete;
+		Limiter& operator = (const Limiter&) = delete;
+
+		//submit - factory() when a slot is free, now or later.
+		template <typename FACTORY>
+		std::shared_ptr<Promise> submit(FACTORY factory) {
+			std::shared_ptr<Promise> result = make_pooled<Promise>(pending_state);
+			Handler start(_Start<FACTORY>(std::move(factory), _shared, result));
+
+			{
+				std::unique_lock<std::mutex> lock(_shared->lock);
+
+				if (_shared->running == _shared->limit) {
+					if (_shared->policy == RejectExcess || (_shared->capacity != 0 && _shared->waiting.size() >= _shared->capacity)) {
+						lock.unlock();
+						Settlement(result.get()).reject(Overloaded());
+						return result;
+					}
+
+					_shared->waiting.push_back(_Waiting(result, std::move(start)));
+					return result;
+				}
+
+				++_shared->running;
+			}
+
+			start.call(result.get());
+			return result;
+		}
+
+		size_t limit(void) const {
+			return _shared->limit;
+		}
+
+		//running - tasks holding a slot
+		size_t running(void) const {
+			std::unique_lock<std::mutex> lock(_shared->lock);
+			return _shared->running;
+		}
+
+		//queued - tasks waiting for one
+		size_t queued(void) const {
+			std::unique_lock<std::mutex> lock(_shared->lock);
+			return _shared->waiting.size();
+		}
+
+	private:
+		//_Waiting - a task and the promise it settles.
+		struct _Waiting {
+			_Waiting(std::shared_ptr<Promise> r, Handler s)
+				:result(std::move(r)),
+				start(std::move(s))
+			{ }
+
+			std::shared_ptr<Promise> result;
+			Handler start;
+		};
+
+		//_Shared - outlives the Limiter while tasks it started still run.
+		struct _Shared {
+			_Shared(size_t n, LimitPolicy p, size_t c)
+				:limit(n),
+				policy(p),
+				capacity(c),
+				running(0),
+				freed(0),
+				starting(false)
+			{ }
+
+			const size_t limit;
+			const LimitPolicy policy;
+			const size_t capacity;
+
+			std::mutex lock;
+			size_t running;
+			std::deque<_Waiting> waiting;
+
+			//slots given back while one thread is starting waiting tasks,
+			//which that thread hands on before it returns
+			size_t freed;
+			bool starting;
+
+			//release - a task settled. Its slot goes straight to the oldest
+			//waiting task, if there is one. A task failing as it starts
+			//releases again from inside, which only counts here, so a
+			//queue of failing tasks does not recurse once per task.
+			void release(void) {
+				std::unique_lock<std::mutex> lock(this->lock);
+
+				++freed;
+				if (starting) {
+					return;
+				}
+				starting = true;
+
+				while (freed != 0) {
+					--freed;
+
+					if (waiting.empty()) {
+						--running;
+						continue;
+					}
+
+					_Waiting next(std::move(waiting.front()));
+					waiting.pop_front();
+
+					lock.unlock();
+					next.start.call(next.result.get());
+					lock.lock();
+				}
+
+				starting = false;
+			}
+		};
+
+		//_Start - a task, run as a settlement handler on its result promise.
+		//The task's promise must settle or end, or its slot is never given back.
+		template <typename FACTORY>
+		struct _Start {
+			_Start(FACTORY f, std::shared_ptr<_Shared> s, std::shared_ptr<Promise> r)
+				:factory(std::move(f)),
+				shared(std::move(s)),
+				result(std::move(r))
+			{ }
+
+			FACTORY factory;
+			std::shared_ptr<_Shared> shared;
+			std::shared_ptr<Promise> result;
+
+			void call(IPromise* settle) {
+				PROM_TYPE prom;
+
+				try {
+					prom = factory();
+				} catch (...) {
+					Settlement(settle).reject(std::current_exception());
+					shared->release();
+					return;
+				}
+
+				if (prom == nullptr) {
+					Settlement(settle).reject(Promise_Error("Limiter.submit(): task returned no promise"));
+					shared->release();
+					return;
+				}
+
+				//a chain that already ended has nothing to wait on
+				if (prom->get_state() == nullptr) {
+					_ended(settle);
+					shared->release();
+					return;
+				}
+
+				//the handler is given the state, holding on to prom
+				//from one of its own continuations would keep it alive
+				std::shared_ptr<_Shared> owner = shared;
+				std::shared_ptr<Promise> forward = result;
+				prom->finally([owner, forward](std::shared_ptr<State> state) {
+					if (state != nullptr) {
+						Settlement(forward.get()).settle(state);
+					} else {
+						_ended(forward.get());
+					}
+
+					owner->release();
+				});
+			}
+
+			//_ended - the task's last handler returned nothing
+			static void _ended(IPromise* settle) {
+				Settlement(settle).reject(Promise_Error("Limiter.submit(): task ended without a value"));
+			}
+		};
+
+		std::shared_ptr<_Shared> _shared;
+	};
+}
+
+#endif // !LIMITER_H
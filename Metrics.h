@@ -0,0 +1,299 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#ifndef METRICS_H
+#define METRICS_H
+
+//Compile with PROMISE_METRICS defined to count what the runtime does.
+//Without it the hooks below expand to nothing and metrics() reads all zeros.
+#ifdef PROMISE_METRICS
+#define PROMISE_METRIC(counter, n) ::Promises::Metrics::add(::Promises::Metrics::counter, (n))
+#define PROMISE_METRIC_START(stamp) uint64_t stamp = ::Promises::Metrics::now()
+#define PROMISE_METRIC_STAMP(stamp) ((stamp) = ::Promises::Metrics::now())
+#define PROMISE_METRIC_SINCE(histogram, stamp) ::Promises::Metrics::sample(::Promises::Metrics::histogram, ::Promises::Metrics::now() - (stamp))
+#else
+#define PROMISE_METRIC(counter, n) ((void)0)
+#define PROMISE_METRIC_START(stamp) ((void)0)
+#define PROMISE_METRIC_STAMP(stamp) ((void)0)
+#define PROMISE_METRIC_SINCE(histogram, stamp) ((void)0)
+#endif
+
+namespace Promises {
+namespace Metrics {
+
+	//Counter - monotonic totals, the gauges in MetricsSnapshot are differences of them.
+	enum Counter {
+		PromisesCreated,
+		PromisesDestroyed,
+		PromisesSettled,
+		PromisesAbandoned,
+		Rejections,
+		ContinuationsRun,
+		TasksSubmitted,
+		TasksRun,
+		ThreadsStarted,
+		ThreadsExited,
+		BytesAllocated,
+		BytesFreed,
+		CasRetries,
+		CounterCount
+	};
+
+	enum Histogram {
+		SettleToContinuation,
+		AwaitBlock,
+		HistogramCount
+	};
+
+	//log-linear buckets: values below 8 exactly, above that 8 per power
+	//of two, so a bucket is within 12.5% of anything recorded in it.
+	static const size_t SubBuckets = 8;
+	static const size_t BucketCount = 62 * SubBuckets;
+
+	inline size_t bucket_of(uint64_t value) {
+		if (value < SubBuckets) {
+			return (size_t)value;
+		}
+
+		size_t msb = 63;
+		while (!(value >> msb)) {
+			--msb;
+		}
+
+		return (msb - 2) * SubBuckets + (size_t)((value >> (msb - 3)) & (SubBuckets - 1));
+	}
+
+	//bucket_max - the largest value that lands in bucket i.
+	inline uint64_t bucket_max(size_t i) {
+		if (i < SubBuckets) {
+			return i;
+		}
+
+		size_t msb = i / SubBuckets + 2;
+		uint64_t width = uint64_t(1) << (msb - 3);
+		return ((SubBuckets + i % SubBuckets) << (msb - 3)) + width - 1;
+	}
+
+	inline uint64_t now(void) {
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	//Shard - one thread's counters. Only the owner writes, with plain
+	//load/store pairs rather than read-modify-writes, so counting never
+	//contends; readers just load.
+	struct Shard {
+		Shard(void) {
+			for (size_t i = 0; i < CounterCount; ++i) {
+				counters[i].store(0, std::memory_order_relaxed);
+			}
+
+			for (size_t h = 0; h < HistogramCount; ++h) {
+				total[h].store(0, std::memory_order_relaxed);
+				max[h].store(0, std::memory_order_relaxed);
+
+				for (size_t i = 0; i < BucketCount; ++i) {
+					buckets[h][i].store(0, std::memory_order_relaxed);
+				}
+			}
+		}
+
+		static void bump(std::atomic<uint64_t> &c, uint64_t n) {
+			c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+		}
+
+		std::atomic<uint64_t> counters[CounterCount];
+		std::atomic<uint64_t> total[HistogramCount];
+		std::atomic<uint64_t> max[HistogramCount];
+		std::atomic<uint64_t> buckets[HistogramCount][BucketCount];
+	};
+
+	//Registry - every shard ever created. A thread's shard stays behind
+	//when it exits, so totals never go backwards.
+	class Registry {
+	public:
+		Shard* add(void) {
+			std::unique_lock<std::mutex> lock(_lock);
+			_shards.push_back(std::unique_ptr<Shard>(new Shard()));
+			return _shards.back().get();
+		}
+
+		template <typename F>
+		void each(F f) {
+			std::unique_lock<std::mutex> lock(_lock);
+
+			for (size_t i = 0; i < _shards.size(); ++i) {
+				f(*_shards[i]);
+			}
+		}
+
+	private:
+		std::mutex _lock;
+		std::vector<std::unique_ptr<Shard>> _shards;
+	};
+
+	//never destroyed, counts keep coming in while statics are torn down
+	inline Registry& registry(void) {
+		static Registry* reg = new Registry();
+		return *reg;
+	}
+
+	inline Shard& local_shard(void) {
+		static thread_local Shard* shard = registry().add();
+		return *shard;
+	}
+
+	inline void add(Counter counter, uint64_t n) {
+		Shard::bump(local_shard().counters[counter], n);
+	}
+
+	inline void sample(Histogram histogram, uint64_t ns) {
+		Shard &shard = local_shard();
+
+		Shard::bump(shard.buckets[histogram][bucket_of(ns)], 1);
+		Shard::bump(shard.total[histogram], ns);
+
+		if (ns > shard.max[histogram].load(std::memory_order_relaxed)) {
+			shard.max[histogram].store(ns, std::memory_order_relaxed);
+		}
+	}
+
+	//Live - counts construction and destruction of whatever derives from it.
+	struct Live {
+#ifdef PROMISE_METRICS
+		Live(void) {
+			add(PromisesCreated, 1);
+		}
+
+		Live(const Live &) {
+			add(PromisesCreated, 1);
+		}
+
+		~Live(void) {
+			add(PromisesDestroyed, 1);
+		}
+#endif
+	};
+}
+
+	//HistogramSnapshot - nanosecond samples, summed over every thread.
+	struct HistogramSnapshot {
+		HistogramSnapshot(void)
+			:buckets(Metrics::BucketCount, 0),
+			count(0),
+			total(0),
+			max(0)
+		{ }
+
+		std::vector<uint64_t> buckets;
+		uint64_t count;
+		uint64_t total;
+		uint64_t max;
+
+		double mean(void) const {
+			return (count == 0) ? 0.0 : (double)total / (double)count;
+		}
+
+		//percentile - p in [0, 100], an upper bound within one bucket.
+		uint64_t percentile(double p) const {
+			if (count == 0) {
+				return 0;
+			}
+
+			uint64_t rank = (uint64_t)((p / 100.0) * (double)count + 0.5);
+			rank = (rank == 0) ? 1 : rank;
+
+			uint64_t seen = 0;
+			for (size_t i = 0; i < buckets.size(); ++i) {
+				seen += buckets[i];
+
+				if (seen >= rank) {
+					return (Metrics::bucket_max(i) < max) ? Metrics::bucket_max(i) : max;
+				}
+			}
+
+			return max;
+		}
+	};
+
+	//MetricsSnapshot - totals since start-up, and the gauges derived from them.
+	//Shards are read one at a time, so a snapshot taken while promises are
+	//settling is close to, not exactly, a single instant.
+	struct MetricsSnapshot {
+		MetricsSnapshot(void)
+			:counters()
+		{ }
+
+		uint64_t counters[Metrics::CounterCount];
+		HistogramSnapshot settle_to_continuation;
+		HistogramSnapshot await_block;
+
+		uint64_t get(Metrics::Counter counter) const {
+			return counters[counter];
+		}
+
+		//promises and cores alive right now
+		uint64_t live(void) const {
+			return _gap(get(Metrics::PromisesCreated), get(Metrics::PromisesDestroyed));
+		}
+
+		//created but neither settled nor destroyed yet
+		uint64_t pending(void) const {
+			return _gap(get(Metrics::PromisesCreated), get(Metrics::PromisesSettled) + get(Metrics::PromisesAbandoned));
+		}
+
+		uint64_t threads_active(void) const {
+			return _gap(get(Metrics::ThreadsStarted), get(Metrics::ThreadsExited));
+		}
+
+		//tasks submitted to an executor that have not started yet
+		uint64_t queue_depth(void) const {
+			return _gap(get(Metrics::TasksSubmitted), get(Metrics::TasksRun));
+		}
+
+		uint64_t bytes_in_use(void) const {
+			return _gap(get(Metrics::BytesAllocated), get(Metrics::BytesFreed));
+		}
+
+	private:
+		//shards are read one after another, a total can briefly trail its counterpart
+		static uint64_t _gap(uint64_t a, uint64_t b) {
+			return (a > b) ? a - b : 0;
+		}
+	};
+
+	//metrics - sum every thread's shard. Takes the registry lock only,
+	//the threads being counted never wait on it.
+	inline MetricsSnapshot metrics(void) {
+		MetricsSnapshot snap;
+		HistogramSnapshot* histograms[Metrics::HistogramCount] = { &snap.settle_to_continuation, &snap.await_block };
+
+		Metrics::registry().each([&snap, &histograms](const Metrics::Shard &shard) {
+			for (size_t i = 0; i < Metrics::CounterCount; ++i) {
+				snap.counters[i] += shard.counters[i].load(std::memory_order_relaxed);
+			}
+
+			for (size_t h = 0; h < Metrics::HistogramCount; ++h) {
+				HistogramSnapshot &hist = *histograms[h];
+
+				for (size_t i = 0; i < Metrics::BucketCount; ++i) {
+					uint64_t n = shard.buckets[h][i].load(std::memory_order_relaxed);
+					hist.buckets[i] += n;
+					hist.count += n;
+				}
+
+				hist.total += shard.total[h].load(std::memory_order_relaxed);
+
+				uint64_t max = shard.max[h].load(std::memory_order_relaxed);
+				hist.max = (max > hist.max) ? max : hist.max;
+			}
+		});
+
+		return snap;
+	}
+}
+
+#endif // !METRICS_H
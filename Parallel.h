@@ -0,0 +1,273 @@
+#include "Promise.h"
+#include "Promise_Error.h"
+#include "Scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+namespace Promises {
+
+	//Chunks - an Outcome over the indices [0, size) of a random access range,
+	//split up while it runs. Each chunk in flight holds a count, and the
+	//last chunk to leave finishes the job.
+	class Chunks : public Outcome {
+	public:
+		Chunks(PROM_TYPE prom, size_t size, size_t grain)
+			:Outcome(prom),
+			_exec(default_executor()),
+			_grain(_pick_grain(_exec, size, grain)),
+			_pending(1)
+		{ }
+
+		IExecutor* executor(void) const {
+			return _exec;
+		}
+
+		size_t grain(void) const {
+			return _grain;
+		}
+
+		void enter(void) {
+			_pending.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		//leave - true for the last chunk out.
+		bool leave(void) {
+			return _pending.fetch_sub(1, std::memory_order_acq_rel) == 1;
+		}
+
+	private:
+		IExecutor* _exec;
+		size_t _grain;
+		std::atomic<size_t> _pending;
+
+		//grain 0 - about eight chunks per worker, enough to even out
+		//uneven elements without paying for a split per element.
+		static size_t _pick_grain(IExecutor* exec, size_t size, size_t grain) {
+			if (grain != 0) {
+				return grain;
+			}
+
+			size_t chunks = std::max<size_t>(1, exec->thread_count()) * 8;
+			return std::max<size_t>(1, size / chunks);
+		}
+	};
+
+	//_split - run [begin, end) of job. While more than a grain is left,
+	//the upper half goes to the executor, where a thief can split it again,
+	//and this thread keeps the lower half. Once the job is decided the
+	//remaining chunks only leave.
+	template <typename JOB>
+	void _split(const std::shared_ptr<JOB> &job, size_t begin, size_t end) {
+		while (end - begin > job->grain() && !job->decided()) {
+			size_t mid = begin + (end - begin) / 2;
+			std::shared_ptr<JOB> other = job;
+
+			job->enter();
+			job->executor()->submit([other, mid, end]() {
+				_split(other, mid, end);
+			});
+
+			end = mid;
+		}
+
+		if (!job->decided()) {
+			try {
+				job->leaf(begin, end);
+			} catch (...) {
+				job->reject(std::current_exception());
+			}
+		}
+
+		if (job->leave()) {
+			job->finish();
+		}
+	}
+
+	//_start - hand the whole range of job to its executor.
+	template <typename JOB>
+	void _start(const std::shared_ptr<JOB> &job, size_t size) {
+		std::shared_ptr<JOB> root = job;
+
+		job->executor()->submit([root, size]() {
+			_split(root, 0, size);
+		});
+	}
+
+	template <typename IT, typename F>
+	class ForJob : public Chunks {
+	public:
+		ForJob(PROM_TYPE prom, IT first, size_t size, size_t grain, F f)
+			:Chunks(prom, size, grain),
+			_first(first),
+			_size(size),
+			_f(std::move(f))
+		{ }
+
+		void leaf(size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				_f(_first[i]);
+			}
+		}
+
+		void finish(void) {
+			resolve(_size);
+		}
+
+	private:
+		IT _first;
+		size_t _size;
+		F _f;
+	};
+
+	template <typename IT, typename F, typename OUT>
+	class TransformJob : public Chunks {
+	public:
+		TransformJob(PROM_TYPE prom, IT first, size_t size, size_t grain, F f)
+			:Chunks(prom, size, grain),
+			_first(first),
+			_f(std::move(f)),
+			_results(size)
+		{ }
+
+		//every chunk writes its own slots, nothing to lock
+		void leaf(size_t begin, size_t end) {
+			for (size_t i = begin; i < end; ++i) {
+				_results.set(i, OUT(_f(_first[i])));
+			}
+		}
+
+		void finish(void) {
+			if (decided()) {
+				return;
+			}
+
+			resolve(_results.take());
+		}
+
+	private:
+		IT _first;
+		F _f;
+		ResultSlots<OUT> _results;
+	};
+
+	template <typename IT, typename T, typename OP>
+	class ReduceJob : public Chunks {
+	public:
+		ReduceJob(PROM_TYPE prom, IT first, size_t size, size_t grain, T init, OP op)
+			:Chunks(prom, size, grain),
+			_first(first),
+			_init(std::move(init)),
+			_op(std::move(op))
+		{ }
+
+		//one partial per chunk, combined in index order by finish()
+		void leaf(size_t begin, size_t end) {
+			T acc = T(_first[begin]);
+
+			for (size_t i = begin + 1; i < end; ++i) {
+				acc = _op(std::move(acc), T(_first[i]));
+			}
+
+			std::unique_lock<std::mutex> lock(_lock);
+			_partials.push_back(std::make_pair(begin, std::move(acc)));
+		}
+
+		void finish(void) {
+			if (decided()) {
+				return;
+			}
+
+			std::sort(_partials.begin(), _partials.end(), [](const std::pair<size_t, T> &a, const std::pair<size_t, T> &b) {
+				return a.first < b.first;
+			});
+
+			T result = std::move(_init);
+			for (size_t i = 0; i < _partials.size(); ++i) {
+				result = _op(std::move(result), std::move(_partials[i].second));
+			}
+
+			resolve(std::move(result));
+		}
+
+	private:
+		IT _first;
+		T _init;
+		OP _op;
+		std::mutex _lock;
+		std::vector<std::pair<size_t, T>> _partials;
+	};
+
+	//parallel_for - call f on every element of range on the default executor.
+	//Resolves with the number of elements once all calls have returned,
+	//or rejects with the first exception f throws.
+	//range must be random access and outlive the returned promise.
+	//grain is the most elements one task runs in a row, 0 picks one.
+	template <typename RANGE, typename F>
+	std::shared_ptr<Promise> parallel_for(RANGE &range, size_t grain, F f) {
+		typedef decltype(std::begin(range)) IT;
+
+		std::shared_ptr<Promise> continuation = make_pooled<Promise>(pending_state);
+		size_t size = std::distance(std::begin(range), std::end(range));
+
+		if (size == 0) {
+			Settlement(continuation.get()).resolve(size);
+			return continuation;
+		}
+
+		_start(make_pooled<ForJob<IT, F>>(continuation, std::begin(range), size, grain, std::move(f)), size);
+
+		return continuation;
+	}
+
+	//parallel_transform - resolves with a std::vector of f(element),
+	//in range order. The result type must be default constructible.
+	template <typename RANGE, typename F>
+	std::shared_ptr<Promise> parallel_transform(const RANGE &range, size_t grain, F f) {
+		typedef decltype(std::begin(range)) IT;
+		typedef typename std::decay<decltype(f(*std::begin(range)))>::type OUT;
+
+		std::shared_ptr<Promise> continuation = make_pooled<Promise>(pending_state);
+		size_t size = std::distance(std::begin(range), std::end(range));
+
+		if (size == 0) {
+			Settlement(continuation.get()).resolve(std::vector<OUT>());
+			return continuation;
+		}
+
+		_start(make_pooled<TransformJob<IT, F, OUT>>(continuation, std::begin(range), size, grain, std::move(f)), size);
+
+		return continuation;
+	}
+
+	//parallel_reduce - resolves with init combined with every element by op,
+	//op(T, T) -> T. op must be associative; elements are combined in range
+	//order, so it need not be commutative.
+	template <typename RANGE, typename T, typename OP>
+	std::shared_ptr<Promise> parallel_reduce(const RANGE &range, size_t grain, T init, OP op) {
+		typedef decltype(std::begin(range)) IT;
+
+		std::shared_ptr<Promise> continuation = make_pooled<Promise>(pending_state);
+		size_t size = std::distance(std::begin(range), std::end(range));
+
+		if (size == 0) {
+			Settlement(continuation.get()).resolve(std::move(init));
+			return continuation;
+		}
+
+		_start(make_pooled<ReduceJob<IT, T, OP>>(continuation, std::begin(range), size, grain, std::move(init), std::move(op)), size);
+
+		return continuation;
+	}
+}
+
+#endif // !PARALLEL_H
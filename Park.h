@@ -0,0 +1,116 @@
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#if defined(__linux__)
+#include <climits>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#ifndef PARK_H
+#define PARK_H
+
+//pause rounds a waiter spins before parking.
+//Zero parks straight away.
+#ifndef SPIN_LIMIT
+#define SPIN_LIMIT 256
+#endif
+
+namespace Promises {
+
+	//cpu_relax - tell the core we are spinning.
+	inline void cpu_relax(void) {
+#if defined(__i386__) || defined(__x86_64__)
+		__builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+		__asm__ __volatile__("yield");
+#endif
+	}
+
+	//spin_until - up to SPIN_LIMIT rounds of cpu_relax() waiting for done().
+	//Spinning only pays off if whoever settles runs on another core,
+	//so it is skipped on a single hardware thread.
+	template <typename DONE>
+	bool spin_until(DONE done) {
+		static const bool worth_it = std::thread::hardware_concurrency() > 1;
+
+		if (worth_it) {
+			for (int i = 0; i < SPIN_LIMIT; ++i) {
+				if (done()) {
+					return true;
+				}
+
+				cpu_relax();
+			}
+		}
+
+		return done();
+	}
+
+#if defined(__linux__)
+	static_assert(sizeof(std::atomic<int>) == sizeof(int), "futex needs a plain int");
+
+	//park - sleep while word still holds expected, or until timeout
+	//(zero means no timeout). May return early; callers re-check.
+	inline void park(std::atomic<int> &word, int expected, std::chrono::microseconds timeout = std::chrono::microseconds(0)) {
+		struct timespec ts;
+		struct timespec* tsp = nullptr;
+
+		if (timeout.count() > 0) {
+			ts.tv_sec = (time_t)(timeout.count() / 1000000);
+			ts.tv_nsec = (long)(timeout.count() % 1000000) * 1000;
+			tsp = &ts;
+		}
+
+		syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAIT_PRIVATE, expected, tsp, nullptr, 0);
+	}
+
+	//unpark_all - wake every thread parked on word.
+	//Only touches the address, so word may already be gone.
+	inline void unpark_all(std::atomic<int> &word) {
+		syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+	}
+#else
+	//without futexes: a small table of condition variables keyed by address.
+	//std::atomic::wait (C++20) would do, but it cannot time out,
+	//and a worker has to wake up to pick up new work.
+	struct ParkSlot {
+		std::mutex lock;
+		std::condition_variable cond;
+	};
+
+	inline ParkSlot& _park_slot(const void* address) {
+		static ParkSlot slots[64];
+		return slots[(reinterpret_cast<uintptr_t>(address) >> 4) % 64];
+	}
+
+	inline void park(std::atomic<int> &word, int expected, std::chrono::microseconds timeout = std::chrono::microseconds(0)) {
+		ParkSlot &slot = _park_slot(&word);
+		std::unique_lock<std::mutex> lock(slot.lock);
+
+		if (word.load(std::memory_order_acquire) != expected) {
+			return;
+		}
+
+		if (timeout.count() > 0) {
+			slot.cond.wait_for(lock, timeout);
+		} else {
+			slot.cond.wait(lock);
+		}
+	}
+
+	inline void unpark_all(std::atomic<int> &word) {
+		ParkSlot &slot = _park_slot(&word);
+		std::unique_lock<std::mutex> lock(slot.lock);
+		slot.cond.notify_all();
+	}
+#endif
+}
+
+#endif // !PARK_H
@@ -1,10 +1,17 @@
 #ifndef PROMISE_H
 #define PROMISE_H
-#define ARENA_SIZE 256
 
 #include "IPromise.h"
 #include "Lambda.h"
 #include "State.h"
+#include "Allocator.h"
+#include "Scheduler.h"
+#include "Park.h"
+#include "Trace.h"
+#include "Cancellation.h"
+#include "Timer.h"
+#include <atomic>
+#include <chrono>
 #include <functional>
 #include <stdexcept>
 #include <thread>
@@ -15,9 +22,11 @@
 #include <mutex>
 #include <iterator>
 #include <map>
+#include <unordered_map>
+#include <algorithm>
+#include <utility>
 #include <cstdlib>
 #include <type_traits>
-#include <iostream>
 
 namespace Promises {
 
@@ -41,32 +50,87 @@ static std::shared_ptr<PendingState> pending_state = std::make_shared<PendingSta
 		}
 
 		template <typename T>
-		void resolve(T value) {
+		void resolve(const T &value) {
 			if (_prom == NULL || _prom == nullptr) {
 				throw Promise_Error("Settlement.resolve(): internal promise is null");
 			}
 			
-			std::shared_ptr<ResolvedState<T>> state = std::make_shared<ResolvedState<T>>(value);
+			std::shared_ptr<ResolvedState<T>> state = make_pooled<ResolvedState<T>>(value);
 
 			_prom->_resolve(state);
 		}
 
-		void reject(const std::exception &e) {
+		//resolve - an rvalue is moved into the state, not copied.
+		template <typename T>
+		void resolve(T &&value) {
+			typedef typename std::decay<T>::type value_type;
+
+			if (_prom == NULL || _prom == nullptr) {
+				throw Promise_Error("Settlement.resolve(): internal promise is null");
+			}
+
+			std::shared_ptr<ResolvedState<value_type>> state = make_pooled<ResolvedState<value_type>>(std::forward<T>(value));
+
+			_prom->_resolve(state);
+		}
+
+		//reject - e is kept as its own type, which await() rethrows.
+		template <typename E, typename = typename std::enable_if<std::is_base_of<std::exception, E>::value>::type>
+		void reject(const E &e) {
 			if (_prom == NULL || _prom == nullptr) {
 				throw Promise_Error("Settlement.reject(): internal promise is null");
 			}
 
-			std::shared_ptr<RejectedState> state = std::make_shared<RejectedState>(e);
+			std::shared_ptr<RejectedState> state = make_pooled<RejectedState>(e);
 
 			_prom->_reject(state);
 		}
-		
+
+		void reject(std::exception_ptr e) {
+			if (_prom == NULL || _prom == nullptr) {
+				throw Promise_Error("Settlement.reject(): internal promise is null");
+			}
+
+			std::shared_ptr<RejectedState> state = make_pooled<RejectedState>(e);
+
+			_prom->_reject(state);
+		}
+
+		//reject - with another promise's rejection, shared rather than copied.
+		void reject(std::shared_ptr<State> state) {
+			if (_prom == NULL || _prom == nullptr) {
+				throw Promise_Error("Settlement.reject(): internal promise is null");
+			}
+
+			if (state == nullptr || *state != Rejected) {
+				throw Promise_Error("Settlement.reject(): state is not rejected");
+			}
+
+			_prom->_reject(state);
+		}
+
+		//settle - like another promise's settled state, value or rejection,
+		//shared rather than copied.
+		void settle(std::shared_ptr<State> state) {
+			if (_prom == NULL || _prom == nullptr) {
+				throw Promise_Error("Settlement.settle(): internal promise is null");
+			}
+
+			if (state != nullptr && *state == Resolved) {
+				_prom->_resolve(state);
+			} else if (state != nullptr && *state == Rejected) {
+				_prom->_reject(state);
+			} else {
+				throw Promise_Error("Settlement.settle(): state is not settled");
+			}
+		}
+
 		void reject(const std::string &msg) {
 			if (_prom == NULL || _prom == nullptr) {
 				throw Promise_Error("Settlement.reject(): internal promise is null");
 			}
 
-			std::shared_ptr<RejectedState> state = std::make_shared<RejectedState>(msg);
+			std::shared_ptr<RejectedState> state = make_pooled<RejectedState>(msg);
 
 			_prom->_reject(state);
 		}
@@ -76,30 +140,24 @@ static std::shared_ptr<PendingState> pending_state = std::make_shared<PendingSta
 	};
 
 	template<typename LAMBDA>
-	class SettlementLambda : public ILambda {
+	class SettlementLambda {
 	public:
 		SettlementLambda(LAMBDA l)
-			: _lam(l)
+			: _lam(std::move(l))
 		{ }
 
-		virtual void call(IPromise *prom) {
+		void call(IPromise *prom) {
 			Settlement sett(prom);
 			_lam(sett);
 		}
 
 	private:
 		LAMBDA _lam;
-
-		virtual std::shared_ptr<IPromise> call(std::shared_ptr<State> stat) {
-			return nullptr;
-		}
 	};
 
 	template<typename LAMBDA>
-	std::shared_ptr<SettlementLambda<LAMBDA>> settlement_lambda(LAMBDA handler) {
-		std::shared_ptr<SettlementLambda<LAMBDA>> settlam = std::make_shared<SettlementLambda<LAMBDA>>(handler);
-
-		return settlam;
+	SettlementLambda<LAMBDA> settlement_lambda(LAMBDA handler) {
+		return SettlementLambda<LAMBDA>(std::move(handler));
 	}
 
 	//NoArg Promise and Lambda
@@ -117,316 +175,791 @@ static std::shared_ptr<PendingState> pending_state = std::make_shared<PendingSta
 			}
 		private:
 			std::shared_ptr<State> _state;
-			virtual void _resolve(std::shared_ptr<State> state) { }
-			virtual void _reject(std::shared_ptr<State> state) { }
+			virtual void _resolve(std::shared_ptr<State>) { }
+			virtual void _reject(std::shared_ptr<State>) { }
 			virtual void Join(void) { }
+			virtual bool Join(std::chrono::steady_clock::time_point) { return true; }
 	};
 	
+	//finally_call - a finally() handler takes nothing, or the settled
+	//state as it is, which is nullptr when the chain ended without one.
+	template <typename LAMBDA>
+	auto finally_call(LAMBDA &lam, std::shared_ptr<State> &stat, int) -> decltype(lam(stat), void()) {
+		lam(stat);
+	}
+
+	template <typename LAMBDA>
+	auto finally_call(LAMBDA &lam, std::shared_ptr<State> &, long) -> decltype(lam(), void()) {
+		lam();
+	}
+
 	template <typename LAMBDA>
-	class NoArgLambda : public ILambda {
+	class NoArgLambda {
 	public:
 		NoArgLambda(LAMBDA l)
-			: _lam(l)
+			: _lam(std::move(l))
 		{ }
 
-		virtual std::shared_ptr<IPromise> call(std::shared_ptr<State> stat) {			
-			_lam();
+		std::shared_ptr<IPromise> call(std::shared_ptr<State> stat) {			
+			finally_call(_lam, stat, 0);
 			//The state needs to bubble downstream
-			std::shared_ptr<NoArgPromise> prom = std::make_shared<NoArgPromise>(stat);
+			std::shared_ptr<NoArgPromise> prom = make_pooled<NoArgPromise>(stat);
 			return prom;
 		}
 
 	private:
 		LAMBDA _lam;
-
-		virtual void call(IPromise* prom) { }
 	};
 
 	template<typename LAMBDA>
-	std::shared_ptr<NoArgLambda<LAMBDA>> noarg_lambda(LAMBDA handler) {
-		std::shared_ptr<NoArgLambda<LAMBDA>> noarglam = std::make_shared<NoArgLambda<LAMBDA>>(handler);
-		
-		return noarglam;
+	NoArgLambda<LAMBDA> noarg_lambda(LAMBDA handler) {
+		return NoArgLambda<LAMBDA>(std::move(handler));
 	}
 	
-	class Semaphore {
-		public:
-			Semaphore(void)
-				:_value(0)
-			{ }
-		
-			bool test_decrease(){
-				std::unique_lock<std::mutex> lock(_lock);
-				if(_value > 0) {
-					--_value;
-					return true;
-				}
-				return false;
-			}
-		
-			void decrease(void) {
-				std::unique_lock<std::mutex> lock(_lock);
-				
-				while(_value <= 0) {
-					_cond.wait(lock);
-				}
-				
-				--_value;
-			}
-			
-			void increase(void) {
-				std::unique_lock<std::mutex> lock(_lock);
-				++_value;
-				_cond.notify_one();
-			}
-		private:
-			size_t _value;
-			std::mutex _lock;
-			std::condition_variable _cond;
-	};
-
-	class Promise : public IPromise {
+	class Promise : public IPromise, private Metrics::Live {
 
 		template <typename T>
 		friend T* await(std::shared_ptr<IPromise>);
 
+		template <typename T>
+		friend T* await_until(std::shared_ptr<IPromise>, std::chrono::steady_clock::time_point);
+
 	public:
 		Promise(void)
-			:_state(nullptr),
+			:_status(Pending),
+			_initial(nullptr),
+			_state(nullptr),
 			_settleHandle(nullptr),
 			_resolveHandle(nullptr),
-			_rejectHandle(nullptr)
+			_rejectHandle(nullptr),
+			_executor(default_executor()),
+			_inflight(0),
+			_waiters(nullptr),
+			_next(nullptr),
+			_cancel(nullptr),
+			_claim(_Unclaimed),
+			_always(false)
 		{ }
 
 		Promise(std::shared_ptr<State> stat)
-			:_state(stat),
+			:_status(_status_of(stat)),
+			_initial(stat),
+			_state(stat),
 			_settleHandle(nullptr),
 			_resolveHandle(nullptr),
-			_rejectHandle(nullptr)
-		{ }
+			_rejectHandle(nullptr),
+			_executor(default_executor()),
+			_inflight(0),
+			_waiters(_status_of(stat) == Pending ? nullptr : _closed()),
+			_next(nullptr),
+			_cancel(nullptr),
+			_claim(_Unclaimed),
+			_always(false)
+		{
+			if (_settled()) {
+				PROMISE_METRIC(PromisesSettled, 1);
+			}
+		}
 
-		Promise(std::shared_ptr<ILambda> lam)
-			:_state(pending_state),
-			_settleHandle(lam),
+		Promise(Handler lam)
+			:_status(Pending),
+			_initial(pending_state),
+			_state(nullptr),
+			_settleHandle(std::move(lam)),
 			_resolveHandle(nullptr),
-			_rejectHandle(nullptr)
+			_rejectHandle(nullptr),
+			_executor(default_executor()),
+			_inflight(0),
+			_waiters(nullptr),
+			_next(nullptr),
+			_cancel(nullptr),
+			_claim(_Unclaimed),
+			_always(false)
 		{
 			_settle();
 		}
 
-		Promise(std::shared_ptr<ILambda> lam, std::shared_ptr<State> parentState)
-			:_state(pending_state),
+		//a settlement handler that is skipped if token is cancelled before it starts
+		Promise(Handler lam, const CancelToken &token)
+			:_status(Pending),
+			_initial(pending_state),
+			_state(nullptr),
+			_settleHandle(std::move(lam)),
+			_resolveHandle(nullptr),
+			_rejectHandle(nullptr),
+			_executor(default_executor()),
+			_inflight(0),
+			_waiters(nullptr),
+			_next(nullptr),
+			_cancel(nullptr),
+			_claim(_Unclaimed),
+			_always(false)
+		{
+			_attach(token);
+			_settle();
+		}
+
+		Promise(Handler lam, std::shared_ptr<State> parentState)
+			:_status(Pending),
+			_initial(pending_state),
+			_state(nullptr),
 			_settleHandle(nullptr),
 			_resolveHandle(nullptr),
-			_rejectHandle(nullptr)
+			_rejectHandle(nullptr),
+			_executor(default_executor()),
+			_inflight(0),
+			_waiters(nullptr),
+			_next(nullptr),
+			_cancel(nullptr),
+			_claim(_Unclaimed),
+			_always(false)
 		{
 			if (*parentState == Resolved) {
-				_resolveHandle = lam;
+				_resolveHandle = std::move(lam);
 				this->_settle(parentState, nullptr);
 			} else if (*parentState == Rejected) {
-				_rejectHandle = lam;
+				_rejectHandle = std::move(lam);
 				this->_settle(nullptr, parentState);
 			}
 		}
 
-		Promise(std::shared_ptr<ILambda> res, std::shared_ptr<ILambda> rej)
-			:_state(pending_state),
+		Promise(Handler res, Handler rej)
+			:_status(Pending),
+			_initial(pending_state),
+			_state(nullptr),
 			_settleHandle(nullptr),
-			_resolveHandle(res),
-			_rejectHandle(rej)
+			_resolveHandle(std::move(res)),
+			_rejectHandle(std::move(rej)),
+			_executor(default_executor()),
+			_inflight(0),
+			_waiters(nullptr),
+			_next(nullptr),
+			_cancel(nullptr),
+			_claim(_Unclaimed),
+			_always(false)
 		{ }
 
+		//a copy is not linked into any chain, so its handlers could never run;
+		//they are move-only and stay with the original.
 		Promise(const Promise &other)
-			:_state(other._state),
-			_settleHandle(other._settleHandle),
-			_resolveHandle(other._resolveHandle),
-			_rejectHandle(other._rejectHandle),
-			_Promises(other._Promises)
-		{ }
+			:Live(other),
+			_status(other._phase()),
+			_initial(other._initial),
+			_state(other._state),
+			_settleHandle(nullptr),
+			_resolveHandle(nullptr),
+			_rejectHandle(nullptr),
+			_executor(other._executor),
+			_inflight(0),
+			_waiters(other._settled() ? _closed() : nullptr),
+			_next(nullptr),
+			_cancel(nullptr),
+			_claim(_Unclaimed),
+			_always(false)
+		{
+			if (_settled()) {
+				PROMISE_METRIC(PromisesSettled, 1);
+			}
+		}
 
 		virtual ~Promise(void) {
+			if (_phase() == Pending) {
+				PROMISE_METRIC(PromisesAbandoned, 1);
+			}
+
 			try {
-				if (this->_th.joinable()) {
-					this->_th.join();
+				//a cancel firing on this promise finishes first
+				if (_cancel != nullptr) {
+					_cancel->state->detach(_cancel);
 				}
-			} catch (const std::exception &ex) {
-				std::cout << ex.what() << std::endl;
+
+				this->_wait_idle();
+				this->_close(Pending);
+			} catch (...) {
+				//a destructor has nowhere to report it
 			}
+
+			pool_delete(_cancel);
 		}
 
+		//operator = - claims _status the way _publish does, so a settler
+		//already writing _state finishes first and a Join() parked here
+		//is woken to look at the new status.
 		Promise& operator = (const Promise &other) {
+			int phase = other._phase();
+
+			int word = this->_status.load(std::memory_order_acquire);
+			while (true) {
+				if ((word & ~_Parked) == _Settling) {
+					std::this_thread::yield();
+					word = this->_status.load(std::memory_order_acquire);
+					continue;
+				}
+
+				if (this->_status.compare_exchange_weak(word, _Settling | (word & _Parked), std::memory_order_acq_rel, std::memory_order_acquire)) {
+					break;
+				}
+
+				PROMISE_METRIC(CasRetries, 1);
+			}
+
+			this->_initial = other._initial;
 			this->_state = other._state;
-			this->_settleHandle = other._settleHandle;
-			this->_resolveHandle = other._resolveHandle;
-			this->_rejectHandle = other._rejectHandle;
-			this->_Promises = 	other._Promises;
+			this->_executor = other._executor;
+
+			if (this->_status.exchange(phase, std::memory_order_acq_rel) & _Parked) {
+				unpark_all(this->_status);
+			}
+
+			//continuations already registered settle with the new state
+			if (this->_settled()) {
+				this->_close(this->_phase());
+			}
 
 			return (*this);
 		}
 
 		template <typename RESLAM, typename REJLAM>
 		std::shared_ptr<Promise> then(RESLAM resolver, REJLAM rejecter) {
-			if (_state == NULL || _state == nullptr) {
+			return then(std::move(resolver), std::move(rejecter), CancelToken());
+		}
+
+		//then - with a token: cancelling it before the handler starts
+		//rejects the continuation with Cancelled instead.
+		template <typename RESLAM, typename REJLAM>
+		std::shared_ptr<Promise> then(RESLAM resolver, REJLAM rejecter, const CancelToken &token) {
+			if (get_state() == nullptr) {
 				throw Promise_Error("Promise.then(): state is null");
 			}
 
-			std::shared_ptr<Promise> continuation = nullptr;
-			std::shared_ptr<ILambda> reslam = nullptr;
-			std::shared_ptr<ILambda> rejlam = nullptr;
-
-			_stateLock.lock();
-
-			if (*_state == Pending) {
-				reslam = resolved_lambda<RESLAM>(resolver);
-				rejlam = rejected_lambda<REJLAM>(rejecter);
-				continuation = std::make_shared<Promise>(reslam, rejlam);
-				_Promises.push_back(continuation);
-			} else if (*_state == Resolved) {
-				reslam = resolved_lambda<RESLAM>(resolver);
-				continuation = std::make_shared<Promise>(reslam, this->_state);
-			} else {
-				rejlam = rejected_lambda<REJLAM>(rejecter);
-				continuation = std::make_shared<Promise>(rejlam, this->_state);
-			}
+			std::shared_ptr<Promise> continuation = make_pooled<Promise>(Handler(resolved_lambda<RESLAM>(std::move(resolver))), Handler(rejected_lambda<REJLAM>(std::move(rejecter))));
+			continuation->_attach(token);
 
-			_stateLock.unlock();
+			_chain(continuation);
 
 			return continuation;
 		}
 		
 		template <typename LAMBDA>
 		std::shared_ptr<Promise> then(LAMBDA resolver) {
-			if (_state == NULL || _state == nullptr) {
+			return then(std::move(resolver), CancelToken());
+		}
+
+		template <typename LAMBDA>
+		std::shared_ptr<Promise> then(LAMBDA resolver, const CancelToken &token) {
+			if (get_state() == nullptr) {
 				throw Promise_Error("Promise.then(): state is null");
 			}
 
-			std::shared_ptr<Promise> continuation = nullptr;
-			std::shared_ptr<ILambda> lam = nullptr;
-			
-			_stateLock.lock();
-
-			if (*_state == Pending) {
-				std::shared_ptr<ILambda> fake = nullptr;
-				lam = resolved_lambda<LAMBDA>(resolver);
-				continuation = std::make_shared<Promise>(lam, fake);
-				_Promises.push_back(continuation);
-			} else if (*_state == Resolved) {
-				lam = resolved_lambda<LAMBDA>(resolver);
-				continuation = std::make_shared<Promise>(lam, this->_state);
-			} else {
-				std::shared_ptr<ILambda> fake = nullptr;
-				continuation = std::make_shared<Promise>(fake, this->_state);
-			}
+			std::shared_ptr<Promise> continuation = make_pooled<Promise>(Handler(resolved_lambda<LAMBDA>(std::move(resolver))), Handler());
+			continuation->_attach(token);
 
-			_stateLock.unlock();
+			_chain(continuation);
 
 			return continuation;
 		}
 	
 		template<typename REJLAM>
 		std::shared_ptr<Promise> _catch(REJLAM rejecter) {
-			if (_state == NULL || _state == nullptr) {
+			return _catch(std::move(rejecter), CancelToken());
+		}
+
+		template<typename REJLAM>
+		std::shared_ptr<Promise> _catch(REJLAM rejecter, const CancelToken &token) {
+			if (get_state() == nullptr) {
 				throw Promise_Error("Promise.catch(): state is null");
 			}
 
-			std::shared_ptr<Promise> continuation = nullptr;
-			std::shared_ptr<ILambda> lam = nullptr;
-						
-			_stateLock.lock();
-			if (*_state == Pending) {
-				std::shared_ptr<ILambda> fake = nullptr;
-				lam = rejected_lambda<REJLAM>(rejecter);
-				continuation = std::make_shared<Promise>(fake, lam);
-				_Promises.push_back(continuation);
-			} else if (*_state == Resolved) {
-				std::shared_ptr<ILambda> fake = nullptr;
-				continuation = std::make_shared<Promise>(fake, this->_state);
-			} else {
-				lam = rejected_lambda<REJLAM>(rejecter);
-				continuation = std::make_shared<Promise>(lam, this->_state);
-			}
+			std::shared_ptr<Promise> continuation = make_pooled<Promise>(Handler(), Handler(rejected_lambda<REJLAM>(std::move(rejecter))));
+			continuation->_attach(token);
 
-			_stateLock.unlock();
+			_chain(continuation);
 
 			return continuation;
 		}
 
 		template <typename LAMBDA>
 		std::shared_ptr<Promise> finally(LAMBDA handler) {
-			if (_state == NULL || _state == nullptr) {
+			return finally(std::move(handler), CancelToken());
+		}
+
+		template <typename LAMBDA>
+		std::shared_ptr<Promise> finally(LAMBDA handler, const CancelToken &token) {
+			//a chain that already ended still runs it
+			if (get_state() == nullptr && _phase() != _Ended) {
 				throw Promise_Error("Promise.finally(): state is null");
 			}
 
-			std::shared_ptr<Promise> continuation = nullptr;
-			std::shared_ptr<ILambda> lam = noarg_lambda<LAMBDA>(handler);
+			//one copy of the handler for each outcome, only one of them runs.
+			//The copy is taken first, the move must not happen before it.
+			Handler on_resolve(noarg_lambda<LAMBDA>(handler));
+			Handler on_reject(noarg_lambda<LAMBDA>(std::move(handler)));
+			std::shared_ptr<Promise> continuation = make_pooled<Promise>(std::move(on_resolve), std::move(on_reject));
+			continuation->_always = true;
+			continuation->_attach(token);
 
-			_stateLock.lock();
-
-			if (*_state == Pending) {
-				std::shared_ptr<ILambda> aux = noarg_lambda<LAMBDA>(handler);
-				continuation = std::make_shared<Promise>(lam, aux);
-				_Promises.push_back(continuation);
-			} else {
-				continuation = std::make_shared<Promise>(lam, this->_state);
-			}
-
-			_stateLock.unlock();
+			_chain(continuation);
 
 			return continuation;
 		}
 
+		//get_state - the settled state, the state the promise was
+		//created with while it is pending, nullptr at a chain end.
 		virtual std::shared_ptr<State> get_state(void) {
-			return this->_state;
+			int status = _phase();
+
+			if (status == Resolved || status == Rejected) {
+				return _state;
+			} else if (status == _Ended) {
+				return nullptr;
+			}
+
+			return _initial;
 		}
 
 	private:
+		//the handlers a promise can hand to its executor
+		enum Handle {
+			SettleHandle,
+			ResolveHandle,
+			RejectHandle
+		};
+
+		//_status values besides Pending, Resolved and Rejected.
+		//_Settling: claimed by one settler, _state is being written.
+		//_Ended: a handler returned nothing, the chain stops here.
+		//_Parked is or'ed in while a thread sleeps in Join(),
+		//so settling only makes a wake-up call when someone is parked.
+		static const int _Settling = 3;
+		static const int _Ended = 4;
+		static const int _Parked = 8;
+
+		//_claim values, only used with a CancelToken. Whoever moves _claim
+		//off _Unclaimed or _Queued owns the handlers and _input:
+		//_settle() on the way to running them, _cancel_now() to drop them.
+		//_Claiming: _settle() is writing _input, a cancel waits it out.
+		static const int _Unclaimed = 0;
+		static const int _Claiming = 1;
+		static const int _Queued = 2;
+		static const int _Started = 3;
+		static const int _Cancelled = 4;
+
+		//_Cancellation - this promise's registration with a CancelState.
+		struct _Cancellation : public CancelLink {
+			_Cancellation(Promise* p, std::shared_ptr<CancelState> s)
+				:CancelLink(&_Cancellation::_fire),
+				owner(p),
+				state(s)
+			{ }
+
+			Promise* owner;
+			std::shared_ptr<CancelState> state;
+
+			static void _fire(CancelLink* self) {
+				static_cast<_Cancellation*>(self)->owner->_cancel_now();
+			}
+		};
+
+		//_status is the state word: leaving Pending is one compare-exchange,
+		//after which only the winner writes _state and publishes the outcome.
+		//Join() parks on it.
+		std::atomic<int> _status;
+		std::shared_ptr<State> _initial;
 		std::shared_ptr<State> _state;
-		std::shared_ptr<ILambda> _settleHandle;
-		std::shared_ptr<ILambda> _resolveHandle;
-		std::shared_ptr<ILambda> _rejectHandle;
-		Semaphore _semp;
-		std::mutex _stateLock;
-		std::thread _th;
-		std::vector<std::shared_ptr<Promise>> _Promises;
+		std::shared_ptr<State> _input;
+		Handler _settleHandle;
+		Handler _resolveHandle;
+		Handler _rejectHandle;
+		IExecutor* _executor;
+		//only for the _idle handshake with the destructor
+		std::mutex _lock;
+		std::condition_variable _idle;
+		std::atomic<size_t> _inflight;
+
+		//_waiters - lock-free stack of continuations, newest first,
+		//swapped for _closed() when the promise settles.
+		//Each continuation is its own node: _next links it into
+		//its parent's stack and _linked keeps it alive while it is there.
+		std::atomic<Promise*> _waiters;
+		Promise* _next;
+		std::shared_ptr<Promise> _linked;
+
+		//set only before the promise is chained or dispatched
+		_Cancellation* _cancel;
+		std::atomic<int> _claim;
+
+		//a finally() continuation, its handler runs on a chain end too
+		bool _always;
+
+#ifdef PROMISE_TRACE
+		uint64_t _trace_id = Trace::created();
+#endif
+
+#ifdef PROMISE_METRICS
+		//when the last handler was dispatched
+		uint64_t _scheduled_at = 0;
+#endif
+
+		//never dereferenced, only compared against
+		static Promise* _closed(void) {
+			static char sentinel;
+			return reinterpret_cast<Promise*>(&sentinel);
+		}
+
+		static int _status_of(const std::shared_ptr<State> &stat) {
+			if (stat != nullptr && *stat == Resolved) {
+				return Resolved;
+			} else if (stat != nullptr && *stat == Rejected) {
+				return Rejected;
+			}
+
+			return Pending;
+		}
+
+		int _phase(void) const {
+			return _status.load(std::memory_order_acquire) & ~_Parked;
+		}
+
+		bool _settled(void) const {
+			int status = _phase();
+			return status != Pending && status != _Settling;
+		}
 
 		virtual void _resolve(std::shared_ptr<State> state) {
-			_stateLock.lock();
+			_publish(Resolved, state);
+		}
+
+		virtual void _reject(std::shared_ptr<State> state) {
+			_publish(Rejected, state);
+		}
+
+		//_publish - the Pending -> outcome transition. The first settlement wins,
+		//later ones are ignored. Continuations registered before the outcome
+		//became visible are settled here, later ones by _chain().
+		bool _publish(int outcome, std::shared_ptr<State> state) {
+			int word = _status.load(std::memory_order_acquire);
+			while (true) {
+				if ((word & ~_Parked) != Pending) {
+					return false;
+				}
+
+				if (_status.compare_exchange_weak(word, _Settling | (word & _Parked), std::memory_order_acq_rel, std::memory_order_acquire)) {
+					break;
+				}
+
+				PROMISE_METRIC(CasRetries, 1);
+			}
+
 			_state = state;
-			_stateLock.unlock();
 
-			_semp.increase();
-			for (size_t i = 0; i < _Promises.size(); i++) {
-				_Promises[i]->_settle(_state, nullptr);
+			if (_status.exchange(outcome, std::memory_order_acq_rel) & _Parked) {
+				unpark_all(_status);
+			}
+
+			PROMISE_TRACE_EVENT(Settled, _trace_id, 0, outcome);
+			PROMISE_METRIC(PromisesSettled, 1);
+
+			if (outcome == Rejected) {
+				PROMISE_METRIC(Rejections, 1);
+			}
+
+			_close(outcome);
+
+			return true;
+		}
+
+		//_close - take the stack, leaving it closed, and settle
+		//what was on it in registration order.
+		void _close(int outcome) {
+			Promise* list = _waiters.exchange(_closed(), std::memory_order_acq_rel);
+			if (list == _closed()) {
+				return;
+			}
+
+			Promise* ordered = nullptr;
+			while (list != nullptr) {
+				Promise* next = list->_next;
+				list->_next = ordered;
+				ordered = list;
+				list = next;
+			}
+
+			while (ordered != nullptr) {
+				Promise* next = ordered->_next;
+				ordered->_next = nullptr;
+
+				std::shared_ptr<Promise> continuation = ordered->_linked;
+				if (outcome == Resolved || outcome == Rejected || outcome == _Ended) {
+					_notify(continuation, outcome);
+				} else {
+					ordered->_linked = nullptr;
+				}
+
+				ordered = next;
 			}
 		}
 
-		virtual void _reject(std::shared_ptr<State> state) {
-			_stateLock.lock();
-			_state = state;
-			_stateLock.unlock();
+		//_chain - push a continuation onto the stack. Once the stack
+		//is closed the outcome is visible, so it is settled right away.
+		void _chain(std::shared_ptr<Promise> continuation) {
+			Promise* node = continuation.get();
+			node->_linked = continuation;
+
+			PROMISE_TRACE_EVENT(Chained, node->_trace_id, _trace_id, 0);
+
+			Promise* head = _waiters.load(std::memory_order_acquire);
+			while (true) {
+				if (head == _closed()) {
+					_notify(continuation, _phase());
+					return;
+				}
 
-			_semp.increase();
+				node->_next = head;
 
-			for (size_t i = 0; i < _Promises.size(); i++) {
-				_Promises[i]->_settle(nullptr, _state);
+				if (_waiters.compare_exchange_weak(head, node, std::memory_order_acq_rel, std::memory_order_acquire)) {
+					break;
+				}
+
+				PROMISE_METRIC(CasRetries, 1);
+			}
+		}
+
+		//_notify - the continuation takes over its _linked reference:
+		//it keeps itself alive until its handler has run, so the last
+		//owner letting go never has to wait on a queued handler.
+		void _notify(const std::shared_ptr<Promise> &continuation, int outcome) {
+			if (outcome == Resolved) {
+				continuation->_settle(_state, nullptr);
+			} else if (outcome == Rejected) {
+				continuation->_settle(nullptr, _state);
+			} else if (outcome == _Ended) {
+				continuation->_end();
+			} else {
+				continuation->_linked = nullptr;
 			}
 		}
 
+		//Join - spin briefly, since short chains often settle within
+		//microseconds, then park on the state word until woken.
 		virtual void Join(void) {
-			//wait for promise to have state.
-			if (_state == nullptr || *_state == Pending) {
-				if (!_semp.test_decrease()) {
-					_semp.decrease();
+			_join(nullptr);
+		}
+
+		//Join - the same, giving up at deadline. True once settled.
+		virtual bool Join(std::chrono::steady_clock::time_point deadline) {
+			return _join(&deadline);
+		}
+
+		bool _join(const std::chrono::steady_clock::time_point* deadline) {
+			PROMISE_TRACE_EVENT(AwaitBegin, _trace_id, 0, 0);
+			PROMISE_METRIC_START(blocked);
+
+			while (!_settled()) {
+				//the handler we wait on may be queued behind us
+				if (help_pending()) {
+					continue;
+				}
+
+				if (spin_until([this]() { return this->_settled(); })) {
+					break;
+				}
+
+				int word = _status.load(std::memory_order_acquire);
+				if ((word & ~_Parked) != Pending && (word & ~_Parked) != _Settling) {
+					break;
 				}
+
+				if (!(word & _Parked)) {
+					if (!_status.compare_exchange_weak(word, word | _Parked, std::memory_order_acq_rel, std::memory_order_acquire)) {
+						continue;
+					}
+
+					word |= _Parked;
+				}
+
+				//a worker wakes up now and then to pick up new work
+				std::chrono::microseconds timeout(current_executor() == nullptr ? 0 : 100);
+
+				if (deadline != nullptr) {
+					std::chrono::steady_clock::duration left = *deadline - std::chrono::steady_clock::now();
+
+					if (left <= std::chrono::steady_clock::duration::zero()) {
+						break;
+					}
+
+					//rounded up, zero would mean no timeout at all
+					std::chrono::microseconds until = std::chrono::duration_cast<std::chrono::microseconds>(left) + std::chrono::microseconds(1);
+					timeout = (timeout.count() == 0 || until < timeout) ? until : timeout;
+				}
+
+				park(_status, word, timeout);
+			}
+
+			PROMISE_METRIC_SINCE(AwaitBlock, blocked);
+			PROMISE_TRACE_EVENT(AwaitEnd, _trace_id, 0, 0);
+
+			return _settled();
+		}
+
+		//_dispatch - hand one of this promise's handlers to an executor.
+		//The task is just {this, which}, small enough for std::function
+		//to store inline, so dispatching allocates nothing.
+		//_inflight keeps the promise from being destroyed under a queued handler.
+		void _dispatch(IExecutor* exec, Handle which) {
+			_inflight.fetch_add(1, std::memory_order_relaxed);
+			PROMISE_TRACE_EVENT(Scheduled, _trace_id, 0, 0);
+			PROMISE_METRIC_STAMP(_scheduled_at);
+
+			exec->submit([this, which]() {
+				this->_run(which);
+			});
+		}
+
+		//_continue - dispatch a resolve/reject handler per continuation_policy().
+		void _continue(Handle which) {
+			if (continuation_policy() == Inline) {
+				_dispatch(&inline_executor(), which);
+			} else {
+				_dispatch(_executor, which);
+			}
+		}
+
+		void _run(Handle which) {
+			std::shared_ptr<Promise> self;
+			self.swap(_linked);
+
+			//cancelled while it was queued, the handler is already gone
+			if (_cancel != nullptr && !_claim_as(_Queued, _Started)) {
+				_leave();
+				return;
+			}
+
+			PROMISE_TRACE_EVENT(HandlerBegin, _trace_id, 0, 0);
+
+			if (which != SettleHandle) {
+				PROMISE_METRIC(ContinuationsRun, 1);
+				PROMISE_METRIC_SINCE(SettleToContinuation, _scheduled_at);
+			}
+
+			try {
+				if (which == SettleHandle) {
+					_withSettleHandle();
+				} else {
+					//moved along, not copied, so the handler can tell
+					//whether it is the value's only consumer
+					std::shared_ptr<State> input;
+					input.swap(_input);
+
+					if (which == ResolveHandle) {
+						_withResolveHandle(std::move(input));
+					} else {
+						_withRejectHandle(std::move(input));
+					}
+				}
+			} catch (...) {
+				//a throwing handler rejects its promise, so the chain goes on
+				_reject(make_pooled<RejectedState>(std::current_exception()));
+			}
+
+			PROMISE_TRACE_EVENT(HandlerEnd, _trace_id, 0, 0);
+
+			_leave();
+		}
+
+		//_leave - a dispatched handler is done with this promise.
+		//The count drops under the lock: a destructor in _wait_idle only
+		//sees it reach 0 once this thread is done with _lock and _idle.
+		void _leave(void) {
+			std::unique_lock<std::mutex> lock(_lock);
+
+			if (_inflight.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				_idle.notify_all();
+			}
+		}
+
+		//_attach - cancel this promise along with token. Called before the
+		//promise is chained or dispatched; a token already cancelled
+		//cancels it right away.
+		void _attach(const CancelToken &token) {
+			std::shared_ptr<CancelState> state = token.state();
+
+			if (state == nullptr) {
+				return;
+			}
+
+			_cancel = pool_new<_Cancellation>(this, state);
+
+			if (!state->attach(_cancel)) {
+				_cancel_now();
+			}
+		}
+
+		bool _claim_as(int from, int to) {
+			return _claim.compare_exchange_strong(from, to, std::memory_order_acq_rel, std::memory_order_acquire);
+		}
+
+		//_claimed - leave _Claiming once _settle has picked what to do.
+		void _claimed(int to) {
+			if (_cancel != nullptr) {
+				_claim.store(to, std::memory_order_release);
 			}
+		}
+
+		//_cancel_now - reject with Cancelled, dropping the handlers and the
+		//input, unless a handler has started or the promise passed its
+		//parent's outcome on. A running handler sees it through its token.
+		void _cancel_now(void) {
+			int claim = _claim.load(std::memory_order_acquire);
+
+			while (true) {
+				if (claim == _Claiming) {
+					std::this_thread::yield();
+					claim = _claim.load(std::memory_order_acquire);
+					continue;
+				}
+
+				if (claim != _Unclaimed && claim != _Queued) {
+					return;
+				}
+
+				if (_claim.compare_exchange_weak(claim, _Cancelled, std::memory_order_acq_rel, std::memory_order_acquire)) {
+					break;
+				}
+			}
+
+			_settleHandle = nullptr;
+			_resolveHandle = nullptr;
+			_rejectHandle = nullptr;
+			_input = nullptr;
+
+			_publish(Rejected, cancelled_state());
+		}
+
+		//_wait_idle - the executor equivalent of joining the handler thread.
+		void _wait_idle(void) {
+			std::unique_lock<std::mutex> lock(_lock);
+
+			while (_inflight.load(std::memory_order_acquire) != 0) {
+				lock.unlock();
+				bool helped = help_pending();
+				lock.lock();
+
+				if (helped || _inflight.load(std::memory_order_acquire) == 0) {
+					continue;
+				}
 
-			if (this->_th.joinable()) {
-				this->_th.join();
+				if (current_executor() == nullptr) {
+					_idle.wait(lock);
+				} else {
+					lock.unlock();
+					std::this_thread::yield();
+					lock.lock();
+				}
 			}
 		}
 
 		void _withSettleHandle(void) {
-			_settleHandle->call(this);
+			_settleHandle.call(this);
 		}
 
 		void _withResolveHandle(std::shared_ptr<State> input) {
@@ -435,12 +968,12 @@ static std::shared_ptr<PendingState> pending_state = std::make_shared<PendingSta
 
 			//we need 2 seperate functions between this and _withRejectHandle
 			//because we need to call two different
-			std::shared_ptr<IPromise> parent = _resolveHandle->call(input);
+			std::shared_ptr<IPromise> parent = _resolveHandle.call(std::move(input));
+			std::shared_ptr<State> state = parent == nullptr ? nullptr : parent->get_state();
 			
-			//parent will only be nullptr on chain end
-			if(parent != nullptr) {
-				std::shared_ptr<State> state = parent->get_state();
-
+			//state will only be nullptr on chain end,
+			//or from a finally() after one
+			if(state != nullptr) {
 				//if the resolve handle succeeds, the the promise chain
 				//is stil continuing with successful runs
 				if (*state == Resolved)
@@ -448,23 +981,19 @@ static std::shared_ptr<PendingState> pending_state = std::make_shared<PendingSta
 				else
 					_reject(state);
 			} else {
-				_stateLock.lock();
-				_state = nullptr;
-				_stateLock.unlock();
-
-				_semp.increase();
+				_publish(_Ended, nullptr);
 			}
 		}
 
 		void _withRejectHandle(std::shared_ptr<State> input) {
 			//surroung this in a try block
 			//so if an exception happens, then the promise is rejected instead.
-			std::shared_ptr<IPromise> parent = _rejectHandle->call(input);
+			std::shared_ptr<IPromise> parent = _rejectHandle.call(std::move(input));
+			std::shared_ptr<State> state = parent == nullptr ? nullptr : parent->get_state();
 			
-			//parent will only be nullptr on chain end
-			if(parent != nullptr) {
-				std::shared_ptr<State> state = parent->get_state();
-
+			//state will only be nullptr on chain end,
+			//or from a finally() after one
+			if(state != nullptr) {
 				//if the resolve handle succeeds, the the promise chain
 				//is stil continuing with successful runs
 				if (*state == Resolved)
@@ -472,65 +1001,118 @@ static std::shared_ptr<PendingState> pending_state = std::make_shared<PendingSta
 				else
 					_reject(state);
 			} else {
-				_stateLock.lock();
-				_state = nullptr;
-				_stateLock.unlock();
-
-				_semp.increase();
+				_publish(_Ended, nullptr);
 			}
 		}
 
 		void _settle(void) {
-			_th = std::thread(&Promise::_withSettleHandle, this);
+			if (_cancel != nullptr && !_claim_as(_Unclaimed, _Queued)) {
+				return;
+			}
+
+			_dispatch(_executor, SettleHandle);
 		}
 
 		void _settle(std::shared_ptr<State> withValue, std::shared_ptr<State> withReason) {
+			//cancelled before the parent settled: nothing left to run
+			if (_cancel != nullptr && !_claim_as(_Unclaimed, _Claiming)) {
+				std::shared_ptr<Promise> self;
+				self.swap(_linked);
+				return;
+			}
+
 			if (withValue != nullptr) {
 				//run resolveHandle if this promise has one
 				if (_resolveHandle != nullptr) {
-					_th = std::thread(&Promise::_withResolveHandle, this, withValue);
+					_input = withValue;
+					_claimed(_Queued);
+					_continue(ResolveHandle);
+					return;
 				}
 
 				//otherwise this promise doesn't have a resolve handle
 				//and the withValue needs to be percolated down.
 				else {
+					_claimed(_Started);
 					_resolve(withValue);
 				}
 			}
 			else if (withReason != nullptr) {
 				//run rejectHandle if this promise has one
 				if (_rejectHandle != nullptr) {
-					_th = std::thread(&Promise::_withRejectHandle, this, withReason);
+					_input = withReason;
+					_claimed(_Queued);
+					_continue(RejectHandle);
+					return;
 				}
 
 				//otherwise this promise doesn't have a reject handle
 				//and the exception needs to be percolated down.
 				else {
+					_claimed(_Started);
 					_reject(withReason);
 				}
 			}
+
+			//nothing was dispatched, let go of the reference from _notify()
+			std::shared_ptr<Promise> self;
+			self.swap(_linked);
+		}
+
+		//_end - the parent chain ended without a value. A finally()
+		//handler still runs, any other continuation ends the same way.
+		void _end(void) {
+			if (_cancel != nullptr && !_claim_as(_Unclaimed, _Claiming)) {
+				std::shared_ptr<Promise> self;
+				self.swap(_linked);
+				return;
+			}
+
+			if (_always) {
+				_claimed(_Queued);
+				_continue(ResolveHandle);
+				return;
+			}
+
+			_claimed(_Started);
+			_publish(_Ended, nullptr);
+
+			std::shared_ptr<Promise> self;
+			self.swap(_linked);
 		}
 	};
 	
 	typedef std::shared_ptr<Promise> PROM_TYPE;
 
-	std::shared_ptr<Promise> Reject(const std::exception &e) {
-		std::shared_ptr<RejectedState> state = std::make_shared<RejectedState>(e);
-		std::shared_ptr<Promise> prom = std::make_shared<Promise>(state);
+	template <typename E, typename = typename std::enable_if<std::is_base_of<std::exception, E>::value>::type>
+	std::shared_ptr<Promise> Reject(const E &e) {
+		std::shared_ptr<RejectedState> state = make_pooled<RejectedState>(e);
+		std::shared_ptr<Promise> prom = make_pooled<Promise>(state);
 
 		return prom;
 	}
 
 	template <typename T>
-	std::shared_ptr<Promise> Resolve(T value) {
-		std::shared_ptr<ResolvedState<T>> state = std::make_shared<ResolvedState<T>>(value);
-		std::shared_ptr<Promise> prom = std::make_shared<Promise>(state);
+	std::shared_ptr<Promise> Resolve(const T &value) {
+		std::shared_ptr<ResolvedState<T>> state = make_pooled<ResolvedState<T>>(value);
+		std::shared_ptr<Promise> prom = make_pooled<Promise>(state);
+
+		return prom;
+	}
+
+	//Resolve - an rvalue is moved into the state, not copied.
+	template <typename T>
+	std::shared_ptr<Promise> Resolve(T &&value) {
+		typedef typename std::decay<T>::type value_type;
+
+		std::shared_ptr<ResolvedState<value_type>> state = make_pooled<ResolvedState<value_type>>(std::forward<T>(value));
+		std::shared_ptr<Promise> prom = make_pooled<Promise>(state);
 
 		return prom;
 	}
 	
 	//await - suspend execution until the given promise is settled.
-	//If promise failed, the reject reason is thrown.
+	//If promise failed, the reject reason is thrown as the type it was rejected with.
 	template <typename T>
 	T* await(IPROM_TYPE prom) {
 		prom->Join();
@@ -539,8 +1121,7 @@ static std::shared_ptr<PendingState> pending_state = std::make_shared<PendingSta
 		T* value = nullptr;
 
 		if (s != nullptr && *s == Rejected) {
-			const std::exception &e = s->get_reason();
-			throw Promises::Promise_Error(e.what());
+			s->rethrow();
 		} else if (s != nullptr && *s == Resolved) {
 			value = (T*)s->get_value();
 		}
@@ -548,76 +1129,645 @@ static std::shared_ptr<PendingState> pending_state = std::make_shared<PendingSta
 		return value;
 	}
 
+	//await_until - await, giving up at deadline with a Timeout.
+	//prom is left as it is, and may still settle later.
+	template <typename T>
+	T* await_until(IPROM_TYPE prom, std::chrono::steady_clock::time_point deadline) {
+		if (!prom->Join(deadline)) {
+			throw Timeout();
+		}
+
+		std::shared_ptr<State> s = prom->get_state();
+
+		T* value = nullptr;
+
+		if (s != nullptr && *s == Rejected) {
+			s->rethrow();
+		} else if (s != nullptr && *s == Resolved) {
+			value = (T*)s->get_value();
+		}
+
+		return value;
+	}
+
+	template <typename T, typename REP, typename PERIOD>
+	T* await_for(IPROM_TYPE prom, const std::chrono::duration<REP, PERIOD> &timeout) {
+		return await_until<T>(prom, std::chrono::steady_clock::now() + std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout));
+	}
+
+	//Outcome - the settle-once end of a combinator. The first resolve()
+	//or reject() settles the result; the combinator then lets go of it,
+	//and whatever the other inputs settle with is dropped.
+	class Outcome {
+	public:
+		Outcome(PROM_TYPE prom)
+			:_result(prom),
+			_done(false)
+		{ }
+
+		bool decided(void) const {
+			return _done.load(std::memory_order_acquire);
+		}
+
+		template <typename T>
+		void resolve(T &&value) {
+			if (_claim()) {
+				Settlement settle(_result.get());
+				settle.resolve(std::forward<T>(value));
+				_result = nullptr;
+			}
+		}
+
+		//reject - ex, a caught exception or an input's rejected state.
+		template <typename E>
+		void reject(const E &ex) {
+			if (_claim()) {
+				Settlement settle(_result.get());
+				settle.reject(ex);
+				_result = nullptr;
+			}
+		}
+
+	private:
+		PROM_TYPE _result;
+		std::atomic<bool> _done;
+
+		bool _claim(void) {
+			return !_done.exchange(true, std::memory_order_acq_rel);
+		}
+	};
+
+	//Countdown - an Outcome waiting on count inputs. The extra count
+	//is dropped once every input has been looked at, so inputs settling
+	//meanwhile cannot finish it early.
+	class Countdown : public Outcome {
+	public:
+		Countdown(PROM_TYPE prom, size_t count)
+			:Outcome(prom),
+			_remaining(count + 1)
+		{ }
+
+		//arrive - true for the last one in.
+		bool arrive(void) {
+			return _remaining.fetch_sub(1, std::memory_order_acq_rel) == 1;
+		}
+
+	private:
+		std::atomic<size_t> _remaining;
+	};
+
+	//ResultSlots - one result per index, each set once, from any thread.
+	//Default constructible types are written straight into the vector
+	//take() hands over; others are built in place in raw storage.
+	template <typename T, bool = std::is_default_constructible<T>::value>
+	class ResultSlots {
+	public:
+		explicit ResultSlots(size_t count)
+			:_values(count)
+		{ }
+
+		void set(size_t i, T &&value) {
+			_values[i] = std::move(value);
+		}
+
+		//release - slot i, to be moved from once.
+		T&& release(size_t i) {
+			return std::move(_values[i]);
+		}
+
+		std::vector<T> take(void) {
+			return std::move(_values);
+		}
+
+	private:
+		std::vector<T> _values;
+	};
+
+	//std::vector<bool> packs its elements into shared words,
+	//so each slot is a char of its own until take().
+	template <>
+	class ResultSlots<bool, true> {
+	public:
+		explicit ResultSlots(size_t count)
+			:_values(count)
+		{ }
+
+		void set(size_t i, bool &&value) {
+			_values[i] = value;
+		}
+
+		bool release(size_t i) {
+			return _values[i] != 0;
+		}
+
+		std::vector<bool> take(void) {
+			return std::vector<bool>(_values.begin(), _values.end());
+		}
+
+	private:
+		std::vector<char> _values;
+	};
+
+	template <typename T>
+	class ResultSlots<T, false> {
+	public:
+		explicit ResultSlots(size_t count)
+			:_count(count),
+			_slots(new _Slot[count])
+		{
+			for (size_t i = 0; i < count; ++i) {
+				_slots[i].built = false;
+			}
+		}
+
+		~ResultSlots(void) {
+			for (size_t i = 0; i < _count; ++i) {
+				if (_slots[i].built) {
+					_get(i).~T();
+				}
+			}
+		}
+
+		void set(size_t i, T &&value) {
+			new (&_slots[i].storage) T(std::move(value));
+			_slots[i].built = true;
+		}
+
+		T&& release(size_t i) {
+			return std::move(_get(i));
+		}
+
+		//take - every slot must be set by now.
+		std::vector<T> take(void) {
+			std::vector<T> values;
+			values.reserve(_count);
+
+			for (size_t i = 0; i < _count; ++i) {
+				values.push_back(std::move(_get(i)));
+			}
+
+			return values;
+		}
+
+	private:
+		struct _Slot {
+			typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+			bool built;
+		};
+
+		size_t _count;
+		std::unique_ptr<_Slot[]> _slots;
+
+		T& _get(size_t i) {
+			return *reinterpret_cast<T*>(&_slots[i].storage);
+		}
+	};
+
+	//Slots - a Countdown with one result slot per input, filled by index.
+	template <typename T>
+	class Slots : public Countdown {
+	public:
+		Slots(PROM_TYPE prom, size_t count)
+			:Countdown(prom, count),
+			_values(count)
+		{ }
+
+		//fill - store slot i, the last one in resolves with all of them.
+		void fill(size_t i, T &&value) {
+			_values.set(i, std::move(value));
+			done();
+		}
+
+		void done(void) {
+			if (arrive()) {
+				resolve(take());
+			}
+		}
+
+		//set - store slot i without arriving, for callers that count themselves.
+		void set(size_t i, T &&value) {
+			_values.set(i, std::move(value));
+		}
+
+		std::vector<T> take(void) {
+			return _values.take();
+		}
+
+	private:
+		ResultSlots<T> _values;
+	};
+
+	//all - resolves with every input's value, in input order,
+	//or rejects with the first rejection. No thread waits on the inputs:
+	//inputs already settled are read right away, the others get a
+	//continuation that fills their slot.
+	template<typename COMMONTYPE>
+	std::shared_ptr<Promise> all(const std::vector<PROM_TYPE> &promises) {
+		std::shared_ptr<Promise> continuation = make_pooled<Promise>(pending_state);
+		std::shared_ptr<Slots<COMMONTYPE>> slots = make_pooled<Slots<COMMONTYPE>>(continuation, promises.size());
+
+		for (size_t i = 0; i < promises.size(); ++i) {
+			std::shared_ptr<State> state = promises[i]->get_state();
+
+			if (state == nullptr) {
+				slots->reject(Promise_Error("all(): promise ended without a value"));
+				break;
+			} else if (*state == Resolved) {
+				slots->fill(i, COMMONTYPE(*(COMMONTYPE*)state->get_value()));
+			} else if (*state == Rejected) {
+				slots->reject(state);
+				break;
+			} else {
+				//finally() also hears of a chain that ends later
+				promises[i]->finally([slots, i](const std::shared_ptr<State> &settled) {
+					if (settled == nullptr) {
+						slots->reject(Promise_Error("all(): promise ended without a value"));
+					} else if (*settled == Resolved) {
+						slots->fill(i, COMMONTYPE(*(COMMONTYPE*)settled->get_value()));
+					} else {
+						slots->reject(settled);
+					}
+				});
+			}
+		}
+
+		slots->done();
+
+		return continuation;
+	}
+
+	//race - settles the way the first input to settle does.
+	//Inputs already settled win in input order.
 	template<typename COMMONTYPE>
-	std::shared_ptr<Promise> all(std::vector<PROM_TYPE> &promises) {
-
-		std::shared_ptr<Promise> continuation = nullptr;
-
-		std::shared_ptr<ILambda> lam = settlement_lambda([&promises](Settlement settle) {
-			//create the list for results
-			std::vector<COMMONTYPE> results;
-
-			//loop through the promises
-			size_t i = 0;
-			for (i = 0; i < promises.size(); ++i) {
-				try {
-					COMMONTYPE* value = await<COMMONTYPE>(promises[i]);
-					results.push_back(*value);
-				} catch (const std::exception &ex) {
-					settle.reject(Promise_Error(ex.what()));
-					i = promises.size()+1;
+	std::shared_ptr<Promise> race(const std::vector<PROM_TYPE> &promises) {
+		std::shared_ptr<Promise> continuation = make_pooled<Promise>(pending_state);
+		std::shared_ptr<Outcome> outcome = make_pooled<Outcome>(continuation);
+
+		for (size_t i = 0; i < promises.size() && !outcome->decided(); ++i) {
+			std::shared_ptr<State> state = promises[i]->get_state();
+
+			if (state == nullptr) {
+				outcome->reject(Promise_Error("race(): promise ended without a value"));
+			} else if (*state == Resolved) {
+				outcome->resolve(COMMONTYPE(*(COMMONTYPE*)state->get_value()));
+			} else if (*state == Rejected) {
+				outcome->reject(state);
+			} else {
+				//losers only look at their state, nothing is copied
+				promises[i]->finally([outcome](const std::shared_ptr<State> &settled) {
+					if (outcome->decided()) {
+						return;
+					}
+
+					if (settled == nullptr) {
+						outcome->reject(Promise_Error("race(): promise ended without a value"));
+					} else if (*settled == Resolved) {
+						outcome->resolve(COMMONTYPE(*(COMMONTYPE*)settled->get_value()));
+					} else {
+						outcome->reject(settled);
+					}
+				});
+			}
+		}
+
+		return continuation;
+	}
+
+	//any - resolves with the first input to resolve. Rejects only once
+	//every input has, with all the reasons in one Promise_Error.
+	template<typename COMMONTYPE>
+	std::shared_ptr<Promise> any(const std::vector<PROM_TYPE> &promises) {
+		std::shared_ptr<Promise> continuation = make_pooled<Promise>(pending_state);
+		std::shared_ptr<Slots<std::string>> reasons = make_pooled<Slots<std::string>>(continuation, promises.size());
+
+		std::function<void(void)> rejected = [reasons]() {
+			if (reasons->arrive()) {
+				std::string msg = "any(): every promise was rejected";
+				std::vector<std::string> all = reasons->take();
+
+				for (size_t i = 0; i < all.size(); ++i) {
+					msg += (i == 0 ? ": " : "; ") + all[i];
 				}
+
+				reasons->reject(Promise_Error(msg));
 			}
-			
-			if (i < (promises.size()+1)) {
-				settle.resolve<std::vector<COMMONTYPE>>(results);
+		};
+
+		for (size_t i = 0; i < promises.size() && !reasons->decided(); ++i) {
+			std::shared_ptr<State> state = promises[i]->get_state();
+
+			if (state == nullptr) {
+				reasons->set(i, std::string("promise ended without a value"));
+				rejected();
+			} else if (*state == Resolved) {
+				reasons->resolve(COMMONTYPE(*(COMMONTYPE*)state->get_value()));
+			} else if (*state == Rejected) {
+				reasons->set(i, std::string(state->get_reason().what()));
+				rejected();
+			} else {
+				promises[i]->finally([reasons, rejected, i](const std::shared_ptr<State> &settled) {
+					if (settled != nullptr && *settled == Resolved) {
+						if (!reasons->decided()) {
+							reasons->resolve(COMMONTYPE(*(COMMONTYPE*)settled->get_value()));
+						}
+						return;
+					}
+
+					reasons->set(i, std::string(settled == nullptr ? "promise ended without a value" : settled->get_reason().what()));
+					rejected();
+				});
 			}
-		});
+		}
 
-		continuation = std::make_shared<Promise>(lam);
+		rejected();
 
 		return continuation;
 	}
 
-	template<typename KEYTYPE, typename COMMONTYPE>
-	std::shared_ptr<Promise> hash(std::map<KEYTYPE, PROM_TYPE> &promises) {
+	//allSettled - resolves with every input's settled state, in input order:
+	//ResolvedState<COMMONTYPE> or RejectedState. Never rejects.
+	template<typename COMMONTYPE>
+	std::shared_ptr<Promise> allSettled(const std::vector<PROM_TYPE> &promises) {
+		typedef std::shared_ptr<State> STATE_TYPE;
 
-		std::shared_ptr<Promise> continuation = nullptr;
+		std::shared_ptr<Promise> continuation = make_pooled<Promise>(pending_state);
+		std::shared_ptr<Slots<STATE_TYPE>> slots = make_pooled<Slots<STATE_TYPE>>(continuation, promises.size());
 
-		std::shared_ptr<ILambda> lam = settlement_lambda([&promises](Settlement settle) {
-			std::map<KEYTYPE, COMMONTYPE> results;
-			bool early_termination = false;
-			
-			//loop through the promises
-			for (auto it = promises.begin(); it != promises.end(); it++) {
-				try {
-					COMMONTYPE* value = await<COMMONTYPE>(it->second);
-					results.insert(std::pair<KEYTYPE, COMMONTYPE>(it->first, *value));
-				} catch (const std::exception &ex) {
-					settle.reject(Promise_Error(ex.what()));
-					it = promises.end();
-					it++;
-					early_termination = true;
+		for (size_t i = 0; i < promises.size(); ++i) {
+			STATE_TYPE state = promises[i]->get_state();
+
+			if (state == nullptr) {
+				slots->fill(i, make_pooled<RejectedState>("allSettled(): promise ended without a value"));
+			} else if (*state == Resolved || *state == Rejected) {
+				//settled states never change, they can be shared
+				slots->fill(i, std::move(state));
+			} else {
+				//finally() also hears of a chain that ends later
+				promises[i]->finally([slots, i](const STATE_TYPE &settled) {
+					if (settled == nullptr) {
+						slots->fill(i, make_pooled<RejectedState>("allSettled(): promise ended without a value"));
+					} else {
+						slots->fill(i, STATE_TYPE(settled));
+					}
+				});
+			}
+		}
+
+		slots->done();
+
+		return continuation;
+	}
+
+	//_Delay - the timer behind delay(), it owns itself until it fires.
+	template <typename T>
+	struct _Delay : public TimerNode {
+		_Delay(PROM_TYPE p, T &&v)
+			:TimerNode(&_Delay::_fire),
+			prom(std::move(p)),
+			value(std::move(v))
+		{ }
+
+		PROM_TYPE prom;
+		T value;
+
+		static void _fire(TimerNode* node) {
+			_Delay* self = static_cast<_Delay*>(node);
+			PROM_TYPE prom = std::move(self->prom);
+			T value = std::move(self->value);
+			pool_delete(self);
+
+			Settlement(prom.get()).resolve(std::move(value));
+		}
+	};
+
+	//delay - resolves with value once duration has passed, on the timer thread.
+	//Costs one pooled node on the shared TimerWheel, not a thread.
+	template <typename T, typename REP, typename PERIOD>
+	std::shared_ptr<Promise> delay(const std::chrono::duration<REP, PERIOD> &duration, T value) {
+		std::shared_ptr<Promise> continuation = make_pooled<Promise>(pending_state);
+		_Delay<T>* timer = pool_new<_Delay<T>>(continuation, std::move(value));
+
+		timers().schedule(timer, timer_clock::now() + std::chrono::duration_cast<timer_clock::duration>(duration));
+
+		return continuation;
+	}
+
+	//delay - resolves with true once duration has passed.
+	template <typename REP, typename PERIOD>
+	std::shared_ptr<Promise> delay(const std::chrono::duration<REP, PERIOD> &duration) {
+		return delay(duration, true);
+	}
+
+	//_Deadline - the timer half of timeout(). While scheduled it holds
+	//itself through self; whichever side takes it off the wheel lets go.
+	struct _Deadline : public TimerNode {
+		explicit _Deadline(std::shared_ptr<Outcome> o)
+			:TimerNode(&_Deadline::_fire),
+			outcome(std::move(o))
+		{ }
+
+		std::shared_ptr<Outcome> outcome;
+		std::shared_ptr<_Deadline> self;
+
+		//_disarm - prom settled first, drop the timer if it has not fired.
+		void _disarm(void) {
+			if (timers().cancel(this)) {
+				self = nullptr;
+			}
+		}
+
+		static void _fire(TimerNode* node) {
+			std::shared_ptr<_Deadline> keep;
+			keep.swap(static_cast<_Deadline*>(node)->self);
+
+			keep->outcome->reject(Timeout());
+		}
+	};
+
+	//timeout - settles like prom, or rejects with Timeout if prom is still
+	//pending after duration. prom itself keeps running either way.
+	//A chain that ends without a value rejects it at once.
+	//Once prom settles the timer is taken off the wheel, so a timeout
+	//that never fires holds nothing until its deadline.
+	template<typename COMMONTYPE, typename REP, typename PERIOD>
+	std::shared_ptr<Promise> timeout(const PROM_TYPE &prom, const std::chrono::duration<REP, PERIOD> &duration) {
+		std::shared_ptr<Promise> continuation = make_pooled<Promise>(pending_state);
+		std::shared_ptr<Outcome> outcome = make_pooled<Outcome>(continuation);
+		std::shared_ptr<State> state = prom->get_state();
+
+		if (state == nullptr) {
+			outcome->reject(Promise_Error("timeout(): promise ended without a value"));
+		} else if (*state == Resolved) {
+			outcome->resolve(COMMONTYPE(*(COMMONTYPE*)state->get_value()));
+		} else if (*state == Rejected) {
+			outcome->reject(state);
+		} else {
+			std::shared_ptr<_Deadline> deadline = make_pooled<_Deadline>(outcome);
+			deadline->self = deadline;
+
+			timers().schedule(deadline.get(), timer_clock::now() + std::chrono::duration_cast<timer_clock::duration>(duration));
+
+			//a chain that ends without a value is done too, not timed out
+			prom->finally([outcome, deadline](const std::shared_ptr<State> &settled) {
+				deadline->_disarm();
+
+				if (outcome->decided()) {
+					return;
 				}
+
+				if (settled == nullptr) {
+					outcome->reject(Promise_Error("timeout(): promise ended without a value"));
+				} else if (*settled == Resolved) {
+					outcome->resolve(COMMONTYPE(*(COMMONTYPE*)settled->get_value()));
+				} else {
+					outcome->reject(settled);
+				}
+			});
+		}
+
+		return continuation;
+	}
+
+	//Keyed - Slots for a keyed fan-out. Keys and values are kept side by side
+	//in input order and only paired up into OUTPUT once the last one is in.
+	template <typename KEYTYPE, typename COMMONTYPE, typename OUTPUT>
+	class Keyed : public Countdown {
+	public:
+		Keyed(PROM_TYPE prom, size_t count)
+			:Countdown(prom, count),
+			_values(count)
+		{
+			_keys.reserve(count);
+		}
+
+		//key - the key of the next input, called in input order.
+		void key(const KEYTYPE &k) {
+			_keys.push_back(k);
+		}
+
+		void fill(size_t i, COMMONTYPE &&value) {
+			_values.set(i, std::move(value));
+			done();
+		}
+
+		void done(void) {
+			if (arrive()) {
+				OUTPUT results;
+				_collect(results);
+				resolve(std::move(results));
 			}
-			
-			if (!early_termination) {
-				settle.resolve<std::map<KEYTYPE, COMMONTYPE>>(results);
+		}
+
+	private:
+		std::vector<KEYTYPE> _keys;
+		ResultSlots<COMMONTYPE> _values;
+
+		void _collect(std::map<KEYTYPE, COMMONTYPE> &results) {
+			for (size_t i = 0; i < _keys.size(); ++i) {
+				results.emplace_hint(results.end(), std::move(_keys[i]), _values.release(i));
+			}
+		}
+
+		void _collect(std::unordered_map<KEYTYPE, COMMONTYPE> &results) {
+			results.reserve(_keys.size());
+
+			for (size_t i = 0; i < _keys.size(); ++i) {
+				results.emplace(std::move(_keys[i]), _values.release(i));
+			}
+		}
+
+		void _collect(std::vector<std::pair<KEYTYPE, COMMONTYPE>> &results) {
+			results.reserve(_keys.size());
+
+			for (size_t i = 0; i < _keys.size(); ++i) {
+				results.emplace_back(std::move(_keys[i]), _values.release(i));
+			}
+
+			//a no-op pass when the input was already ordered
+			std::stable_sort(results.begin(), results.end(), [](const std::pair<KEYTYPE, COMMONTYPE> &a, const std::pair<KEYTYPE, COMMONTYPE> &b) {
+				return a.first < b.first;
+			});
+		}
+	};
+
+	//keyed - the fan-out behind hash() and its variants. promises is any
+	//range of (key, PROM_TYPE) pairs with a size(). Settled entries are read
+	//right away, the rest fill their slot as they settle; the first
+	//rejection rejects the lot.
+	template<typename KEYTYPE, typename COMMONTYPE, typename OUTPUT, typename RANGE>
+	std::shared_ptr<Promise> keyed(const RANGE &promises) {
+		typedef Keyed<KEYTYPE, COMMONTYPE, OUTPUT> KEYED_TYPE;
+
+		std::shared_ptr<Promise> continuation = make_pooled<Promise>(pending_state);
+		std::shared_ptr<KEYED_TYPE> slots = make_pooled<KEYED_TYPE>(continuation, promises.size());
+
+		size_t i = 0;
+		for (auto it = promises.begin(); it != promises.end(); ++it, ++i) {
+			std::shared_ptr<State> state = it->second->get_state();
+			slots->key(it->first);
+
+			if (state == nullptr) {
+				slots->reject(Promise_Error("hash(): promise ended without a value"));
+				break;
+			} else if (*state == Resolved) {
+				slots->fill(i, COMMONTYPE(*(COMMONTYPE*)state->get_value()));
+			} else if (*state == Rejected) {
+				slots->reject(state);
+				break;
+			} else {
+				//finally() also hears of a chain that ends later
+				it->second->finally([slots, i](const std::shared_ptr<State> &settled) {
+					if (settled == nullptr) {
+						slots->reject(Promise_Error("hash(): promise ended without a value"));
+					} else if (*settled == Resolved) {
+						slots->fill(i, COMMONTYPE(*(COMMONTYPE*)settled->get_value()));
+					} else {
+						slots->reject(settled);
+					}
+				});
 			}
-		});
+		}
 
-		continuation = std::make_shared<Promise>(lam);
+		slots->done();
 
 		return continuation;
 	}
 
+	//hash - resolves with a std::map of every entry's value, or rejects
+	//with the first rejection: in key order among entries already settled
+	//when hash() is called, otherwise whichever rejects first.
+	template<typename KEYTYPE, typename COMMONTYPE>
+	std::shared_ptr<Promise> hash(std::map<KEYTYPE, PROM_TYPE> &promises) {
+		return keyed<KEYTYPE, COMMONTYPE, std::map<KEYTYPE, COMMONTYPE>>(promises);
+	}
+
+	//hash_unordered - hash() into a std::unordered_map, from any keyed range.
+	template<typename KEYTYPE, typename COMMONTYPE, typename RANGE>
+	std::shared_ptr<Promise> hash_unordered(const RANGE &promises) {
+		return keyed<KEYTYPE, COMMONTYPE, std::unordered_map<KEYTYPE, COMMONTYPE>>(promises);
+	}
+
+	//hash_sorted - hash() into a vector of (key, value) pairs sorted by key,
+	//from any keyed range.
+	template<typename KEYTYPE, typename COMMONTYPE, typename RANGE>
+	std::shared_ptr<Promise> hash_sorted(const RANGE &promises) {
+		return keyed<KEYTYPE, COMMONTYPE, std::vector<std::pair<KEYTYPE, COMMONTYPE>>>(promises);
+	}
+
 	typedef std::shared_ptr<Promise> PROMTYPE;
 } // namespace Promises
 
 template<typename LAMBDA>
 std::shared_ptr<Promises::Promise> promise(LAMBDA handle) {
-	std::shared_ptr<Promises::ILambda> l = Promises::settlement_lambda<LAMBDA>(handle);
-	std::shared_ptr<Promises::Promise> prom = std::make_shared<Promises::Promise>(l);
+	std::shared_ptr<Promises::Promise> prom = Promises::make_pooled<Promises::Promise>(Promises::Handler(Promises::settlement_lambda<LAMBDA>(std::move(handle))));
+
+	return prom;
+}
+
+//promise - skipped, and rejected with Cancelled, if token is cancelled before handle starts.
+template<typename LAMBDA>
+std::shared_ptr<Promises::Promise> promise(const Promises::CancelToken &token, LAMBDA handle) {
+	std::shared_ptr<Promises::Promise> prom = Promises::make_pooled<Promises::Promise>(Promises::Handler(Promises::settlement_lambda<LAMBDA>(std::move(handle))), token);
 
 	return prom;
 }
@@ -1,3 +1,5 @@
+#include <cstring>
+#include <memory>
 #include <stdexcept>
 #include <string>
 
@@ -8,18 +10,20 @@ namespace Promises {
 
     //Promise_Error - used to capture exceptions
     //defined our own exception because exceptions in std do not have copy constructors
+    //Copies share one immutable message, so passing a Promise_Error
+    //along never copies the string.
     class Promise_Error : public std::exception {
         public:
             explicit Promise_Error(const std::string &msg)
-                :_msg(msg)
+                :_msg(std::make_shared<const std::string>(msg))
             { }
 
             explicit Promise_Error(const char *msg)
-                :_msg(msg)
+                :_msg(std::make_shared<const std::string>(msg))
             { }
 
             Promise_Error(const std::exception &e) 
-                :_msg(e.what())
+                :_msg(_message_of(e))
             { }
 
             Promise_Error(const Promise_Error &err)
@@ -27,7 +31,7 @@ namespace Promises {
             { }
 
             virtual const char* what() const noexcept {
-                return _msg.c_str();
+                return _msg->c_str();
             }
 
             virtual ~Promise_Error(void)
@@ -38,20 +42,26 @@ namespace Promises {
 					return (*this);
 				}
 				
-				_msg = err.what();
+				_msg = _message_of(err);
                 return (*this);
 			}
 
             bool operator == (const Promise_Error &err) {
-                return (_msg.compare(err._msg) == 0);
+                return (strcmp(what(), err.what()) == 0);
             }
 
             bool operator != (const Promise_Error &err) {
-                return (_msg.compare(err._msg) != 0);
+                return (strcmp(what(), err.what()) != 0);
             }
 
         private:
-            std::string _msg;
+            std::shared_ptr<const std::string> _msg;
+
+            //another Promise_Error's message is shared rather than copied
+            static std::shared_ptr<const std::string> _message_of(const std::exception &e) {
+                const Promise_Error* err = dynamic_cast<const Promise_Error*>(&e);
+                return (err != nullptr) ? err->_msg : std::make_shared<const std::string>(e.what());
+            }
     };
 
 }
@@ -0,0 +1,672 @@
+#include "Promise.h"
+#include "Promise_Error.h"
+#include "Executor.h"
+#include "Cancellation.h"
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+#ifndef REACTOR_H
+#define REACTOR_H
+
+//readiness events taken per epoll_wait.
+#ifndef REACTOR_BATCH
+#define REACTOR_BATCH 64
+#endif
+
+#if defined(__linux__)
+namespace Promises {
+
+	//IoWaiter - an intrusive wait for one direction of one fd.
+	//ready runs once, with no lock held: on the reactor thread with the
+	//epoll events that woke it, or with 0 if the wait was dropped.
+	struct IoWaiter {
+		explicit IoWaiter(void (*f)(IoWaiter*, uint32_t))
+			:next(nullptr),
+			ready(f)
+		{ }
+
+		IoWaiter* next;
+		void (*ready)(IoWaiter* self, uint32_t events);
+	};
+
+	//Reactor - one epoll instance and the thread that waits on it.
+	//Waiters queue per fd and direction, and each readiness event wakes
+	//the oldest one; the fd stays registered, level-triggered, only while
+	//someone waits on it. Every event from one epoll_wait is matched under
+	//a single lock, then woken in a batch.
+	//It is also an executor: submitted tasks run on the reactor thread,
+	//woken through an eventfd.
+	class Reactor : public IExecutor {
+	public:
+		Reactor(void)
+			:_epoll(epoll_create1(EPOLL_CLOEXEC)),
+			_wake(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)),
+			_stop(false),
+			_error(0)
+		{
+			if (_epoll < 0 || _wake < 0) {
+				int error = errno;
+				_close();
+				throw std::system_error(error, std::generic_category(), "Reactor()");
+			}
+
+			epoll_event ev;
+			ev.events = EPOLLIN;
+			ev.data.fd = _wake;
+
+			if (epoll_ctl(_epoll, EPOLL_CTL_ADD, _wake, &ev) != 0) {
+				int error = errno;
+				_close();
+				throw std::system_error(error, std::generic_category(), "Reactor()");
+			}
+
+			_thread = std::thread(&Reactor::_work, this);
+		}
+
+		//waits still pending are dropped, and queued tasks run here
+		virtual ~Reactor(void) {
+			_stop.store(true, std::memory_order_release);
+			_signal();
+			_thread.join();
+
+			std::vector<IoWaiter*> dropped;
+			std::deque<std::function<void(void)>> tasks;
+
+			{
+				std::unique_lock<std::mutex> lock(_lock);
+
+				for (std::unordered_map<int, _Interest>::iterator it = _fds.begin(); it != _fds.end(); ++it) {
+					_take_all(it->second, dropped);
+				}
+				_fds.clear();
+				tasks.swap(_tasks);
+			}
+
+			for (size_t i = 0; i < dropped.size(); ++i) {
+				dropped[i]->ready(dropped[i], 0);
+			}
+
+			for (size_t i = 0; i < tasks.size(); ++i) {
+				run_task(tasks[i]);
+			}
+
+			_close();
+		}
+
+		Reactor(const Reactor&) = delete;
+		Reactor& operator = (const Reactor&) = delete;
+
+		//watch - wake w once fd is ready for direction, EPOLLIN or EPOLLOUT.
+		//Throws std::system_error if epoll refuses fd, e.g. a regular file,
+		//or if epoll_wait failed and the reactor thread has stopped.
+		void watch(int fd, uint32_t direction, IoWaiter* w) {
+			std::unique_lock<std::mutex> lock(_lock);
+
+			if (_error != 0) {
+				throw std::system_error(_error, std::generic_category(), "Reactor.watch()");
+			}
+
+			std::pair<std::unordered_map<int, _Interest>::iterator, bool> found = _fds.insert(std::make_pair(fd, _Interest()));
+			_Interest &in = found.first->second;
+
+			_push((direction == EPOLLIN) ? in.readers : in.writers, w);
+
+			int error = _arm(fd, in);
+			if (error != 0) {
+				_pop((direction == EPOLLIN) ? in.readers : in.writers, w);
+
+				if (in.readers.head == nullptr && in.writers.head == nullptr) {
+					_fds.erase(found.first);
+				}
+
+				throw std::system_error(error, std::generic_category(), "Reactor.watch()");
+			}
+		}
+
+		//forget - stop watching fd, dropping its waiters on this thread.
+		//Call it before closing an fd that still has waiters.
+		void forget(int fd) {
+			std::vector<IoWaiter*> dropped;
+
+			{
+				std::unique_lock<std::mutex> lock(_lock);
+				std::unordered_map<int, _Interest>::iterator it = _fds.find(fd);
+
+				if (it == _fds.end()) {
+					return;
+				}
+
+				_take_all(it->second, dropped);
+				epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+				_fds.erase(it);
+			}
+
+			for (size_t i = 0; i < dropped.size(); ++i) {
+				dropped[i]->ready(dropped[i], 0);
+			}
+		}
+
+		//fds with someone waiting on them
+		size_t watched(void) {
+			std::unique_lock<std::mutex> lock(_lock);
+			return _fds.size();
+		}
+
+		//once the reactor thread has stopped on an epoll_wait error,
+		//tasks run on the submitting thread instead
+		virtual void submit(std::function<void(void)> task) {
+			PROMISE_METRIC(TasksSubmitted, 1);
+			bool stopped;
+
+			{
+				std::unique_lock<std::mutex> lock(_lock);
+				stopped = (_error != 0);
+
+				if (!stopped) {
+					_tasks.push_back(std::move(task));
+				}
+			}
+
+			if (stopped) {
+				run_task(task);
+				return;
+			}
+
+			_signal();
+		}
+
+		virtual bool try_run_pending(void) {
+			std::function<void(void)> task;
+
+			{
+				std::unique_lock<std::mutex> lock(_lock);
+
+				if (_tasks.empty()) {
+					return false;
+				}
+
+				task = std::move(_tasks.front());
+				_tasks.pop_front();
+			}
+
+			run_task(task);
+			return true;
+		}
+
+		//readable - resolves with fd once it can be read without blocking,
+		//or has hung up. Rejects with Cancelled if the fd is forgotten.
+		std::shared_ptr<Promise> readable(int fd) {
+			return _ready(fd, EPOLLIN);
+		}
+
+		std::shared_ptr<Promise> writable(int fd) {
+			return _ready(fd, EPOLLOUT);
+		}
+
+		//async_read - resolves with one read of up to max bytes, once fd is
+		//readable. An empty string is end of file. The read runs on the
+		//reactor thread, so fd should be non-blocking, or read only here.
+		std::shared_ptr<Promise> async_read(int fd, size_t max) {
+			std::shared_ptr<Promise> prom = make_pooled<Promise>(pending_state);
+			_Read* w = pool_new<_Read>(this, prom, fd, max);
+
+			_start(fd, EPOLLIN, w, prom);
+			return prom;
+		}
+
+		//async_write - resolves with the number of bytes written, which is
+		//all of data, waiting for fd to be writable as often as it takes.
+		//A peer that hung up rejects with EPIPE rather than raising SIGPIPE
+		//on sockets; on a pipe SIGPIPE is left to the caller.
+		std::shared_ptr<Promise> async_write(int fd, std::string data) {
+			std::shared_ptr<Promise> prom = make_pooled<Promise>(pending_state);
+			_Write* w = pool_new<_Write>(this, prom, fd, std::move(data));
+
+			_start(fd, EPOLLOUT, w, prom);
+			return prom;
+		}
+
+	private:
+		//_Queue - a FIFO of waiters, one direction of one fd.
+		struct _Queue {
+			_Queue(void)
+				:head(nullptr),
+				tail(nullptr)
+			{ }
+
+			IoWaiter* head;
+			IoWaiter* tail;
+		};
+
+		struct _Interest {
+			_Interest(void)
+				:armed(0)
+			{ }
+
+			_Queue readers;
+			_Queue writers;
+			uint32_t armed;
+		};
+
+		//_Ready - readable()/writable(): resolves with the fd.
+		struct _Ready : public IoWaiter {
+			_Ready(PROM_TYPE p, int f)
+				:IoWaiter(&_Ready::_fire),
+				prom(std::move(p)),
+				fd(f)
+			{ }
+
+			PROM_TYPE prom;
+			int fd;
+
+			static void _fire(IoWaiter* w, uint32_t events) {
+				_Ready* self = static_cast<_Ready*>(w);
+				PROM_TYPE prom = std::move(self->prom);
+				int fd = self->fd;
+				pool_delete(self);
+
+				if (events == 0) {
+					Settlement(prom.get()).reject(Cancelled());
+				} else {
+					Settlement(prom.get()).resolve<int>(fd);
+				}
+			}
+		};
+
+		struct _Read : public IoWaiter {
+			_Read(Reactor* r, PROM_TYPE p, int f, size_t m)
+				:IoWaiter(&_Read::_fire),
+				reactor(r),
+				prom(std::move(p)),
+				fd(f),
+				max(m)
+			{ }
+
+			Reactor* reactor;
+			PROM_TYPE prom;
+			int fd;
+			size_t max;
+
+			static void _fire(IoWaiter* w, uint32_t events) {
+				_Read* self = static_cast<_Read*>(w);
+
+				if (events == 0) {
+					_finish(self, std::make_exception_ptr(Cancelled()));
+					return;
+				}
+
+				std::string data(self->max, '\0');
+				ssize_t n = ::read(self->fd, &data[0], self->max);
+
+				if (n >= 0) {
+					data.resize((size_t)n);
+
+					PROM_TYPE prom = std::move(self->prom);
+					pool_delete(self);
+					Settlement(prom.get()).resolve(std::move(data));
+				} else if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+					//someone else got there first, wait for more
+					self->reactor->_rewatch(self->fd, EPOLLIN, self);
+				} else {
+					_finish(self, std::make_exception_ptr(std::system_error(errno, std::generic_category(), "async_read()")));
+				}
+			}
+		};
+
+		struct _Write : public IoWaiter {
+			_Write(Reactor* r, PROM_TYPE p, int f, std::string &&d)
+				:IoWaiter(&_Write::_fire),
+				reactor(r),
+				prom(std::move(p)),
+				fd(f),
+				data(std::move(d)),
+				written(0)
+			{ }
+
+			Reactor* reactor;
+			PROM_TYPE prom;
+			int fd;
+			std::string data;
+			size_t written;
+
+			static void _fire(IoWaiter* w, uint32_t events) {
+				_Write* self = static_cast<_Write*>(w);
+
+				if (events == 0) {
+					_finish(self, std::make_exception_ptr(Cancelled()));
+					return;
+				}
+
+				while (self->written < self->data.size()) {
+					ssize_t n = _write_some(self->fd, self->data.data() + self->written, self->data.size() - self->written);
+
+					if (n > 0) {
+						self->written += (size_t)n;
+					} else if (n < 0 && errno == EINTR) {
+						continue;
+					} else if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+						self->reactor->_rewatch(self->fd, EPOLLOUT, self);
+						return;
+					} else {
+						_finish(self, std::make_exception_ptr(std::system_error(n < 0 ? errno : EIO, std::generic_category(), "async_write()")));
+						return;
+					}
+				}
+
+				PROM_TYPE prom = std::move(self->prom);
+				size_t written = self->written;
+				pool_delete(self);
+				Settlement(prom.get()).resolve<size_t>(written);
+			}
+
+			//a blocking fd writes everything at once, a non-blocking one
+			//what fits. send() keeps a closed socket from raising SIGPIPE.
+			static ssize_t _write_some(int fd, const char* data, size_t size) {
+				ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+
+				if (n < 0 && errno == ENOTSOCK) {
+					n = ::write(fd, data, size);
+				}
+
+				return n;
+			}
+		};
+
+		int _epoll;
+		int _wake;
+		std::atomic<bool> _stop;
+		std::thread _thread;
+
+		std::mutex _lock;
+		std::unordered_map<int, _Interest> _fds;
+		std::deque<std::function<void(void)>> _tasks;
+		int _error;
+
+		//_finish - reject a helper's promise with error and free the helper.
+		template <typename WAITER>
+		static void _finish(WAITER* self, std::exception_ptr error) {
+			PROM_TYPE prom = std::move(self->prom);
+			pool_delete(self);
+			Settlement(prom.get()).reject(error);
+		}
+
+		std::shared_ptr<Promise> _ready(int fd, uint32_t direction) {
+			std::shared_ptr<Promise> prom = make_pooled<Promise>(pending_state);
+			_Ready* w = pool_new<_Ready>(prom, fd);
+
+			_start(fd, direction, w, prom);
+			return prom;
+		}
+
+		//_start - watch for a helper, rejecting its promise if epoll refuses fd.
+		template <typename WAITER>
+		void _start(int fd, uint32_t direction, WAITER* w, const PROM_TYPE &prom) {
+			try {
+				watch(fd, direction, w);
+			} catch (const std::system_error &ex) {
+				pool_delete(w);
+				Settlement(prom.get()).reject(std::current_exception());
+			}
+		}
+
+		//_rewatch - a helper going back to waiting, from its own ready().
+		template <typename WAITER>
+		void _rewatch(int fd, uint32_t direction, WAITER* w) {
+			try {
+				watch(fd, direction, w);
+			} catch (const std::system_error &ex) {
+				_finish(w, std::current_exception());
+			}
+		}
+
+		void _signal(void) {
+			uint64_t one = 1;
+			ssize_t n = ::write(_wake, &one, sizeof(one));
+			(void)n;
+		}
+
+		void _close(void) {
+			if (_wake >= 0) {
+				::close(_wake);
+			}
+
+			if (_epoll >= 0) {
+				::close(_epoll);
+			}
+		}
+
+		static void _push(_Queue &q, IoWaiter* w) {
+			w->next = nullptr;
+
+			if (q.tail != nullptr) {
+				q.tail->next = w;
+			} else {
+				q.head = w;
+			}
+			q.tail = w;
+		}
+
+		static IoWaiter* _shift(_Queue &q) {
+			IoWaiter* w = q.head;
+
+			if (w != nullptr) {
+				q.head = w->next;
+				q.tail = (q.head == nullptr) ? nullptr : q.tail;
+				w->next = nullptr;
+			}
+
+			return w;
+		}
+
+		//_pop - take w back off the end it was just pushed onto.
+		static void _pop(_Queue &q, IoWaiter* w) {
+			IoWaiter* prev = nullptr;
+
+			for (IoWaiter* it = q.head; it != nullptr; prev = it, it = it->next) {
+				if (it == w) {
+					if (prev == nullptr) {
+						q.head = w->next;
+					} else {
+						prev->next = w->next;
+					}
+
+					q.tail = (q.tail == w) ? prev : q.tail;
+					w->next = nullptr;
+					return;
+				}
+			}
+		}
+
+		static void _take_all(_Interest &in, std::vector<IoWaiter*> &out) {
+			for (IoWaiter* w = _shift(in.readers); w != nullptr; w = _shift(in.readers)) {
+				out.push_back(w);
+			}
+
+			for (IoWaiter* w = _shift(in.writers); w != nullptr; w = _shift(in.writers)) {
+				out.push_back(w);
+			}
+		}
+
+		//_fail - epoll_wait failed for good: keep the error for later
+		//watch() calls, drop the waiters and run what is queued.
+		void _fail(int error) {
+			std::vector<IoWaiter*> dropped;
+			std::deque<std::function<void(void)>> tasks;
+
+			{
+				std::unique_lock<std::mutex> lock(_lock);
+				_error = error;
+
+				for (std::unordered_map<int, _Interest>::iterator it = _fds.begin(); it != _fds.end(); ++it) {
+					_take_all(it->second, dropped);
+				}
+				_fds.clear();
+				tasks.swap(_tasks);
+			}
+
+			for (size_t i = 0; i < dropped.size(); ++i) {
+				dropped[i]->ready(dropped[i], 0);
+			}
+
+			for (size_t i = 0; i < tasks.size(); ++i) {
+				run_task(tasks[i]);
+			}
+		}
+
+		//_arm - bring fd's epoll registration in line with its waiters.
+		//Returns the errno of a failed epoll_ctl, or 0.
+		int _arm(int fd, _Interest &in) {
+			uint32_t wanted = (in.readers.head != nullptr ? (uint32_t)EPOLLIN : 0u) | (in.writers.head != nullptr ? (uint32_t)EPOLLOUT : 0u);
+
+			if (wanted == in.armed) {
+				return 0;
+			}
+
+			//a closed fd has left the epoll set already, nothing to undo
+			if (wanted == 0) {
+				epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+				in.armed = 0;
+				return 0;
+			}
+
+			epoll_event ev;
+			ev.events = wanted;
+			ev.data.fd = fd;
+
+			int rc = epoll_ctl(_epoll, in.armed == 0 ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev);
+
+			//closed and reopened under the same number since it was armed
+			if (rc != 0 && errno == ENOENT) {
+				rc = epoll_ctl(_epoll, EPOLL_CTL_ADD, fd, &ev);
+			}
+
+			if (rc != 0) {
+				return errno;
+			}
+
+			in.armed = wanted;
+			return 0;
+		}
+
+		void _work(void) {
+			current_executor() = this;
+
+			epoll_event events[REACTOR_BATCH];
+			std::vector<std::pair<IoWaiter*, uint32_t>> woken;
+			std::deque<std::function<void(void)>> tasks;
+
+			while (!_stop.load(std::memory_order_acquire)) {
+				int n = epoll_wait(_epoll, events, REACTOR_BATCH, -1);
+
+				if (n < 0) {
+					if (errno == EINTR) {
+						continue;
+					}
+
+					_fail(errno);
+					break;
+				}
+
+				{
+					std::unique_lock<std::mutex> lock(_lock);
+
+					for (int i = 0; i < n; ++i) {
+						int fd = events[i].data.fd;
+						uint32_t ev = events[i].events;
+
+						if (fd == _wake) {
+							uint64_t count;
+							ssize_t r = ::read(_wake, &count, sizeof(count));
+							(void)r;
+							continue;
+						}
+
+						//forgotten since epoll_wait returned
+						std::unordered_map<int, _Interest>::iterator it = _fds.find(fd);
+						if (it == _fds.end()) {
+							continue;
+						}
+
+						_Interest &in = it->second;
+
+						if (ev & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+							IoWaiter* w = _shift(in.readers);
+							if (w != nullptr) {
+								woken.push_back(std::make_pair(w, ev));
+							}
+						}
+
+						if (ev & (EPOLLOUT | EPOLLHUP | EPOLLERR)) {
+							IoWaiter* w = _shift(in.writers);
+							if (w != nullptr) {
+								woken.push_back(std::make_pair(w, ev));
+							}
+						}
+
+						_arm(fd, in);
+						if (in.readers.head == nullptr && in.writers.head == nullptr) {
+							_fds.erase(it);
+						}
+					}
+
+					tasks.swap(_tasks);
+				}
+
+				for (size_t i = 0; i < woken.size(); ++i) {
+					woken[i].first->ready(woken[i].first, woken[i].second);
+				}
+				woken.clear();
+
+				while (!tasks.empty()) {
+					run_task(tasks.front());
+					tasks.pop_front();
+				}
+			}
+
+			current_executor() = nullptr;
+		}
+	};
+
+	//reactor - the Reactor the free functions below use, started on first use.
+	//Never destroyed, like the default executor's registry.
+	inline Reactor& reactor(void) {
+		static Reactor* r = new Reactor();
+		return *r;
+	}
+
+	inline std::shared_ptr<Promise> readable(int fd) {
+		return reactor().readable(fd);
+	}
+
+	inline std::shared_ptr<Promise> writable(int fd) {
+		return reactor().writable(fd);
+	}
+
+	inline std::shared_ptr<Promise> async_read(int fd, size_t max) {
+		return reactor().async_read(fd, max);
+	}
+
+	inline std::shared_ptr<Promise> async_write(int fd, std::string data) {
+		return reactor().async_write(fd, std::move(data));
+	}
+}
+#endif
+
+#endif // !REACTOR_H
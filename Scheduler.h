@@ -0,0 +1,485 @@
+#include "Executor.h"
+#include "Allocator.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+namespace Promises {
+
+	typedef std::function<void(void)> TASK_TYPE;
+
+	//WorkDeque - Chase-Lev work-stealing deque.
+	//The owning worker pushes and takes at the bottom (LIFO),
+	//any other worker steals from the top (FIFO).
+	//Memory orderings follow Le, Pop, Cohen, Zappa Nardelli,
+	//"Correct and Efficient Work-Stealing for Weak Memory Models" (PPoPP'13).
+	class WorkDeque {
+	public:
+		explicit WorkDeque(size_t capacity = 256)
+			:_top(0),
+			_bottom(0)
+		{
+			size_t cap = 1;
+			while (cap < capacity) {
+				cap <<= 1;
+			}
+
+			_arrays.push_back(std::unique_ptr<Array>(new Array(cap)));
+			_array.store(_arrays.back().get(), std::memory_order_relaxed);
+		}
+
+		~WorkDeque(void) {
+			TASK_TYPE* task = nullptr;
+			while ((task = take()) != nullptr) {
+				pool_delete(task);
+			}
+		}
+
+		//push - owner only.
+		void push(TASK_TYPE* task) {
+			int64_t b = _bottom.load(std::memory_order_relaxed);
+			int64_t t = _top.load(std::memory_order_acquire);
+			Array* a = _array.load(std::memory_order_relaxed);
+
+			if (b - t > (int64_t)a->capacity - 1) {
+				a = _grow(a, t, b);
+			}
+
+			a->put(b, task);
+			_bottom.store(b + 1, std::memory_order_release);
+		}
+
+		//take - owner only, newest task first.
+		TASK_TYPE* take(void) {
+			int64_t b = _bottom.load(std::memory_order_relaxed) - 1;
+			Array* a = _array.load(std::memory_order_relaxed);
+			_bottom.store(b, std::memory_order_relaxed);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t t = _top.load(std::memory_order_relaxed);
+
+			TASK_TYPE* task = nullptr;
+
+			if (t <= b) {
+				task = a->get(b);
+
+				if (t == b) {
+					//last element, race the thieves for it
+					if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+						task = nullptr;
+					}
+					_bottom.store(b + 1, std::memory_order_relaxed);
+				}
+			} else {
+				_bottom.store(b + 1, std::memory_order_relaxed);
+			}
+
+			return task;
+		}
+
+		//steal - any thread, oldest task first.
+		//Returns nullptr when empty or when another thief won the race.
+		TASK_TYPE* steal(void) {
+			int64_t t = _top.load(std::memory_order_acquire);
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+			int64_t b = _bottom.load(std::memory_order_acquire);
+
+			if (t < b) {
+				Array* a = _array.load(std::memory_order_acquire);
+				TASK_TYPE* task = a->get(t);
+
+				if (!_top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed)) {
+					return nullptr;
+				}
+
+				return task;
+			}
+
+			return nullptr;
+		}
+
+		bool empty(void) const {
+			int64_t t = _top.load(std::memory_order_seq_cst);
+			int64_t b = _bottom.load(std::memory_order_seq_cst);
+			return b <= t;
+		}
+
+	private:
+		struct Array {
+			explicit Array(size_t cap)
+				:capacity(cap),
+				mask(cap - 1),
+				slots(new std::atomic<TASK_TYPE*>[cap])
+			{ }
+
+			TASK_TYPE* get(int64_t i) {
+				return slots[i & mask].load(std::memory_order_relaxed);
+			}
+
+			void put(int64_t i, TASK_TYPE* task) {
+				slots[i & mask].store(task, std::memory_order_relaxed);
+			}
+
+			size_t capacity;
+			size_t mask;
+			std::unique_ptr<std::atomic<TASK_TYPE*>[]> slots;
+		};
+
+		std::atomic<int64_t> _top;
+		std::atomic<int64_t> _bottom;
+		std::atomic<Array*> _array;
+
+		//outgrown arrays stay alive until the deque dies,
+		//a thief may still be reading from one of them
+		std::vector<std::unique_ptr<Array>> _arrays;
+
+		Array* _grow(Array* old, int64_t t, int64_t b) {
+			Array* a = new Array(old->capacity * 2);
+
+			for (int64_t i = t; i < b; ++i) {
+				a->put(i, old->get(i));
+			}
+
+			_arrays.push_back(std::unique_ptr<Array>(a));
+			_array.store(a, std::memory_order_release);
+			return a;
+		}
+	};
+
+	//WorkStealingPool - fixed set of workers, each with its own WorkDeque.
+	//Tasks submitted by a worker (e.g. the continuations a resolving promise fans out)
+	//go onto that worker's deque, idle workers steal from the others.
+	//Tasks from outside the pool go through a shared injection queue,
+	//which is the only part bounded by ExecutorConfig::queue_capacity.
+	class WorkStealingPool : public IExecutor {
+	public:
+		explicit WorkStealingPool(const ExecutorConfig &config = ExecutorConfig())
+			:_capacity(config.queue_capacity),
+			_stop(false),
+			_sleepers(0),
+			_epoch(0),
+			_injectedCount(0)
+		{
+			size_t count = config.thread_count();
+
+			for (size_t i = 0; i < count; ++i) {
+				_deques.push_back(std::unique_ptr<WorkDeque>(new WorkDeque()));
+			}
+
+			_workers.reserve(count);
+			for (size_t i = 0; i < count; ++i) {
+				_workers.push_back(std::thread(&WorkStealingPool::_work, this, i));
+			}
+		}
+
+		virtual ~WorkStealingPool(void) {
+			{
+				std::unique_lock<std::mutex> lock(_sleepLock);
+				_stop.store(true);
+				++_epoch;
+			}
+
+			_wakeup.notify_all();
+			_notFull.notify_all();
+
+			for (size_t i = 0; i < _workers.size(); ++i) {
+				if (_workers[i].joinable()) {
+					_workers[i].join();
+				}
+			}
+
+			while (!_injected.empty()) {
+				pool_delete(_injected.front());
+				_injected.pop_front();
+			}
+		}
+
+		virtual void submit(TASK_TYPE task) {
+			PROMISE_METRIC(TasksSubmitted, 1);
+
+			if (current_executor() == this) {
+				_deques[_index()]->push(pool_new<TASK_TYPE>(std::move(task)));
+				_notify();
+				return;
+			}
+
+			std::unique_lock<std::mutex> lock(_injectLock);
+
+			//a pool being torn down runs late submissions on the producer
+			if (_stop.load()) {
+				lock.unlock();
+				run_task(task);
+				return;
+			}
+
+			while (_capacity != 0 && _injected.size() >= _capacity && !_stop.load()) {
+				_notFull.wait(lock);
+			}
+
+			_injected.push_back(pool_new<TASK_TYPE>(std::move(task)));
+			_injectedCount.fetch_add(1, std::memory_order_seq_cst);
+			lock.unlock();
+
+			_notify();
+		}
+
+		virtual bool try_run_pending(void) {
+			if (current_executor() != this) {
+				return false;
+			}
+
+			TASK_TYPE* task = _find(_index());
+			if (task == nullptr) {
+				return false;
+			}
+
+			_run(task);
+			return true;
+		}
+
+		size_t size(void) const {
+			return _workers.size();
+		}
+
+		virtual size_t thread_count(void) const {
+			return _workers.size();
+		}
+
+	private:
+		size_t _capacity;
+		std::atomic<bool> _stop;
+		std::atomic<size_t> _sleepers;
+		uint64_t _epoch;
+		std::mutex _sleepLock;
+		std::condition_variable _wakeup;
+
+		std::mutex _injectLock;
+		std::condition_variable _notFull;
+		std::deque<TASK_TYPE*> _injected;
+		std::atomic<size_t> _injectedCount;
+
+		std::vector<std::unique_ptr<WorkDeque>> _deques;
+		std::vector<std::thread> _workers;
+
+		static size_t& _index(void) {
+			static thread_local size_t index = 0;
+			return index;
+		}
+
+		static uint32_t& _seed(void) {
+			static thread_local uint32_t seed = 2463534242u;
+			return seed;
+		}
+
+		//xorshift32, picks where a thief starts looking
+		static uint32_t _random(void) {
+			uint32_t &x = _seed();
+			x ^= x << 13;
+			x ^= x >> 17;
+			x ^= x << 5;
+			return x;
+		}
+
+		//_notify - wake one sleeper, if there is one.
+		//The fence pairs with the one in _sleep(): either the sleeper's
+		//last scan sees the new task or we see the sleeper.
+		void _notify(void) {
+			std::atomic_thread_fence(std::memory_order_seq_cst);
+
+			if (_sleepers.load(std::memory_order_relaxed) != 0) {
+				{
+					std::unique_lock<std::mutex> lock(_sleepLock);
+					++_epoch;
+				}
+				_wakeup.notify_one();
+			}
+		}
+
+		TASK_TYPE* _pop_injected(void) {
+			//thieves pass by here constantly, don't make them take the lock
+			if (_injectedCount.load(std::memory_order_acquire) == 0) {
+				return nullptr;
+			}
+
+			std::unique_lock<std::mutex> lock(_injectLock);
+
+			if (_injected.empty()) {
+				return nullptr;
+			}
+
+			TASK_TYPE* task = _injected.front();
+			_injected.pop_front();
+			_injectedCount.fetch_sub(1, std::memory_order_relaxed);
+			lock.unlock();
+
+			if (_capacity != 0) {
+				_notFull.notify_one();
+			}
+
+			return task;
+		}
+
+		//_find - own deque, then the injection queue, then steal.
+		TASK_TYPE* _find(size_t self) {
+			TASK_TYPE* task = _deques[self]->take();
+			if (task != nullptr) {
+				return task;
+			}
+
+			task = _pop_injected();
+			if (task != nullptr) {
+				return task;
+			}
+
+			size_t count = _deques.size();
+			size_t start = _random() % count;
+
+			for (size_t i = 0; i < count; ++i) {
+				size_t victim = (start + i) % count;
+
+				if (victim != self) {
+					task = _deques[victim]->steal();
+					if (task != nullptr) {
+						return task;
+					}
+				}
+			}
+
+			return nullptr;
+		}
+
+		bool _idle(void) {
+			for (size_t i = 0; i < _deques.size(); ++i) {
+				if (!_deques[i]->empty()) {
+					return false;
+				}
+			}
+
+			return _injectedCount.load(std::memory_order_seq_cst) == 0;
+		}
+
+		void _run(TASK_TYPE* task) {
+			run_task(*task);
+			pool_delete(task);
+		}
+
+		//_sleep - returns false once the pool is stopped and out of work.
+		bool _sleep(void) {
+			std::unique_lock<std::mutex> lock(_sleepLock);
+			uint64_t epoch = _epoch;
+
+			_sleepers.fetch_add(1, std::memory_order_seq_cst);
+
+			bool idle = _idle();
+			if (idle && _stop.load()) {
+				_sleepers.fetch_sub(1, std::memory_order_relaxed);
+				return false;
+			}
+
+			while (idle && epoch == _epoch) {
+				_wakeup.wait(lock);
+			}
+
+			_sleepers.fetch_sub(1, std::memory_order_relaxed);
+			return true;
+		}
+
+		void _work(size_t self) {
+			PROMISE_METRIC(ThreadsStarted, 1);
+			current_executor() = this;
+			_index() = self;
+			_seed() = (uint32_t)(self * 2654435761u) | 1u;
+
+			for (;;) {
+				TASK_TYPE* task = _find(self);
+
+				if (task != nullptr) {
+					_run(task);
+				} else if (!_sleep()) {
+					break;
+				}
+			}
+
+			current_executor() = nullptr;
+			PROMISE_METRIC(ThreadsExited, 1);
+		}
+	};
+
+	//ExecutorRegistry - owns every executor ever installed as the default.
+	//A replaced executor is retired rather than destroyed,
+	//so promises still holding it can finish their work.
+	class ExecutorRegistry {
+	public:
+		ExecutorRegistry(void)
+			:_current(nullptr)
+		{ }
+
+		IExecutor* get(void) {
+			IExecutor* exec = _current.load(std::memory_order_acquire);
+
+			if (exec == nullptr) {
+				std::unique_lock<std::mutex> lock(_lock);
+				exec = _current.load(std::memory_order_relaxed);
+
+				if (exec == nullptr) {
+					_owned.push_back(std::make_shared<WorkStealingPool>());
+					exec = _owned.back().get();
+					_current.store(exec, std::memory_order_release);
+				}
+			}
+
+			return exec;
+		}
+
+		void set(IEXEC_TYPE exec) {
+			if (exec == nullptr) {
+				throw Promise_Error("set_default_executor(): executor is null");
+			}
+
+			std::unique_lock<std::mutex> lock(_lock);
+			_owned.push_back(exec);
+			_current.store(exec.get(), std::memory_order_release);
+		}
+
+	private:
+		std::atomic<IExecutor*> _current;
+		std::mutex _lock;
+		std::vector<IEXEC_TYPE> _owned;
+	};
+
+	inline ExecutorRegistry& executor_registry(void) {
+		static ExecutorRegistry registry;
+		return registry;
+	}
+
+	//default_executor - where promises dispatch their handlers.
+	//Lazily created as a WorkStealingPool sized to the hardware.
+	inline IExecutor* default_executor(void) {
+		return executor_registry().get();
+	}
+
+	//set_default_executor - install e.g. a differently sized ThreadPool.
+	//Promises created afterwards dispatch to exec.
+	inline void set_default_executor(IEXEC_TYPE exec) {
+		executor_registry().set(exec);
+	}
+
+	//continuation_executor - where continuations go under continuation_policy().
+	inline IExecutor* continuation_executor(void) {
+		if (continuation_policy() == Inline) {
+			return &inline_executor();
+		}
+
+		return default_executor();
+	}
+}
+
+#endif // !SCHEDULER_H
\ No newline at end of file
@@ -1,5 +1,11 @@
 #include "Promise_Error.h"
+#include "Allocator.h"
+#include <exception>
 #include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <utility>
 
 #ifndef STATE_H
 #define STATE_H
@@ -29,25 +35,41 @@ namespace Promises {
 
 		virtual ~State(void) {}
 
-		bool operator == (Status stat) {
+		bool operator == (Status stat) const {
 			return this->_status == stat;
 		}
 
-		bool operator != (Status stat) {
+		bool operator != (Status stat) const {
 			return this->_status != stat;
 		}
 		
-		bool operator == (const State &state) {
+		bool operator == (const State &state) const {
 			return (*this) == state._status;
 		}
 		
-		bool operator != (const State &state) {
+		bool operator != (const State &state) const {
 			return (*this) != state._status;
 		}
 
 		virtual void* get_value(void) = 0;
 		virtual const std::exception& get_reason(void) = 0;
 
+		//rethrow - throw the reason, see RejectedState.
+		virtual void rethrow(void) {
+			throw Promise_Error(get_reason());
+		}
+
+		//get_error - the reason as a std::exception_ptr, e.g. to reject a Core with.
+		virtual std::exception_ptr get_error(void) {
+			try {
+				rethrow();
+			} catch (...) {
+				return std::current_exception();
+			}
+
+			return nullptr;
+		}
+
 	private:
 		Status _status;
 	};
@@ -75,13 +97,10 @@ namespace Promises {
 			return noerr;
 		}
 		
-		bool operator == (const State &state) {
-			return State::operator == (state);
-		}
-		
-		bool operator != (const State &state) {
-			return State::operator != (state);
-		}
+		//the base comparisons, one set of them,
+		//so C++20's reversed candidates are not ambiguous
+		using State::operator ==;
+		using State::operator !=;
 	};
 
 	template <typename T>
@@ -90,11 +109,17 @@ namespace Promises {
 		ResolvedState(void)
 		{ }
 
-		ResolvedState(T v)
+		ResolvedState(const T &v)
 			: State(Resolved),
 			_value(v)
 		{ }
 
+		//moves the value in, move-only types are fine
+		ResolvedState(T &&v)
+			: State(Resolved),
+			_value(std::move(v))
+		{ }
+
 		ResolvedState(const ResolvedState &state)
 			: State(state),
 			_value(state._value)
@@ -112,42 +137,69 @@ namespace Promises {
 			return noerr;
 		}
 		
-		bool operator == (const State &state) {
-			return State::operator == (state);
-		}
-		
-		bool operator != (const State &state) {
-			return State::operator != (state);
-		}
+		using State::operator ==;
+		using State::operator !=;
 
 	private:
 		T _value;
 	};
 
+	//reason_type - what a rejection with an E keeps. Behind a plain
+	//std::exception reference could be anything, so only its message is kept.
+	template <typename E>
+	struct reason_type {
+		typedef E type;
+	};
+
+	template <>
+	struct reason_type<std::exception> {
+		typedef Promise_Error type;
+	};
+
+	//RejectedState - a rejection, kept as the type it was rejected with.
+	//The reason is one pooled object shared by every copy of the state,
+	//and rethrow() throws it as that type, so await() hands back what was
+	//rejected instead of a Promise_Error carrying its message.
 	class RejectedState : public State {
 	public:
 		RejectedState(void)
-			: _reason(noerr)
+			: _throw(nullptr)
 		{ }
 
-		RejectedState(const std::exception &e)
+		template <typename E, typename = typename std::enable_if<std::is_base_of<std::exception, E>::value>::type>
+		RejectedState(const E &e)
 			: State(Rejected),
-			_reason(e)
+			_reason(make_pooled<typename reason_type<E>::type>(e)),
+			_throw(&_throw_as<typename reason_type<E>::type>)
 		{ }
 		
 		RejectedState(const std::string &msg)
 			: State(Rejected),
-			_reason(msg)
+			_reason(make_pooled<Promise_Error>(msg)),
+			_throw(&_throw_as<Promise_Error>)
 		{ }
 		
 		RejectedState(const char* msg)
 			: State(Rejected),
-			_reason(msg)
+			_reason(make_pooled<Promise_Error>(msg)),
+			_throw(&_throw_as<Promise_Error>)
+		{ }
+
+		//an exception caught as it was thrown, of any type, is rethrown as is.
+		//get_reason() only has its message, taken the first time it is asked for.
+		RejectedState(std::exception_ptr e)
+			: State(Rejected),
+			_reason(e ? nullptr : make_pooled<Promise_Error>("unknown exception")),
+			_throw(e ? nullptr : &_throw_as<Promise_Error>),
+			_error(e)
 		{ }
 
+		//the copy takes its own message from _error if it needs one
 		RejectedState(const RejectedState &state)
 			: State(state),
-			_reason(state._reason)
+			_reason(state._error ? nullptr : state._reason),
+			_throw(state._throw),
+			_error(state._error)
 		{ }
 
 		virtual ~RejectedState(void) { }
@@ -157,19 +209,52 @@ namespace Promises {
 		}
 		
 		virtual const std::exception& get_reason(void) {
-			return _reason;
+			if (_error) {
+				std::call_once(_once, [this]() {
+					_reason = _reason_of(_error);
+				});
+			}
+
+			return (_reason != nullptr) ? *_reason : noerr;
 		}
-		
-		bool operator == (const State &state) {
-			return State::operator == (state);
+
+		virtual void rethrow(void) {
+			if (_error) {
+				std::rethrow_exception(_error);
+			} else if (_throw != nullptr) {
+				_throw(*_reason);
+			}
+
+			throw Promise_Error(get_reason());
 		}
-		
-		bool operator != (const State &state) {
-			return State::operator != (state);
+
+		virtual std::exception_ptr get_error(void) {
+			return _error ? _error : State::get_error();
 		}
+		
+		using State::operator ==;
+		using State::operator !=;
 
 	private:
-		Promise_Error _reason;
+		std::shared_ptr<const std::exception> _reason;
+		void (*_throw)(const std::exception&);
+		std::exception_ptr _error;
+		std::once_flag _once;
+
+		template <typename E>
+		static void _throw_as(const std::exception &reason) {
+			throw static_cast<const E&>(reason);
+		}
+
+		static std::shared_ptr<const std::exception> _reason_of(std::exception_ptr e) {
+			try {
+				std::rethrow_exception(e);
+			} catch (const std::exception &ex) {
+				return make_pooled<Promise_Error>(ex);
+			} catch (...) {
+				return make_pooled<Promise_Error>("unknown exception");
+			}
+		}
 	};
 }
 
@@ -0,0 +1,160 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "../Promise.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+
+//CountingResource - forwards to the global allocator and counts calls.
+class CountingResource : public Promises::memory_resource {
+public:
+	CountingResource(void)
+		:allocations(0),
+		deallocations(0)
+	{ }
+
+	std::atomic<size_t> allocations;
+	std::atomic<size_t> deallocations;
+
+protected:
+	virtual void* do_allocate(size_t bytes, size_t) {
+		allocations.fetch_add(1);
+		return ::operator new(bytes);
+	}
+
+	virtual void do_deallocate(void* p, size_t, size_t) {
+		deallocations.fetch_add(1);
+		::operator delete(p);
+	}
+};
+
+static void run_chain(int depth) {
+	std::vector<Promises::PROM_TYPE> links;
+	links.push_back(Promises::Resolve<int>(0));
+
+	for (int i = 0; i < depth; ++i) {
+		links.push_back(links.back()->then([](int value) {
+			return Promises::Resolve<int>(value + 1);
+		}));
+	}
+
+	int* v = Promises::await<int>(links.back());
+	BOOST_CHECK(*v == depth);
+}
+
+BOOST_AUTO_TEST_SUITE(ALLOCATOR_SUITE)
+
+BOOST_AUTO_TEST_CASE(Block_Reuse_Test) {
+	Promises::memory_resource &pool = Promises::block_pool_resource::instance();
+
+	void* p1 = pool.allocate(24);
+	pool.deallocate(p1, 24);
+
+	//same size class, freed on this thread: the block comes straight back
+	void* p2 = pool.allocate(32);
+	BOOST_CHECK(p1 == p2);
+	pool.deallocate(p2, 32);
+
+	//too big for any class, goes upstream
+	void* big = pool.allocate(Promises::block_pool_resource::max_block + 1);
+	BOOST_CHECK(big != nullptr);
+	pool.deallocate(big, Promises::block_pool_resource::max_block + 1);
+}
+
+BOOST_AUTO_TEST_CASE(Cross_Thread_Free_Test) {
+	Promises::memory_resource &pool = Promises::block_pool_resource::instance();
+	std::vector<void*> blocks;
+
+	for (int i = 0; i < 3 * ARENA_SIZE; ++i) {
+		blocks.push_back(pool.allocate(64));
+	}
+
+	//freed by a thread that exits, its cache goes back to the depot
+	std::thread th([&]() {
+		for (size_t i = 0; i < blocks.size(); ++i) {
+			pool.deallocate(blocks[i], 64);
+		}
+	});
+	th.join();
+
+	size_t chunks = Promises::block_pool_resource::instance().chunks();
+	for (int i = 0; i < 3 * ARENA_SIZE; ++i) {
+		blocks[i] = pool.allocate(64);
+	}
+	BOOST_CHECK(Promises::block_pool_resource::instance().chunks() == chunks);
+
+	for (size_t i = 0; i < blocks.size(); ++i) {
+		pool.deallocate(blocks[i], 64);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Steady_State_Test) {
+	//inline continuations keep every allocation and free on this thread.
+	//After one warm-up run a chain must not take more memory from upstream.
+	Promises::set_continuation_policy(Promises::Inline);
+
+	run_chain(200);
+	size_t chunks = Promises::block_pool_resource::instance().chunks();
+
+	for (int i = 0; i < 10; ++i) {
+		run_chain(200);
+	}
+
+	Promises::set_continuation_policy(Promises::Dispatch);
+
+	BOOST_CHECK(Promises::block_pool_resource::instance().chunks() == chunks);
+}
+
+BOOST_AUTO_TEST_CASE(Aligned_Test) {
+	//over-aligned requests come back aligned, from either resource
+	Promises::memory_resource* resources[] = {&Promises::new_delete_resource::instance(), &Promises::block_pool_resource::instance()};
+	size_t alignments[] = {8, 16, 64, 256, 4096};
+
+	for (size_t r = 0; r < 2; ++r) {
+		for (size_t a = 0; a < 5; ++a) {
+			void* p = resources[r]->allocate(100, alignments[a]);
+			BOOST_CHECK(reinterpret_cast<uintptr_t>(p) % alignments[a] == 0);
+
+			memset(p, 0xab, 100);
+			resources[r]->deallocate(p, 100, alignments[a]);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Custom_Resource_Test) {
+	CountingResource arena;
+
+	Promises::set_memory_resource(&arena);
+	BOOST_CHECK(Promises::get_memory_resource() == &arena);
+
+	run_chain(10);
+
+	Promises::set_memory_resource(nullptr);
+	BOOST_CHECK(Promises::get_memory_resource() == &Promises::block_pool_resource::instance());
+
+	//a worker may still be letting go of the last links,
+	//the arena has to outlive them
+	for (int i = 0; i < 10000 && arena.allocations.load() != arena.deallocations.load(); ++i) {
+		std::this_thread::sleep_for(std::chrono::microseconds(100));
+	}
+
+	BOOST_CHECK(arena.allocations.load() > 0);
+	BOOST_CHECK(arena.allocations.load() == arena.deallocations.load());
+}
+
+BOOST_AUTO_TEST_CASE(PoolAllocator_Test) {
+	CountingResource arena;
+	Promises::PoolAllocator<int> alloc(&arena);
+	Promises::PoolAllocator<double> other(alloc);
+
+	BOOST_CHECK(alloc == other);
+	BOOST_CHECK(alloc != Promises::PoolAllocator<int>());
+
+	std::vector<int, Promises::PoolAllocator<int>> values(alloc);
+	values.push_back(1);
+	BOOST_CHECK(arena.allocations.load() == 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
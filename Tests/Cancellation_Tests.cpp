@@ -0,0 +1,202 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "../Promise.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(CANCELLATION_SUITE)
+
+static Promises::PROM_TYPE pending(void) {
+	return Promises::make_pooled<Promises::Promise>(Promises::pending_state);
+}
+
+BOOST_AUTO_TEST_CASE(CancelSource_Test) {
+	Promises::CancelToken never;
+	BOOST_CHECK(!never.cancelled());
+	BOOST_CHECK_NO_THROW(never.throw_if_cancelled());
+
+	Promises::CancelSource source;
+	Promises::CancelToken token = source.token();
+	BOOST_CHECK(!token.cancelled());
+
+	//a fired link marks itself through prev, which cancel() has just cleared
+	Promises::CancelLink kept([](Promises::CancelLink* self) {
+		self->prev = self;
+	});
+	Promises::CancelLink dropped([](Promises::CancelLink* self) {
+		self->prev = self;
+	});
+
+	BOOST_CHECK(token.state()->attach(&kept));
+	BOOST_CHECK(token.state()->attach(&dropped));
+	token.state()->detach(&dropped);
+
+	source.cancel();
+	source.cancel();
+
+	//only the link still attached fired, and only once
+	BOOST_CHECK(kept.prev == &kept);
+	BOOST_CHECK(dropped.prev == nullptr);
+
+	BOOST_CHECK(source.cancelled());
+	BOOST_CHECK(token.cancelled());
+	BOOST_CHECK_THROW(token.throw_if_cancelled(), Promises::Cancelled);
+
+	//too late to attach
+	Promises::CancelLink late([](Promises::CancelLink*) { });
+	BOOST_CHECK(!token.state()->attach(&late));
+}
+
+BOOST_AUTO_TEST_CASE(Cancel_Before_Settle_Test) {
+	Promises::CancelSource source;
+	std::atomic<bool> ran(false);
+	std::shared_ptr<int> captured = std::make_shared<int>(1);
+
+	Promises::PROM_TYPE root = pending();
+	Promises::PROM_TYPE next = root->then([&ran, captured](int value) {
+		ran = true;
+		return Promises::Resolve<int>(value + *captured);
+	}, source.token());
+
+	BOOST_CHECK(captured.use_count() == 2);
+	source.cancel();
+
+	//the handler is let go of right away, not when root settles
+	BOOST_CHECK(captured.use_count() == 1);
+	BOOST_CHECK_THROW(Promises::await<int>(next), Promises::Cancelled);
+
+	Promises::Settlement(root.get()).resolve<int>(1);
+	BOOST_CHECK(*Promises::await<int>(root) == 1);
+	BOOST_CHECK(!ran);
+}
+
+BOOST_AUTO_TEST_CASE(Already_Cancelled_Test) {
+	Promises::CancelSource source;
+	source.cancel();
+
+	std::atomic<bool> ran(false);
+	Promises::PROM_TYPE root = Promises::Resolve<int>(1);
+
+	Promises::PROM_TYPE next = root->then([&ran](int value) {
+		ran = true;
+		return Promises::Resolve<int>(value);
+	}, source.token());
+
+	Promises::PROM_TYPE caught = root->_catch([&ran](const std::exception &) {
+		ran = true;
+	}, source.token());
+
+	Promises::PROM_TYPE started = promise(source.token(), [&ran](Promises::Settlement settle) {
+		ran = true;
+		settle.resolve<int>(1);
+	});
+
+	BOOST_CHECK_THROW(Promises::await<int>(next), Promises::Cancelled);
+	BOOST_CHECK_THROW(Promises::await<int>(caught), Promises::Cancelled);
+	BOOST_CHECK_THROW(Promises::await<int>(started), Promises::Cancelled);
+	BOOST_CHECK(!ran);
+}
+
+BOOST_AUTO_TEST_CASE(Cancel_Propagates_Test) {
+	Promises::CancelSource source;
+	Promises::PROM_TYPE root = pending();
+
+	Promises::PROM_TYPE first = root->then([](int value) {
+		return Promises::Resolve<int>(value + 1);
+	}, source.token());
+
+	//no token of their own, they see the Cancelled rejection
+	Promises::PROM_TYPE second = first->then([](int value) {
+		return Promises::Resolve<int>(value + 1);
+	});
+
+	std::atomic<bool> cancelled(false);
+	Promises::PROM_TYPE caught = second->_catch([&cancelled](const std::exception &ex) {
+		cancelled = dynamic_cast<const Promises::Cancelled*>(&ex) != nullptr;
+		return Promises::Resolve<int>(0);
+	});
+
+	source.cancel();
+
+	BOOST_CHECK(*Promises::await<int>(caught) == 0);
+	BOOST_CHECK(cancelled);
+
+	Promises::Settlement(root.get()).resolve<int>(1);
+}
+
+BOOST_AUTO_TEST_CASE(Cancel_Running_Handler_Test) {
+	Promises::CancelSource source;
+	Promises::CancelToken token = source.token();
+	std::atomic<bool> started(false);
+
+	//a handler that has started finishes, polling its token to stop early
+	Promises::PROM_TYPE prom = promise(token, [token, &started](Promises::Settlement settle) {
+		started = true;
+
+		while (!token.cancelled()) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		settle.resolve<int>(7);
+	});
+
+	while (!started) {
+		std::this_thread::yield();
+	}
+	source.cancel();
+
+	BOOST_CHECK(*Promises::await<int>(prom) == 7);
+}
+
+BOOST_AUTO_TEST_CASE(Cancel_After_Settle_Test) {
+	Promises::CancelSource source;
+	Promises::PROM_TYPE root = Promises::Resolve<int>(1);
+
+	Promises::PROM_TYPE next = root->then([](int value) {
+		return Promises::Resolve<int>(value + 1);
+	}, source.token());
+
+	BOOST_CHECK(*Promises::await<int>(next) == 2);
+
+	//nothing left to cancel
+	source.cancel();
+	BOOST_CHECK(*Promises::await<int>(next) == 2);
+}
+
+BOOST_AUTO_TEST_CASE(Cancel_Race_Test) {
+	//cancel and settle at once: every continuation either ran or was
+	//cancelled, never both, and nothing is left pending
+	for (int round = 0; round < 200; ++round) {
+		Promises::CancelSource source;
+		std::atomic<int> ran(0);
+		Promises::PROM_TYPE root = pending();
+
+		std::vector<Promises::PROM_TYPE> links;
+		for (int i = 0; i < 8; ++i) {
+			links.push_back(root->then([&ran](int value) {
+				ran.fetch_add(1);
+				return Promises::Resolve<int>(value);
+			}, source.token()));
+		}
+
+		std::thread canceller([&source]() {
+			source.cancel();
+		});
+
+		Promises::Settlement(root.get()).resolve<int>(1);
+		canceller.join();
+
+		int resolved = 0;
+		for (size_t i = 0; i < links.size(); ++i) {
+			try {
+				resolved += *Promises::await<int>(links[i]);
+			} catch (const Promises::Cancelled &ex) { }
+		}
+
+		BOOST_CHECK(resolved == ran.load());
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
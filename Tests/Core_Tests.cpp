@@ -0,0 +1,232 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "../Core.h"
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+BOOST_AUTO_TEST_SUITE(CORE_SUITE)
+
+BOOST_AUTO_TEST_CASE(Resolve_Test) {
+	Promises::CorePtr<int> core = Promises::make_core<int>();
+	BOOST_CHECK(core->status() == Promises::Pending);
+
+	BOOST_CHECK(core->resolve(7));
+	BOOST_CHECK(core->status() == Promises::Resolved);
+	BOOST_CHECK(core->value() == 7);
+
+	//only the first settlement counts
+	BOOST_CHECK(!core->resolve(8));
+	BOOST_CHECK(!core->reject(std::make_exception_ptr(Promises::Promise_Error("late"))));
+	BOOST_CHECK(core->value() == 7);
+}
+
+BOOST_AUTO_TEST_CASE(Continuation_Test) {
+	Promises::CorePtr<int> root = Promises::make_core<int>();
+	Promises::CorePtr<std::string> link = Promises::continue_with<std::string>(root.get(), [](Promises::CoreBase* parent, Promises::Core<std::string>* self) {
+		self->resolve(std::to_string(static_cast<Promises::Core<int>*>(parent)->value() * 2));
+	});
+
+	root->resolve(21);
+	link->wait();
+
+	BOOST_CHECK(link->status() == Promises::Resolved);
+	BOOST_CHECK(link->value() == "42");
+}
+
+BOOST_AUTO_TEST_CASE(Rejection_Test) {
+	Promises::CorePtr<int> root = Promises::make_core<int>();
+	Promises::CorePtr<int> link = Promises::continue_with<int>(root.get(), [](Promises::CoreBase*, Promises::Core<int>*) {
+		throw Promises::Promise_Error("handler failed");
+	});
+
+	root->resolve(1);
+	link->wait();
+
+	BOOST_CHECK(link->status() == Promises::Rejected);
+
+	try {
+		std::rethrow_exception(link->error());
+		BOOST_FAIL("expected a rejection");
+	} catch (const Promises::Promise_Error &err) {
+		BOOST_CHECK(std::string(err.what()) == "handler failed");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Chain_Test) {
+	const int depth = 500;
+	Promises::CorePtr<int> root = Promises::make_core<int>();
+	Promises::CorePtr<int> tail = root;
+
+	for (int i = 0; i < depth; ++i) {
+		tail = Promises::continue_with<int>(tail.get(), [](Promises::CoreBase* parent, Promises::Core<int>* self) {
+			self->resolve(static_cast<Promises::Core<int>*>(parent)->value() + 1);
+		});
+	}
+
+	root->resolve(0);
+	tail->wait();
+
+	BOOST_CHECK(tail->value() == depth);
+}
+
+BOOST_AUTO_TEST_CASE(Single_Allocation_Test) {
+	class Counting : public Promises::memory_resource {
+	public:
+		Counting(void)
+			:allocations(0),
+			deallocations(0)
+		{ }
+
+		std::atomic<size_t> allocations;
+		std::atomic<size_t> deallocations;
+
+	protected:
+		virtual void* do_allocate(size_t bytes, size_t) {
+			allocations.fetch_add(1);
+			return ::operator new(bytes);
+		}
+
+		virtual void do_deallocate(void* p, size_t, size_t) {
+			deallocations.fetch_add(1);
+			::operator delete(p);
+		}
+	};
+
+	Counting resource;
+	std::atomic<size_t> &allocations = resource.allocations;
+	Promises::set_memory_resource(&resource);
+
+	{
+		Promises::CorePtr<int> root = Promises::make_core<int>();
+		BOOST_CHECK(allocations.load() == 1);
+
+		//node, value, handler and list link in one block
+		Promises::CorePtr<int> link = Promises::continue_with<int>(root.get(), [](Promises::CoreBase* parent, Promises::Core<int>* self) {
+			self->resolve(static_cast<Promises::Core<int>*>(parent)->value());
+		});
+		BOOST_CHECK(allocations.load() == 2);
+
+		root->resolve(3);
+		link->wait();
+		BOOST_CHECK(link->value() == 3);
+	}
+
+	//the handler task drops its reference on the root after settling the link
+	while (resource.deallocations.load() != 2) {
+		std::this_thread::yield();
+	}
+
+	Promises::set_memory_resource(nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(Abandoned_Test) {
+	Promises::Core<int>* raw = nullptr;
+	Promises::CorePtr<int> link;
+
+	{
+		Promises::CorePtr<int> root = Promises::make_core<int>();
+		link = Promises::continue_with<int>(root.get(), [](Promises::CoreBase* parent, Promises::Core<int>* self) {
+			if (parent->status() == Promises::Rejected) {
+				self->reject(parent->error());
+			}
+		});
+		raw = root.get();
+	}
+
+	//the root went away unsettled, its continuation is rejected
+	link->wait();
+	BOOST_CHECK(link->status() == Promises::Rejected);
+	BOOST_CHECK(raw != nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(Consume_Test) {
+	Promises::CorePtr<int> root = Promises::make_core<int>();
+	root->resolve(1);
+
+	std::atomic<int> shared(-1);
+	std::atomic<int> sole(-1);
+
+	//root is still held, the value cannot be moved out
+	Promises::CorePtr<int> reader = Promises::continue_with<int>(root.get(), [&shared](Promises::CoreBase*, Promises::Core<int>* self, bool s) {
+		shared = s;
+		self->resolve(1);
+	});
+	reader->wait();
+
+	//the last handle goes to the link
+	Promises::CorePtr<int> taker = Promises::continue_with<int>(root.detach(), [&sole](Promises::CoreBase*, Promises::Core<int>* self, bool s) {
+		sole = s;
+		self->resolve(1);
+	}, true);
+	taker->wait();
+
+	BOOST_CHECK(shared == 0);
+	BOOST_CHECK(sole == 1);
+
+	//a consumed root nobody else can settle is abandoned
+	Promises::CorePtr<int> link;
+	{
+		Promises::CorePtr<int> pending = Promises::make_core<int>();
+		Promises::CorePtr<int> other(pending);
+
+		link = Promises::continue_with<int>(pending.detach(), [](Promises::CoreBase* parent, Promises::Core<int>* self) {
+			if (parent->status() == Promises::Rejected) {
+				self->reject(parent->error());
+			}
+		}, true);
+	}
+
+	link->wait();
+	BOOST_CHECK(link->status() == Promises::Rejected);
+}
+
+BOOST_AUTO_TEST_CASE(Promise_Bridge_Test) {
+	Promises::CorePtr<int> core = Promises::make_core<int>();
+	Promises::PROM_TYPE prom = Promises::to_promise(core)->then([](int value) {
+		return Promises::Resolve<int>(value + 1);
+	});
+
+	core->resolve(41);
+
+	int* v = Promises::await<int>(prom);
+	BOOST_CHECK(*v == 42);
+
+	Promises::CorePtr<int> back = Promises::from_promise<int>(Promises::Resolve<int>(9));
+	back->wait();
+	BOOST_CHECK(back->value() == 9);
+
+	Promises::CorePtr<int> failed = Promises::from_promise<int>(Promises::Reject(Promises::Promise_Error("no")));
+	failed->wait();
+	BOOST_CHECK(failed->status() == Promises::Rejected);
+}
+
+//Copied - counts the copies made of it.
+struct Copied {
+	Copied(void) { }
+	Copied(const Copied &) { ++copies; }
+	Copied(Copied &&) { }
+
+	static std::atomic<int> copies;
+};
+std::atomic<int> Copied::copies(0);
+
+BOOST_AUTO_TEST_CASE(Move_Only_Bridge_Test) {
+	//the bridge is the core's only reader, so the value is moved across
+	Promises::CorePtr<std::unique_ptr<int>> core = Promises::make_core<std::unique_ptr<int>>();
+	core->resolve(std::unique_ptr<int>(new int(7)));
+
+	Promises::PROM_TYPE prom = Promises::to_promise(std::move(core));
+	std::unique_ptr<int>* v = Promises::await<std::unique_ptr<int>>(prom);
+	BOOST_CHECK(**v == 7);
+
+	//from_promise copies the value out of a shared resolved state once
+	Promises::PROM_TYPE source = Promises::Resolve<Copied>(Copied());
+	Promises::CorePtr<Copied> back = Promises::from_promise<Copied>(source);
+	back->wait();
+	BOOST_CHECK(back->status() == Promises::Resolved);
+	BOOST_CHECK(Copied::copies.load() == 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
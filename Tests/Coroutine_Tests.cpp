@@ -0,0 +1,117 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "../Coroutine.h"
+#include <atomic>
+#include <memory>
+#include <vector>
+
+//only built into the suite when compiled as C++20
+#ifdef PROMISE_HAS_COROUTINES
+
+static Promises::PROM_TYPE add_one(Promises::PROM_TYPE prom) {
+	int value = co_await Promises::awaitable<int>(prom);
+	co_return value + 1;
+}
+
+static Promises::Typed::Promise<int> twice(Promises::Typed::Promise<int> prom) {
+	int value = co_await prom;
+	co_return value * 2;
+}
+
+static Promises::Typed::Promise<void> wait_for(Promises::Typed::Promise<int> prom, std::atomic<int> &sum) {
+	sum += co_await prom;
+}
+
+//exec is taken by reference: a copy in the frame could be the last one,
+//and a pool cannot be destroyed from its own thread
+static Promises::Typed::Promise<Promises::IExecutor*> resume_on(Promises::Typed::Promise<int> prom, const Promises::IEXEC_TYPE &exec) {
+	co_await Promises::Typed::awaitable(prom, exec);
+	co_return Promises::current_executor();
+}
+
+static Promises::Typed::Promise<int> unbox(Promises::Typed::Promise<std::unique_ptr<int>> prom) {
+	std::unique_ptr<int> box = co_await std::move(prom);
+	co_return *box;
+}
+
+static Promises::PROM_TYPE rethrow(Promises::PROM_TYPE prom) {
+	co_await prom;
+	co_return 0;
+}
+
+BOOST_AUTO_TEST_SUITE(COROUTINE_SUITE)
+
+BOOST_AUTO_TEST_CASE(Promise_Coroutine_Test) {
+	Promises::PROM_TYPE root = promise([](Promises::Settlement settle) {
+		settle.resolve<int>(1);
+	});
+
+	Promises::PROM_TYPE prom = add_one(add_one(root));
+	BOOST_CHECK(*Promises::await<int>(prom) == 3);
+}
+
+BOOST_AUTO_TEST_CASE(Typed_Coroutine_Test) {
+	Promises::Typed::Promise<int> prom = twice(twice(Promises::Typed::Resolve(5)));
+	BOOST_CHECK(*Promises::Typed::await(prom) == 20);
+
+	Promises::Typed::Promise<int> boxed = unbox(Promises::Typed::Resolve(std::unique_ptr<int>(new int(7))));
+	BOOST_CHECK(*Promises::Typed::await(boxed) == 7);
+}
+
+BOOST_AUTO_TEST_CASE(Coroutine_Reject_Test) {
+	Promises::PROM_TYPE prom = rethrow(Promises::Reject(Promises::Promise_Error("no")));
+	BOOST_CHECK_THROW(Promises::await<int>(prom), Promises::Promise_Error);
+
+	Promises::Typed::Promise<int> typed = twice(Promises::Typed::Reject<int>(std::logic_error("bad")));
+	BOOST_CHECK_THROW(Promises::Typed::await(typed), std::logic_error);
+}
+
+BOOST_AUTO_TEST_CASE(Suspended_Many_Test) {
+	//a thousand suspended coroutines, none of them holds a thread
+	Promises::CorePtr<int> root = Promises::make_core<int>();
+	Promises::Typed::Promise<int> prom(root);
+	std::atomic<int> sum(0);
+
+	std::vector<Promises::Typed::Promise<void>> waiting;
+	for (int i = 0; i < 1000; ++i) {
+		waiting.push_back(wait_for(prom, sum));
+	}
+
+	BOOST_CHECK(sum == 0);
+	root->resolve(1);
+
+	for (size_t i = 0; i < waiting.size(); ++i) {
+		Promises::Typed::await(waiting[i]);
+	}
+
+	BOOST_CHECK(sum == 1000);
+}
+
+BOOST_AUTO_TEST_CASE(Resume_On_Test) {
+	Promises::IEXEC_TYPE exec = std::make_shared<Promises::ThreadPool>(Promises::ExecutorConfig(1));
+	Promises::CorePtr<int> root = Promises::make_core<int>();
+
+	Promises::Typed::Promise<Promises::IExecutor*> prom = resume_on(Promises::Typed::Promise<int>(root), exec);
+	root->resolve(1);
+
+	BOOST_CHECK(*Promises::Typed::await(prom) == exec.get());
+}
+
+BOOST_AUTO_TEST_CASE(Chain_End_Test) {
+	//awaiting a pending chain whose last handler returns nothing
+	Promises::PROM_TYPE root = Promises::make_pooled<Promises::Promise>(Promises::pending_state);
+	std::atomic<int> seen(0);
+
+	Promises::PROM_TYPE prom = rethrow(root->then([&seen](int value) {
+		seen = value;
+	}));
+	BOOST_CHECK(*prom->get_state() == Promises::Pending);
+
+	Promises::Settlement(root.get()).resolve<int>(4);
+	BOOST_CHECK(*Promises::await<int>(prom) == 0);
+	BOOST_CHECK(seen == 4);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+#endif
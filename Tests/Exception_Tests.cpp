@@ -59,4 +59,14 @@ BOOST_AUTO_TEST_CASE(Throw_Test) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(Shared_Message_Test) {
+    Promises::Promise_Error err("a message long enough not to fit in a short string");
+    Promises::Promise_Error copy(err);
+    Promises::Promise_Error wrapped(static_cast<const std::exception&>(err));
+
+    //copies point at the same message
+    BOOST_CHECK(copy.what() == err.what());
+    BOOST_CHECK(wrapped.what() == err.what());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
@@ -0,0 +1,144 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "../Executor.h"
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+BOOST_AUTO_TEST_SUITE(EXECUTOR_SUITE)
+
+BOOST_AUTO_TEST_CASE(Config_Test) {
+	Promises::ExecutorConfig defaults;
+	Promises::ExecutorConfig sized(3, 16);
+
+	BOOST_CHECK(defaults.thread_count() > 0);
+	BOOST_CHECK(defaults.queue_capacity == 0);
+	BOOST_CHECK(sized.thread_count() == 3);
+	BOOST_CHECK(sized.queue_capacity == 16);
+}
+
+BOOST_AUTO_TEST_CASE(ThreadPool_Submit_Test) {
+	std::atomic<int> count(0);
+
+	{
+		Promises::ThreadPool pool(Promises::ExecutorConfig(4));
+		BOOST_CHECK(pool.size() == 4);
+
+		for (int i = 0; i < 1000; ++i) {
+			pool.submit([&count]() {
+				count.fetch_add(1);
+			});
+		}
+
+		//pool destructor drains the queue
+	}
+
+	BOOST_CHECK(count.load() == 1000);
+}
+
+BOOST_AUTO_TEST_CASE(ThreadPool_Bounded_Queue_Test) {
+	std::atomic<int> count(0);
+
+	{
+		Promises::ThreadPool pool(Promises::ExecutorConfig(2, 4));
+
+		//workers resubmit while the queue is full,
+		//which must run inline instead of deadlocking
+		for (int i = 0; i < 100; ++i) {
+			pool.submit([&count, &pool]() {
+				pool.submit([&count]() {
+					count.fetch_add(1);
+				});
+				count.fetch_add(1);
+			});
+		}
+	}
+
+	BOOST_CHECK(count.load() == 200);
+}
+
+BOOST_AUTO_TEST_CASE(ThreadPool_Exception_Test) {
+	std::atomic<int> count(0);
+
+	{
+		Promises::ThreadPool pool(Promises::ExecutorConfig(1));
+
+		pool.submit([]() {
+			throw std::logic_error("test");
+		});
+
+		pool.submit([&count]() {
+			count.fetch_add(1);
+		});
+	}
+
+	//the worker survives a throwing task
+	BOOST_CHECK(count.load() == 1);
+}
+
+static std::atomic<int> task_errors(0);
+
+static void count_task_error(std::exception_ptr error) {
+	try {
+		std::rethrow_exception(error);
+	} catch (const std::logic_error &ex) {
+		task_errors.fetch_add(1);
+	} catch (...) {
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Task_Error_Handler_Test) {
+	Promises::set_task_error_handler(&count_task_error);
+
+	{
+		Promises::ThreadPool pool(Promises::ExecutorConfig(1));
+
+		pool.submit([]() {
+			throw std::logic_error("test");
+		});
+	}
+
+	Promises::set_task_error_handler(nullptr);
+	BOOST_CHECK(task_errors.load() == 1);
+}
+
+BOOST_AUTO_TEST_CASE(Try_Run_Pending_Test) {
+	std::atomic<int> count(0);
+	Promises::ThreadPerTaskExecutor exec;
+
+	exec.submit([&count]() {
+		count.fetch_add(1);
+	});
+
+	BOOST_CHECK(!exec.try_run_pending());
+	BOOST_CHECK(Promises::current_executor() == nullptr);
+	BOOST_CHECK(!Promises::help_pending());
+}
+
+BOOST_AUTO_TEST_CASE(InlineExecutor_Test) {
+	Promises::InlineExecutor exec(2);
+	std::vector<int> order;
+
+	BOOST_CHECK(exec.max_depth() == 2);
+
+	exec.submit([&]() {
+		order.push_back(1);
+		exec.submit([&]() {
+			order.push_back(2);
+			//past the depth guard, queued until the outer task returns
+			exec.submit([&]() {
+				order.push_back(4);
+			});
+			order.push_back(3);
+		});
+	});
+
+	BOOST_CHECK(order.size() == 4);
+	for (size_t i = 0; i < order.size(); ++i) {
+		BOOST_CHECK(order[i] == (int)i + 1);
+	}
+
+	BOOST_CHECK(!exec.try_run_pending());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
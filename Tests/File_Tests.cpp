@@ -0,0 +1,223 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "../File.h"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+BOOST_AUTO_TEST_SUITE(FILE_SUITE)
+
+//Scratch - a temporary file holding data, removed at the end of the test.
+struct Scratch {
+	explicit Scratch(const std::string &data) {
+		char name[] = "/tmp/file_test_XXXXXX";
+		fd = mkstemp(name);
+		path = name;
+
+		size_t done = 0;
+		while (done < data.size()) {
+			ssize_t n = write(fd, data.data() + done, data.size() - done);
+			if (n <= 0) {
+				break;
+			}
+			done += (size_t)n;
+		}
+	}
+
+	~Scratch(void) {
+		close(fd);
+		unlink(path.c_str());
+	}
+
+	int fd;
+	std::string path;
+};
+
+static std::string pattern(size_t size) {
+	std::string data(size, '\0');
+	for (size_t i = 0; i < size; ++i) {
+		data[i] = (char)('a' + (i * 7 + i / 4096) % 26);
+	}
+	return data;
+}
+
+//backends - the pool, and a ring where this kernel has one
+static std::vector<std::shared_ptr<Promises::fs::IBackend>> backends(void) {
+	std::vector<std::shared_ptr<Promises::fs::IBackend>> all;
+	all.push_back(std::make_shared<Promises::fs::PoolBackend>(2, 16));
+
+#ifdef PROMISE_HAS_URING
+	std::unique_ptr<Promises::fs::UringBackend> ring = Promises::fs::UringBackend::open(8);
+	if (ring != nullptr) {
+		all.push_back(std::shared_ptr<Promises::fs::IBackend>(std::move(ring)));
+	}
+#endif
+
+	return all;
+}
+
+BOOST_AUTO_TEST_CASE(Read_File_Test) {
+	std::string data = pattern(10000);
+	Scratch file(data);
+
+	for (auto &fs : backends()) {
+		Promises::PROM_TYPE whole = fs->read_file(file.path);
+		Promises::fs::Buffer* read = Promises::await<Promises::fs::Buffer>(whole);
+		BOOST_CHECK(read->size() == data.size());
+		BOOST_CHECK(read->str() == data);
+
+		BOOST_CHECK_THROW(Promises::await<Promises::fs::Buffer>(fs->read_file("/nonexistent/file")), std::system_error);
+	}
+
+	//the default backend, and an empty file
+	Scratch empty("");
+	BOOST_CHECK(Promises::await<Promises::fs::Buffer>(Promises::fs::read_file(empty.path))->empty());
+	BOOST_CHECK(Promises::await<Promises::fs::Buffer>(Promises::fs::read_file(file.path))->str() == data);
+}
+
+BOOST_AUTO_TEST_CASE(Read_At_Test) {
+	std::string data = pattern(5000);
+	Scratch file(data);
+
+	for (auto &fs : backends()) {
+		BOOST_CHECK(Promises::await<Promises::fs::Buffer>(fs->read_at(file.fd, 100, 50))->str() == data.substr(100, 50));
+
+		//short only at end of file
+		BOOST_CHECK(Promises::await<Promises::fs::Buffer>(fs->read_at(file.fd, 4990, 100))->str() == data.substr(4990));
+		BOOST_CHECK(Promises::await<Promises::fs::Buffer>(fs->read_at(file.fd, 6000, 100))->empty());
+
+		try {
+			Promises::await<Promises::fs::Buffer>(fs->read_at(-1, 0, 10));
+			BOOST_CHECK(false);
+		} catch (const std::system_error &ex) {
+			BOOST_CHECK(ex.code().value() == EBADF);
+		}
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Large_Read_Test) {
+	//past one registered buffer, so the ring reads into the heap
+	std::string data = pattern(3 * FS_FIXED_SIZE + 123);
+	Scratch file(data);
+
+	for (auto &fs : backends()) {
+		BOOST_CHECK(Promises::await<Promises::fs::Buffer>(fs->read_file(file.path))->str() == data);
+		BOOST_CHECK(Promises::await<Promises::fs::Buffer>(fs->read_at(file.fd, 1, data.size()))->str() == data.substr(1));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Write_At_Test) {
+	Scratch file("");
+
+	for (auto &fs : backends()) {
+		BOOST_REQUIRE(ftruncate(file.fd, 0) == 0);
+		BOOST_CHECK(*Promises::await<size_t>(fs->write_at(file.fd, 0, Promises::fs::Buffer(std::string("hello world")))) == 11);
+		BOOST_CHECK(*Promises::await<size_t>(fs->write_at(file.fd, 6, Promises::fs::Buffer(std::string("there")))) == 5);
+		BOOST_CHECK(Promises::await<Promises::fs::Buffer>(fs->read_at(file.fd, 0, 64))->str() == "hello there");
+
+		//a buffer read in is written back out as it is
+		Promises::fs::Buffer read = *Promises::await<Promises::fs::Buffer>(fs->read_at(file.fd, 0, 5));
+		BOOST_CHECK(*Promises::await<size_t>(fs->write_at(file.fd, 20, read)) == 5);
+		BOOST_CHECK(Promises::await<Promises::fs::Buffer>(fs->read_at(file.fd, 20, 64))->str() == "hello");
+
+		BOOST_CHECK_THROW(Promises::await<size_t>(fs->write_at(-1, 0, Promises::fs::Buffer(std::string("x")))), std::system_error);
+	}
+
+	std::string big = pattern(2 * FS_FIXED_SIZE);
+	BOOST_CHECK(*Promises::await<size_t>(Promises::fs::write_at(file.fd, 0, big)) == big.size());
+	BOOST_CHECK(Promises::await<Promises::fs::Buffer>(Promises::fs::read_at(file.fd, 0, big.size()))->str() == big);
+}
+
+BOOST_AUTO_TEST_CASE(Many_Reads_Test) {
+	//more reads than the ring has entries or registered buffers
+	std::string data = pattern(64 * 1024);
+	Scratch file(data);
+
+	for (auto &fs : backends()) {
+		std::vector<Promises::PROM_TYPE> reads;
+		std::vector<Promises::fs::Buffer> kept;
+
+		for (size_t i = 0; i < 200; ++i) {
+			reads.push_back(fs->read_at(file.fd, i * 300, 1000));
+		}
+
+		for (size_t i = 0; i < reads.size(); ++i) {
+			Promises::fs::Buffer* read = Promises::await<Promises::fs::Buffer>(reads[i]);
+			BOOST_CHECK(read->str() == data.substr(i * 300, 1000));
+
+			//held buffers do not run the slots dry
+			if (i < FS_FIXED_BUFFERS) {
+				kept.push_back(*read);
+			}
+		}
+
+		Promises::PROM_TYPE chained = fs->read_at(file.fd, 0, 4)->then([](const Promises::fs::Buffer &bytes) {
+			return Promises::Resolve<std::string>(bytes.str());
+		});
+		BOOST_CHECK(*Promises::await<std::string>(chained) == data.substr(0, 4));
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Fallback_Test) {
+	std::string data = pattern(100);
+	Scratch file(data);
+
+#ifdef PROMISE_HAS_URING
+	//a kernel without an opcode the ring needs, as 5.1-5.5 lack plain READ/WRITE;
+	//no kernel has opcode 255
+	std::unique_ptr<Promises::fs::UringBackend> ring = Promises::fs::UringBackend::open(8, std::vector<uint8_t>(1, 255));
+	BOOST_CHECK(ring == nullptr);
+
+	std::unique_ptr<Promises::fs::IBackend> fs = Promises::fs::or_pool(std::move(ring));
+#else
+	std::unique_ptr<Promises::fs::IBackend> fs = Promises::fs::or_pool(nullptr);
+#endif
+
+	BOOST_REQUIRE(dynamic_cast<Promises::fs::PoolBackend*>(fs.get()) != nullptr);
+	BOOST_CHECK(Promises::await<Promises::fs::Buffer>(fs->read_at(file.fd, 10, 20))->str() == data.substr(10, 20));
+	BOOST_CHECK(*Promises::await<std::string>(fs->read_file(file.path)->then([](const Promises::fs::Buffer &bytes) {
+		return Promises::Resolve<std::string>(bytes.str());
+	})) == data);
+}
+
+#ifdef PROMISE_HAS_URING
+BOOST_AUTO_TEST_CASE(Full_Ring_Test) {
+	//a two entry ring kept full from several threads at once;
+	//nothing queued may be left behind in the submission queue
+	std::unique_ptr<Promises::fs::UringBackend> ring = Promises::fs::UringBackend::open(2);
+	if (ring == nullptr) {
+		return;
+	}
+
+	std::string data = pattern(64 * 1024);
+	Scratch file(data);
+
+	std::vector<Promises::PROM_TYPE> reads(4 * 250);
+	std::vector<std::thread> threads;
+
+	for (size_t t = 0; t < 4; ++t) {
+		threads.push_back(std::thread([&ring, &reads, &file, t]() {
+			for (size_t i = t * 250; i < (t + 1) * 250; ++i) {
+				reads[i] = ring->read_at(file.fd, (i * 61) % (60 * 1024), 512);
+			}
+		}));
+	}
+	for (auto &thread : threads) {
+		thread.join();
+	}
+
+	std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+	for (size_t i = 0; i < reads.size(); ++i) {
+		Promises::fs::Buffer* read = Promises::await_until<Promises::fs::Buffer>(reads[i], deadline);
+		BOOST_CHECK(read->str() == data.substr((i * 61) % (60 * 1024), 512));
+	}
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -1,6 +1,7 @@
 #define BOOST_TEST_DYN_LINK
 #include <boost/test/unit_test.hpp>
 #include "../Lambda.h"
+#include <array>
 #include <cstring>
 #include <memory>
 
@@ -23,21 +24,21 @@ BOOST_AUTO_TEST_CASE(RejectedLambda_Test) {
 	
 	Promises::STATE_TYPE state = std::make_shared<Promises::RejectedState>("test");
 	
-	auto p1 = lam1->call(state);
-	auto p2 = lam2->call(state);
+	auto p1 = lam1.call(state);
+	auto p2 = lam2.call(state);
 	
 	BOOST_CHECK(p1 == nullptr);
 	BOOST_CHECK(p2 == nullptr);
 	
 	Promises::STATE_TYPE s = nullptr;
 	try {
-		lam1->call(s);
+		lam1.call(s);
 	} catch (const std::exception &ex) {
 		BOOST_CHECK(strcmp(ex.what(), "RejectedLambda.call(): state is null") == 0);
 	}
 	
 	try {
-		lam2->call(s);
+		lam2.call(s);
 	} catch (const std::exception &ex) {
 		BOOST_CHECK(strcmp(ex.what(), "RejectedLambda.call(): state is null") == 0);
 	}
@@ -60,24 +61,67 @@ BOOST_AUTO_TEST_CASE(ResolvedLambda_Test) {
 	Promises::STATE_TYPE state1 = std::make_shared<Promises::ResolvedState<int>>(10);
 	Promises::STATE_TYPE state2 = std::make_shared<Promises::ResolvedState<char>>('$');
 	
-	auto p1 = lam1->call(state1);
-	auto p2 = lam2->call(state2);
+	auto p1 = lam1.call(state1);
+	auto p2 = lam2.call(state2);
 	
 	BOOST_CHECK(p1 == nullptr);
 	BOOST_CHECK(p2 == nullptr);
 	
 	Promises::STATE_TYPE s = nullptr;
 	try {
-		lam1->call(s);
+		lam1.call(s);
 	} catch (const std::exception &ex) {
 		BOOST_CHECK(strcmp(ex.what(), "ResolvedLambda.call(): state is null") == 0);
 	}
 	
 	try {
-		lam2->call(s);
+		lam2.call(s);
 	} catch (const std::exception &ex) {
 		BOOST_CHECK(strcmp(ex.what(), "ResolvedLambda.call(): state is null") == 0);
 	}
 }
 
+BOOST_AUTO_TEST_CASE(Handler_Test) {
+	std::shared_ptr<int> calls = std::make_shared<int>(0);
+
+	//a few pointers fit inline, a large capture goes to the pool
+	auto small = Promises::resolved_lambda([calls](int num) {
+		*calls += num;
+	});
+
+	std::array<char, 128> padding = {};
+	auto large = Promises::resolved_lambda([calls, padding](int num) {
+		*calls += num + padding[0];
+	});
+
+	BOOST_CHECK(Promises::Handler::stored_inline<decltype(small)>());
+	BOOST_CHECK(!Promises::Handler::stored_inline<decltype(large)>());
+
+	Promises::Handler empty;
+	BOOST_CHECK(empty == nullptr);
+
+	Promises::Handler h1(std::move(small));
+	Promises::Handler h2(std::move(large));
+	BOOST_CHECK(h1 != nullptr);
+	BOOST_CHECK(h2 != nullptr);
+
+	//moving leaves the source empty and the handler still callable
+	Promises::Handler h3(std::move(h1));
+	BOOST_CHECK(h1 == nullptr);
+
+	Promises::Handler h4;
+	h4 = std::move(h2);
+	BOOST_CHECK(h2 == nullptr);
+
+	Promises::STATE_TYPE state = std::make_shared<Promises::ResolvedState<int>>(10);
+	BOOST_CHECK(h3.call(state) == nullptr);
+	BOOST_CHECK(h4.call(state) == nullptr);
+	BOOST_CHECK(*calls == 20);
+
+	//the captured copies of calls go away with the handlers
+	h3 = nullptr;
+	h4 = nullptr;
+	BOOST_CHECK(calls.use_count() == 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
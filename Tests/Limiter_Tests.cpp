@@ -0,0 +1,276 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "../Limiter.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(LIMITER_SUITE)
+
+static Promises::PROM_TYPE pending(void) {
+	return Promises::make_pooled<Promises::Promise>(Promises::pending_state);
+}
+
+//settled by the test, one at a time
+struct Tasks {
+	std::vector<Promises::PROM_TYPE> started;
+	std::mutex lock;
+
+	Promises::PROM_TYPE start(void) {
+		Promises::PROM_TYPE prom = pending();
+		std::unique_lock<std::mutex> guard(lock);
+		started.push_back(prom);
+		return prom;
+	}
+
+	Promises::PROM_TYPE at(size_t i) {
+		std::unique_lock<std::mutex> guard(lock);
+		return started[i];
+	}
+
+	size_t count(void) {
+		std::unique_lock<std::mutex> guard(lock);
+		return started.size();
+	}
+
+	void wait_for(size_t n) {
+		while (count() < n) {
+			std::this_thread::yield();
+		}
+	}
+};
+
+BOOST_AUTO_TEST_CASE(Limit_Test) {
+	Promises::Limiter limiter(3);
+	std::atomic<int> active(0);
+	std::atomic<int> most(0);
+	std::vector<Promises::PROM_TYPE> results;
+
+	for (int i = 0; i < 50; ++i) {
+		results.push_back(limiter.submit([i, &active, &most]() {
+			int now = ++active;
+			int seen = most.load();
+			while (now > seen && !most.compare_exchange_weak(seen, now)) {
+			}
+
+			return Promises::delay(std::chrono::milliseconds(1), i)->then([&active](int value) {
+				--active;
+				return Promises::Resolve<int>(value);
+			});
+		}));
+	}
+
+	for (int i = 0; i < 50; ++i) {
+		BOOST_CHECK(*Promises::await<int>(results[i]) == i);
+	}
+
+	BOOST_CHECK(most.load() <= 3);
+	BOOST_CHECK(most.load() >= 1);
+}
+
+BOOST_AUTO_TEST_CASE(Queue_Order_Test) {
+	Promises::Limiter limiter(2);
+	Tasks tasks;
+	std::vector<Promises::PROM_TYPE> results;
+
+	for (int i = 0; i < 5; ++i) {
+		results.push_back(limiter.submit([&tasks]() {
+			return tasks.start();
+		}));
+	}
+
+	//only two started, the rest wait their turn
+	BOOST_CHECK(tasks.count() == 2);
+	BOOST_CHECK(limiter.running() == 2);
+	BOOST_CHECK(limiter.queued() == 3);
+	BOOST_CHECK(*results[2]->get_state() == Promises::Pending);
+
+	//each settled task lets the oldest waiting one start
+	for (size_t i = 0; i < 5; ++i) {
+		tasks.wait_for(std::min<size_t>(i + 2, 5));
+		Promises::Settlement(tasks.at(i).get()).resolve<int>((int)i * 10);
+		BOOST_CHECK(*Promises::await<int>(results[i]) == (int)i * 10);
+	}
+
+	while (limiter.running() != 0) {
+		std::this_thread::yield();
+	}
+	BOOST_CHECK(limiter.queued() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(Reject_Excess_Test) {
+	Promises::Limiter limiter(1, Promises::RejectExcess);
+	Tasks tasks;
+
+	Promises::PROM_TYPE first = limiter.submit([&tasks]() {
+		return tasks.start();
+	});
+	Promises::PROM_TYPE refused = limiter.submit([&tasks]() {
+		return tasks.start();
+	});
+
+	BOOST_CHECK_THROW(Promises::await<int>(refused), Promises::Overloaded);
+	BOOST_CHECK(tasks.count() == 1);
+
+	Promises::Settlement(tasks.at(0).get()).resolve<int>(1);
+	BOOST_CHECK(*Promises::await<int>(first) == 1);
+
+	while (limiter.running() != 0) {
+		std::this_thread::yield();
+	}
+
+	//room again
+	BOOST_CHECK(*Promises::await<int>(limiter.submit([]() {
+		return Promises::Resolve<int>(2);
+	})) == 2);
+}
+
+BOOST_AUTO_TEST_CASE(Queue_Capacity_Test) {
+	Promises::Limiter limiter(1, Promises::QueueExcess, 2);
+	Tasks tasks;
+	std::vector<Promises::PROM_TYPE> results;
+
+	for (int i = 0; i < 4; ++i) {
+		results.push_back(limiter.submit([&tasks]() {
+			return tasks.start();
+		}));
+	}
+
+	//one running, two waiting, the fourth turned away
+	BOOST_CHECK(limiter.queued() == 2);
+	BOOST_CHECK_THROW(Promises::await<int>(results[3]), Promises::Overloaded);
+
+	for (size_t i = 0; i < 3; ++i) {
+		tasks.wait_for(i + 1);
+		Promises::Settlement(tasks.at(i).get()).resolve<int>((int)i);
+		BOOST_CHECK(*Promises::await<int>(results[i]) == (int)i);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Failing_Task_Test) {
+	Promises::Limiter limiter(1);
+	Tasks tasks;
+
+	Promises::PROM_TYPE first = limiter.submit([&tasks]() {
+		return tasks.start();
+	});
+
+	//a throwing factory and a rejected task both give their slot back
+	std::vector<Promises::PROM_TYPE> throwing;
+	for (int i = 0; i < 1000; ++i) {
+		throwing.push_back(limiter.submit([]() -> Promises::PROM_TYPE {
+			throw std::out_of_range("no");
+		}));
+	}
+
+	Promises::PROM_TYPE rejected = limiter.submit([]() {
+		return Promises::Reject(std::logic_error("bad"));
+	});
+	Promises::PROM_TYPE last = limiter.submit([]() {
+		return Promises::Resolve<int>(3);
+	});
+
+	Promises::Settlement(tasks.at(0).get()).resolve<int>(1);
+	BOOST_CHECK(*Promises::await<int>(first) == 1);
+
+	for (size_t i = 0; i < throwing.size(); ++i) {
+		BOOST_CHECK_THROW(Promises::await<int>(throwing[i]), std::out_of_range);
+	}
+	BOOST_CHECK_THROW(Promises::await<int>(rejected), std::logic_error);
+	BOOST_CHECK(*Promises::await<int>(last) == 3);
+}
+
+BOOST_AUTO_TEST_CASE(Chain_End_Test) {
+	Promises::Limiter limiter(1);
+	Tasks tasks;
+
+	//the task's last handler returns nothing, its slot still comes back
+	Promises::PROM_TYPE ended = limiter.submit([&tasks]() {
+		return tasks.start()->then([](int) {
+		});
+	});
+	Promises::PROM_TYPE next = limiter.submit([]() {
+		return Promises::Resolve<int>(2);
+	});
+
+	BOOST_CHECK(limiter.queued() == 1);
+
+	Promises::Settlement(tasks.at(0).get()).resolve<int>(1);
+	BOOST_CHECK_THROW(Promises::await<int>(ended), Promises::Promise_Error);
+	BOOST_CHECK(*Promises::await<int>(next) == 2);
+
+	while (limiter.running() != 0) {
+		std::this_thread::yield();
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Destroyed_Test) {
+	Tasks tasks;
+	Promises::PROM_TYPE running;
+	Promises::PROM_TYPE waiting;
+
+	{
+		Promises::Limiter limiter(1);
+		running = limiter.submit([&tasks]() {
+			return tasks.start();
+		});
+		waiting = limiter.submit([&tasks]() {
+			return tasks.start();
+		});
+	}
+
+	//the waiting task never starts, the running one still settles
+	BOOST_CHECK_THROW(Promises::await<int>(waiting), Promises::Cancelled);
+	BOOST_CHECK(tasks.count() == 1);
+
+	Promises::Settlement(tasks.at(0).get()).resolve<int>(5);
+	BOOST_CHECK(*Promises::await<int>(running) == 5);
+}
+
+BOOST_AUTO_TEST_CASE(Overload_Test) {
+	//far more submitted than may run, from several producers
+	Promises::Limiter limiter(8);
+	std::atomic<int> active(0);
+	std::atomic<bool> over(false);
+	std::vector<std::thread> producers;
+	std::vector<std::vector<Promises::PROM_TYPE>> results(4);
+
+	for (size_t p = 0; p < results.size(); ++p) {
+		producers.push_back(std::thread([p, &limiter, &active, &over, &results]() {
+			for (int i = 0; i < 5000; ++i) {
+				results[p].push_back(limiter.submit([i, &active, &over]() {
+					if (++active > 8) {
+						over = true;
+					}
+
+					return Promises::Resolve<int>(i)->then([&active](int value) {
+						--active;
+						return Promises::Resolve<int>(value);
+					});
+				}));
+			}
+		}));
+	}
+
+	for (size_t p = 0; p < producers.size(); ++p) {
+		producers[p].join();
+	}
+
+	for (size_t p = 0; p < results.size(); ++p) {
+		for (int i = 0; i < 5000; ++i) {
+			BOOST_CHECK(*Promises::await<int>(results[p][i]) == i);
+		}
+	}
+
+	BOOST_CHECK(!over.load());
+	while (limiter.running() != 0) {
+		std::this_thread::yield();
+	}
+	BOOST_CHECK(limiter.queued() == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,112 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "../Metrics.h"
+#include "../Typed.h"
+#include <thread>
+
+BOOST_AUTO_TEST_SUITE(METRICS_SUITE)
+
+BOOST_AUTO_TEST_CASE(Histogram_Bucket_Test) {
+	//exact below 8, then within one eighth
+	BOOST_CHECK(Promises::Metrics::bucket_of(0) == 0);
+	BOOST_CHECK(Promises::Metrics::bucket_of(7) == 7);
+	BOOST_CHECK(Promises::Metrics::bucket_of(8) == 8);
+	BOOST_CHECK(Promises::Metrics::bucket_of(16) == Promises::Metrics::bucket_of(17));
+	BOOST_CHECK(Promises::Metrics::bucket_of(~uint64_t(0)) == Promises::Metrics::BucketCount - 1);
+
+	bool bounded = true;
+	uint64_t values[] = { 1, 9, 100, 1000, 123456, 987654321, uint64_t(1) << 40 };
+
+	for (size_t i = 0; i < sizeof(values) / sizeof(values[0]); ++i) {
+		uint64_t max = Promises::Metrics::bucket_max(Promises::Metrics::bucket_of(values[i]));
+		bounded = bounded && max >= values[i] && (double)(max - values[i]) <= (double)values[i] / 8.0;
+	}
+	BOOST_CHECK(bounded);
+}
+
+BOOST_AUTO_TEST_CASE(Metrics_Snapshot_Test) {
+	Promises::MetricsSnapshot before = Promises::metrics();
+
+	//counts from another thread's shard are summed in
+	std::thread other([]() {
+		Promises::Metrics::add(Promises::Metrics::CasRetries, 5);
+		Promises::Metrics::sample(Promises::Metrics::AwaitBlock, 1000);
+	});
+	other.join();
+
+	Promises::Metrics::add(Promises::Metrics::CasRetries, 2);
+
+	for (uint64_t i = 1; i <= 100; ++i) {
+		Promises::Metrics::sample(Promises::Metrics::SettleToContinuation, i * 1000000);
+	}
+
+	Promises::MetricsSnapshot after = Promises::metrics();
+	BOOST_CHECK(after.get(Promises::Metrics::CasRetries) - before.get(Promises::Metrics::CasRetries) >= 7);
+	BOOST_CHECK(after.await_block.count - before.await_block.count >= 1);
+	BOOST_CHECK(after.settle_to_continuation.max >= 100000000);
+
+	Promises::HistogramSnapshot samples;
+	for (uint64_t i = 1; i <= 100; ++i) {
+		samples.buckets[Promises::Metrics::bucket_of(i * 1000)] += 1;
+		samples.count += 1;
+		samples.total += i * 1000;
+		samples.max = i * 1000;
+	}
+
+	BOOST_CHECK(samples.mean() == 50500.0);
+	BOOST_CHECK(samples.percentile(50) >= 50000 && samples.percentile(50) <= 50000 + 50000 / 8);
+	BOOST_CHECK(samples.percentile(100) == 100000);
+}
+
+#ifdef PROMISE_METRICS
+BOOST_AUTO_TEST_CASE(Metrics_Runtime_Test) {
+	Promises::MetricsSnapshot before = Promises::metrics();
+
+	{
+		Promises::PROM_TYPE root = Promises::make_pooled<Promises::Promise>(Promises::pending_state);
+		Promises::PROM_TYPE next = root->then([](int value) {
+			return Promises::Resolve<int>(value + 1);
+		});
+
+		Promises::Settlement(root.get()).resolve<int>(1);
+		Promises::await<int>(next);
+
+		Promises::Typed::Promise<int> failed = Promises::Typed::Resolve(1).then([](int value) -> int {
+			throw std::runtime_error("no");
+		});
+		BOOST_CHECK_THROW(Promises::Typed::await(failed), std::runtime_error);
+	}
+
+	Promises::MetricsSnapshot after = Promises::metrics();
+	BOOST_CHECK(after.get(Promises::Metrics::PromisesCreated) - before.get(Promises::Metrics::PromisesCreated) >= 4);
+	BOOST_CHECK(after.get(Promises::Metrics::ContinuationsRun) - before.get(Promises::Metrics::ContinuationsRun) >= 2);
+	BOOST_CHECK(after.get(Promises::Metrics::Rejections) - before.get(Promises::Metrics::Rejections) >= 1);
+	BOOST_CHECK(after.get(Promises::Metrics::BytesAllocated) > before.get(Promises::Metrics::BytesAllocated));
+	BOOST_CHECK(after.settle_to_continuation.count > before.settle_to_continuation.count);
+	BOOST_CHECK(after.await_block.count - before.await_block.count >= 2);
+	BOOST_CHECK(after.threads_active() >= 1);
+}
+
+BOOST_AUTO_TEST_CASE(Metrics_Bytes_Test) {
+	//a new thread's first block takes a chunk from upstream,
+	//which must not count on top of the block itself
+	Promises::memory_resource &pool = Promises::block_pool_resource::instance();
+	Promises::MetricsSnapshot before = Promises::metrics();
+	Promises::MetricsSnapshot during;
+
+	std::thread([&pool, &during]() {
+		void* small = pool.allocate(48);
+		void* big = pool.allocate(4096);
+		during = Promises::metrics();
+
+		pool.deallocate(big, 4096);
+		pool.deallocate(small, 48);
+	}).join();
+
+	Promises::MetricsSnapshot after = Promises::metrics();
+	BOOST_CHECK(during.get(Promises::Metrics::BytesAllocated) - before.get(Promises::Metrics::BytesAllocated) == 48 + 4096);
+	BOOST_CHECK(after.get(Promises::Metrics::BytesFreed) - during.get(Promises::Metrics::BytesFreed) == 48 + 4096);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
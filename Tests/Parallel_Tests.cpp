@@ -0,0 +1,117 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "../Parallel.h"
+#include <atomic>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(PARALLEL_SUITE)
+
+BOOST_AUTO_TEST_CASE(Parallel_For_Test) {
+	std::vector<int> values(100000, 1);
+
+	//every element exactly once, with the grain picked for us
+	Promises::PROM_TYPE prom = Promises::parallel_for(values, 0, [](int &value) {
+		value += 1;
+	});
+
+	BOOST_CHECK(*Promises::await<size_t>(prom) == values.size());
+
+	bool doubled = true;
+	for (size_t i = 0; i < values.size(); ++i) {
+		doubled = doubled && values[i] == 2;
+	}
+	BOOST_CHECK(doubled);
+
+	std::vector<int> empty;
+	Promises::PROM_TYPE none = Promises::parallel_for(empty, 16, [](int &value) {
+		value = 0;
+	});
+	BOOST_CHECK(*Promises::await<size_t>(none) == 0);
+}
+
+BOOST_AUTO_TEST_CASE(Parallel_Transform_Test) {
+	std::vector<int> values;
+	for (int i = 0; i < 10000; ++i) {
+		values.push_back(i);
+	}
+
+	Promises::PROM_TYPE prom = Promises::parallel_transform(values, 64, [](int value) {
+		return std::to_string(value);
+	});
+
+	std::vector<std::string>* strings = Promises::await<std::vector<std::string>>(prom);
+	BOOST_REQUIRE(strings->size() == values.size());
+
+	bool ordered = true;
+	for (size_t i = 0; i < values.size(); ++i) {
+		ordered = ordered && (*strings)[i] == std::to_string(values[i]);
+	}
+	BOOST_CHECK(ordered);
+}
+
+BOOST_AUTO_TEST_CASE(Parallel_Transform_Bool_Test) {
+	//grain 1, so neighbouring elements are written by different chunks
+	std::vector<int> values;
+	for (int i = 0; i < 10000; ++i) {
+		values.push_back(i);
+	}
+
+	Promises::PROM_TYPE prom = Promises::parallel_transform(values, 1, [](int value) {
+		return value % 3 == 0;
+	});
+
+	std::vector<bool>* flags = Promises::await<std::vector<bool>>(prom);
+	BOOST_REQUIRE(flags->size() == values.size());
+
+	bool right = true;
+	for (size_t i = 0; i < values.size(); ++i) {
+		right = right && (*flags)[i] == (values[i] % 3 == 0);
+	}
+	BOOST_CHECK(right);
+}
+
+BOOST_AUTO_TEST_CASE(Parallel_Reduce_Test) {
+	std::vector<long> values;
+	for (long i = 1; i <= 100000; ++i) {
+		values.push_back(i);
+	}
+
+	Promises::PROM_TYPE sum = Promises::parallel_reduce(values, 100, 0L, [](long a, long b) {
+		return a + b;
+	});
+	BOOST_CHECK(*Promises::await<long>(sum) == 5000050000L);
+
+	//not commutative: chunks are combined in order
+	std::vector<std::string> letters;
+	for (char c = 'a'; c <= 'z'; ++c) {
+		letters.push_back(std::string(1, c));
+	}
+
+	Promises::PROM_TYPE joined = Promises::parallel_reduce(letters, 3, std::string(">"), [](std::string a, std::string b) {
+		return a + b;
+	});
+	BOOST_CHECK(*Promises::await<std::string>(joined) == ">abcdefghijklmnopqrstuvwxyz");
+}
+
+BOOST_AUTO_TEST_CASE(Parallel_Reject_Test) {
+	std::vector<int> values(1000, 0);
+	values[500] = 1;
+
+	Promises::PROM_TYPE prom = Promises::parallel_for(values, 10, [](int &value) {
+		if (value == 1) {
+			throw std::runtime_error("IUPUI");
+		}
+	});
+
+	try {
+		Promises::await<size_t>(prom);
+		BOOST_ERROR("parallel_for() resolved past a throwing element");
+	} catch (const std::runtime_error &ex) {
+		//rethrown as the type the element threw
+		BOOST_CHECK(std::string(ex.what()) == "IUPUI");
+	}
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,102 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "../Park.h"
+#include "../Promise.h"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(PARK_SUITE)
+
+BOOST_AUTO_TEST_CASE(Spin_Test) {
+	int calls = 0;
+
+	//on a single hardware thread there is no spinning, just the one check
+	bool done = Promises::spin_until([&calls]() {
+		return ++calls == 3;
+	});
+	BOOST_CHECK(done == (calls == 3));
+
+	BOOST_CHECK(!Promises::spin_until([]() {
+		return false;
+	}));
+}
+
+BOOST_AUTO_TEST_CASE(Park_Timeout_Test) {
+	std::atomic<int> word(0);
+
+	//nobody wakes us, the timeout does
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	Promises::park(word, 0, std::chrono::microseconds(2000));
+	BOOST_CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+
+	//the word already moved on: returns straight away
+	Promises::park(word, 1);
+}
+
+BOOST_AUTO_TEST_CASE(Unpark_Test) {
+	std::atomic<int> word(0);
+	std::atomic<int> woken(0);
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < 4; ++i) {
+		threads.push_back(std::thread([&word, &woken]() {
+			while (word.load() == 0) {
+				Promises::park(word, 0);
+			}
+			woken.fetch_add(1);
+		}));
+	}
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	word.store(1);
+	Promises::unpark_all(word);
+
+	for (size_t i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
+
+	BOOST_CHECK(woken.load() == 4);
+}
+
+BOOST_AUTO_TEST_CASE(Join_Many_Test) {
+	Promises::PROM_TYPE prom = promise([](Promises::Settlement settle) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+		settle.resolve<int>(5);
+	});
+
+	//several threads parked on the same promise all wake up
+	std::atomic<int> sum(0);
+	std::vector<std::thread> threads;
+
+	for (int i = 0; i < 4; ++i) {
+		threads.push_back(std::thread([&prom, &sum]() {
+			sum.fetch_add(*Promises::await<int>(prom));
+		}));
+	}
+
+	for (size_t i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
+
+	BOOST_CHECK(sum.load() == 20);
+}
+
+BOOST_AUTO_TEST_CASE(Join_Assign_Test) {
+	Promises::PROM_TYPE prom = Promises::make_pooled<Promises::Promise>(Promises::pending_state);
+
+	//a thread parked with no timeout wakes when a settled promise is assigned
+	std::atomic<int> value(0);
+	std::thread waiter([&prom, &value]() {
+		value.store(*Promises::await<int>(prom));
+	});
+
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	*prom = *Promises::Resolve<int>(6);
+
+	waiter.join();
+	BOOST_CHECK(value.load() == 6);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
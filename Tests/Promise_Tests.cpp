@@ -2,6 +2,11 @@
 #define BOOST_TEST_DYN_LINK
 #include <boost/test/unit_test.hpp>
 #include "../Promise.h"
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
 
 BOOST_AUTO_TEST_SUITE(PROMISE_SUITE)
 
@@ -33,7 +38,7 @@ BOOST_AUTO_TEST_CASE(SettlmentLambda_Test) {
     });
 
     Promises::IPromise* prom = nullptr;
-    lam->call(prom);
+    lam.call(prom);
 }
 
 BOOST_AUTO_TEST_CASE(Promise_Default_Constructor_Test) {
@@ -91,7 +96,7 @@ BOOST_AUTO_TEST_CASE(Promise_SettlementLambda_Constructor_Test) {
         BOOST_CHECK(true);
     });
 
-    Promises::PROM_TYPE prom = std::make_shared<Promises::Promise>(lam);
+    Promises::PROM_TYPE prom = std::make_shared<Promises::Promise>(std::move(lam));
     
     //promise destructor joins on thread
 }
@@ -101,7 +106,7 @@ BOOST_AUTO_TEST_CASE(Await_Test) {
         settle.resolve<int>(10);
     });
 
-    Promises::PROM_TYPE prom1 = std::make_shared<Promises::Promise>(lam1);
+    Promises::PROM_TYPE prom1 = std::make_shared<Promises::Promise>(std::move(lam1));
     int* v = Promises::await<int>(prom1);
     BOOST_CHECK(*v == 10);
 
@@ -109,7 +114,7 @@ BOOST_AUTO_TEST_CASE(Await_Test) {
         settle.reject(std::logic_error("nyalia"));
     });
 
-    Promises::PROM_TYPE prom2 = std::make_shared<Promises::Promise>(lam2);
+    Promises::PROM_TYPE prom2 = std::make_shared<Promises::Promise>(std::move(lam2));
     try {
         Promises::await<int>(prom2);
     } catch (const std::exception &ex) {
@@ -132,7 +137,7 @@ BOOST_AUTO_TEST_CASE(Double_Lambda_Then_Test) {
     });
 
     //tests the resolve handle
-    prom1->then([](int value) {
+    Promises::PROM_TYPE resolved = prom1->then([](int value) {
         BOOST_CHECK(value == 10);
     }, [](const std::exception &ex){});
 	
@@ -141,9 +146,13 @@ BOOST_AUTO_TEST_CASE(Double_Lambda_Then_Test) {
     });
 
     //tests the reject handle
-    prom2->then([](int value) { }, [](const std::exception &ex){
+    Promises::PROM_TYPE rejected = prom2->then([](int value) { }, [](const std::exception &ex){
         BOOST_CHECK(strcmp(ex.what(), "test") == 0);
     });
+
+    //Boost.Test checks are not thread safe, let the handlers finish first
+    Promises::await<void>(resolved);
+    Promises::await<void>(rejected);
 }
 
 BOOST_AUTO_TEST_CASE(Single_Lambda_Then_Test) {
@@ -151,9 +160,11 @@ BOOST_AUTO_TEST_CASE(Single_Lambda_Then_Test) {
         settle.resolve<int>(10);
     });
 
-    prom->then([](int value) {
+    Promises::PROM_TYPE done = prom->then([](int value) {
         BOOST_CHECK(value == 10);
     });
+
+    Promises::await<void>(done);
 }
 
 BOOST_AUTO_TEST_CASE(Lambda_Catch_Test) {
@@ -161,9 +172,11 @@ BOOST_AUTO_TEST_CASE(Lambda_Catch_Test) {
         settle.reject(Promises::Promise_Error("nyalia"));
     });
 
-    prom->_catch([](const std::exception &ex) {
+    Promises::PROM_TYPE caught = prom->_catch([](const std::exception &ex) {
         BOOST_CHECK(strcmp(ex.what(), "nyalia") == 0);
     });
+
+    Promises::await<void>(caught);
 }
 
 BOOST_AUTO_TEST_CASE(Bubble_Resolve_Test) {
@@ -172,12 +185,14 @@ BOOST_AUTO_TEST_CASE(Bubble_Resolve_Test) {
     });
 
     //tests the resolve handle when value must be bubbled downstream
-    prom->_catch([](const std::exception &ex) { })
+    Promises::PROM_TYPE done = prom->_catch([](const std::exception &ex) { })
     ->_catch([](const std::exception &ex) { })
     ->_catch([](const std::exception &ex) { })
     ->then([](int value) {
         BOOST_CHECK(value == 10);
     });
+
+    Promises::await<void>(done);
 }
 
 BOOST_AUTO_TEST_CASE(Bubble_Reject_Test) {
@@ -185,21 +200,26 @@ BOOST_AUTO_TEST_CASE(Bubble_Reject_Test) {
         settle.reject(Promises::Promise_Error("nyalia"));
     });
 
-    prom->then([](int num){})
+    Promises::PROM_TYPE caught = prom->then([](int num){})
     ->then([](int num){})
     ->then([](int num){})
     ->_catch([](const std::exception &ex) {
         BOOST_CHECK(strcmp(ex.what(), "nyalia") == 0);
     });
+
+    Promises::await<void>(caught);
 }
 
 BOOST_AUTO_TEST_CASE(PreResolved_Test) {
     auto prom = Promises::Resolve<int>(10);
 
-    prom->then([](int num) {
+    auto done = prom->then([](int num) {
         BOOST_CHECK(num == 10);
     });
 
+    //Boost.Test checks are not thread safe, let the handler finish first
+    Promises::await<void>(done);
+
     auto v = Promises::await<int>(prom);
     BOOST_CHECK(*v == 10);
 }
@@ -207,10 +227,13 @@ BOOST_AUTO_TEST_CASE(PreResolved_Test) {
 BOOST_AUTO_TEST_CASE(PreRejected_Test) {
     auto prom = Promises::Reject(Promises::Promise_Error("IUPUI"));
 
-    prom->_catch([](const std::exception &ex) {
+    auto caught = prom->_catch([](const std::exception &ex) {
         BOOST_CHECK(strcmp(ex.what(), "IUPUI") == 0);
     });
 
+    //Boost.Test checks are not thread safe, let the handler finish first
+    Promises::await<void>(caught);
+
     try {
         Promises::await<int>(prom);
     } catch (const std::exception &ex) {
@@ -223,7 +246,7 @@ BOOST_AUTO_TEST_CASE(Finally_Test) {
         settle.reject(Promises::Promise_Error("nyalia"));
     });
 
-    prom->then([](int num){})
+    Promises::PROM_TYPE caught = prom->then([](int num){})
     ->then([](int num){})
     ->then([](int num){})
     ->finally([](){ } )
@@ -231,7 +254,7 @@ BOOST_AUTO_TEST_CASE(Finally_Test) {
         BOOST_CHECK(strcmp(ex.what(), "nyalia") == 0);
     });
 
-    prom->then([](int num){})
+    Promises::PROM_TYPE recovered = prom->then([](int num){})
     ->then([](int num){})
     ->then([](int num){})
     ->_catch([](const std::exception &ex) { 
@@ -240,6 +263,91 @@ BOOST_AUTO_TEST_CASE(Finally_Test) {
     ->finally([](){
         BOOST_CHECK(true);
     });
+
+    Promises::await<void>(caught);
+    BOOST_CHECK(*Promises::await<int>(recovered) == 10);
+}
+
+BOOST_AUTO_TEST_CASE(Finally_Capture_Test) {
+	//either outcome's copy of the handler still has its captures
+	std::shared_ptr<int> ran = std::make_shared<int>(0);
+
+	Promises::PROM_TYPE resolved = Promises::Resolve<int>(1)->finally([ran]() {
+		++*ran;
+	});
+	BOOST_CHECK(*Promises::await<int>(resolved) == 1);
+
+	Promises::PROM_TYPE rejected = Promises::Reject(std::logic_error("no"))->finally([ran]() {
+		++*ran;
+	});
+	BOOST_CHECK_THROW(Promises::await<int>(rejected), std::logic_error);
+
+	BOOST_CHECK(*ran == 2);
+}
+
+BOOST_AUTO_TEST_CASE(Finally_State_Test) {
+	//a finally() handler taking the state gets it as it is
+	std::shared_ptr<Promises::State> seen;
+
+	Promises::PROM_TYPE prom = Promises::Resolve<int>(3)->finally([&seen](std::shared_ptr<Promises::State> state) {
+		seen = state;
+	});
+	BOOST_CHECK(*Promises::await<int>(prom) == 3);
+	BOOST_CHECK(seen != nullptr && *(int*)seen->get_value() == 3);
+
+	Promises::PROM_TYPE ended = Promises::Resolve<int>(3)->then([](int value) {
+	})->finally([&seen](std::shared_ptr<Promises::State> state) {
+		seen = state;
+	});
+	BOOST_CHECK(Promises::await<int>(ended) == nullptr);
+	BOOST_CHECK(seen == nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(Finally_Chain_End_Test) {
+	//a pending chain whose last handler returns nothing still runs finally()
+	Promises::PROM_TYPE root = Promises::make_pooled<Promises::Promise>(Promises::pending_state);
+	std::atomic<int> ran(0);
+
+	Promises::PROM_TYPE end = root->then([](int value) {
+	})->finally([&ran]() {
+		++ran;
+	});
+
+	//and so does a continuation after another one
+	Promises::PROM_TYPE later = root->then([](int value) {
+	})->then([](int value) {
+		return Promises::Resolve<int>(value);
+	})->finally([&ran]() {
+		++ran;
+	});
+
+	Promises::Settlement(root.get()).resolve<int>(1);
+
+	BOOST_CHECK(Promises::await<int>(end) == nullptr);
+	BOOST_CHECK(Promises::await<int>(later) == nullptr);
+	BOOST_CHECK(ran == 2);
+
+	//or one added after the chain ended
+	Promises::PROM_TYPE ended = root->then([](int value) {
+	});
+	BOOST_CHECK(Promises::await<int>(ended) == nullptr);
+	BOOST_CHECK(Promises::await<int>(ended->finally([&ran]() {
+		++ran;
+	})) == nullptr);
+	BOOST_CHECK(ran == 3);
+}
+
+//rejected_with - the message prom rejects with. A few seconds
+//at most, so a combinator that never settles fails instead of hanging.
+template <typename T>
+static std::string rejected_with(Promises::PROM_TYPE prom) {
+	try {
+		Promises::await_until<T>(prom, std::chrono::steady_clock::now() + std::chrono::seconds(5));
+	} catch (const std::exception &ex) {
+		return ex.what();
+	}
+
+	return "";
 }
 
 BOOST_AUTO_TEST_CASE(Promise_All_Test) {
@@ -273,6 +381,252 @@ BOOST_AUTO_TEST_CASE(Promise_All_Test) {
 	}
 }
 
+BOOST_AUTO_TEST_CASE(Promise_All_Countdown_Test) {
+	const int count = 10000;
+	std::vector<Promises::PROM_TYPE> pending;
+	Promises::PROM_TYPE prom;
+
+	{
+		//all() does not hold on to the vector it was given
+		std::vector<Promises::PROM_TYPE> promises;
+		for (int i = 0; i < count; ++i) {
+			promises.push_back(Promises::make_pooled<Promises::Promise>(Promises::pending_state));
+		}
+
+		pending = promises;
+		prom = Promises::all<int>(promises);
+	}
+
+	//settled back to front, collected by index
+	for (int i = count - 1; i >= 0; --i) {
+		Promises::Settlement settle(pending[i].get());
+		settle.resolve<int>(i);
+	}
+
+	std::vector<int>* values = Promises::await<std::vector<int>>(prom);
+	BOOST_CHECK(values->size() == (size_t)count);
+
+	bool ordered = true;
+	for (int i = 0; i < count; ++i) {
+		ordered = ordered && ((*values)[i] == i);
+	}
+	BOOST_CHECK(ordered);
+
+	//a rejection settles it without waiting for the rest
+	std::vector<Promises::PROM_TYPE> waiting;
+	waiting.push_back(Promises::make_pooled<Promises::Promise>(Promises::pending_state));
+	waiting.push_back(Promises::make_pooled<Promises::Promise>(Promises::pending_state));
+
+	Promises::PROM_TYPE failed = Promises::all<int>(waiting);
+	Promises::Settlement settle(waiting[1].get());
+	settle.reject(Promises::Promise_Error("second"));
+
+	BOOST_CHECK_THROW(Promises::await<std::vector<int>>(failed), Promises::Promise_Error);
+
+	//nothing to wait for
+	Promises::PROM_TYPE empty = Promises::all<int>(std::vector<Promises::PROM_TYPE>());
+	BOOST_CHECK(Promises::await<std::vector<int>>(empty)->empty());
+}
+
+BOOST_AUTO_TEST_CASE(Promise_All_Bool_Test) {
+	Promises::set_continuation_policy(Promises::Inline);
+
+	//neighbouring slots settled from different threads, over a few rounds
+	const int count = 64;
+	const int threads = 4;
+	bool matched = true;
+
+	for (int round = 0; round < 50; ++round) {
+		std::vector<Promises::PROM_TYPE> promises;
+		for (int i = 0; i < count; ++i) {
+			promises.push_back(Promises::make_pooled<Promises::Promise>(Promises::pending_state));
+		}
+
+		Promises::PROM_TYPE prom = Promises::all<bool>(promises);
+
+		std::atomic<bool> go(false);
+		std::vector<std::thread> settlers;
+		for (int t = 0; t < threads; ++t) {
+			settlers.push_back(std::thread([&promises, &go, t]() {
+				while (!go.load()) {
+					std::this_thread::yield();
+				}
+
+				for (int i = t; i < count; i += threads) {
+					Promises::Settlement(promises[i].get()).resolve<bool>(i % 3 == 0);
+				}
+			}));
+		}
+
+		go.store(true);
+		for (size_t t = 0; t < settlers.size(); ++t) {
+			settlers[t].join();
+		}
+
+		std::vector<bool>* values = Promises::await<std::vector<bool>>(prom);
+		BOOST_REQUIRE(values->size() == (size_t)count);
+
+		for (int i = 0; i < count; ++i) {
+			matched = matched && (*values)[i] == (i % 3 == 0);
+		}
+	}
+	BOOST_CHECK(matched);
+
+	Promises::set_continuation_policy(Promises::Dispatch);
+}
+
+//Unboxed - has no default constructor.
+struct Unboxed {
+	explicit Unboxed(int v)
+		:value(v)
+	{ }
+
+	int value;
+};
+
+BOOST_AUTO_TEST_CASE(Promise_All_No_Default_Test) {
+	std::vector<Promises::PROM_TYPE> promises;
+	promises.push_back(Promises::make_pooled<Promises::Promise>(Promises::pending_state));
+	promises.push_back(Promises::Resolve(Unboxed(2)));
+
+	Promises::PROM_TYPE prom = Promises::all<Unboxed>(promises);
+	Promises::Settlement(promises[0].get()).resolve(Unboxed(1));
+
+	std::vector<Unboxed>* values = Promises::await<std::vector<Unboxed>>(prom);
+	BOOST_REQUIRE(values->size() == 2);
+	BOOST_CHECK((*values)[0].value == 1);
+	BOOST_CHECK((*values)[1].value == 2);
+}
+
+BOOST_AUTO_TEST_CASE(Promise_All_Ended_Test) {
+	//an input whose chain ends after all() subscribed to it
+	Promises::PROM_TYPE root = Promises::make_pooled<Promises::Promise>(Promises::pending_state);
+	std::vector<Promises::PROM_TYPE> promises;
+	promises.push_back(Promises::Resolve<int>(1));
+	promises.push_back(root->then([](int value) {
+	}));
+
+	Promises::PROM_TYPE prom = Promises::all<int>(promises);
+	Promises::Settlement(root.get()).resolve<int>(2);
+
+	BOOST_CHECK(rejected_with<std::vector<int>>(prom) == "all(): promise ended without a value");
+}
+
+BOOST_AUTO_TEST_CASE(Promise_Race_Test) {
+	std::vector<Promises::PROM_TYPE> promises;
+	promises.push_back(Promises::make_pooled<Promises::Promise>(Promises::pending_state));
+	promises.push_back(Promises::Resolve<int>(2));
+	promises.push_back(Promises::Resolve<int>(3));
+
+	//already settled, the first in input order wins
+	Promises::PROM_TYPE settled = Promises::race<int>(promises);
+	BOOST_CHECK(*Promises::await<int>(settled) == 2);
+
+	std::vector<Promises::PROM_TYPE> pending;
+	pending.push_back(Promises::make_pooled<Promises::Promise>(Promises::pending_state));
+	pending.push_back(Promises::make_pooled<Promises::Promise>(Promises::pending_state));
+
+	Promises::PROM_TYPE first = Promises::race<int>(pending);
+	Promises::Settlement(pending[1].get()).resolve<int>(20);
+	Promises::Settlement(pending[0].get()).resolve<int>(10);
+	BOOST_CHECK(*Promises::await<int>(first) == 20);
+
+	//a rejection can win too
+	std::vector<Promises::PROM_TYPE> failing;
+	failing.push_back(Promises::make_pooled<Promises::Promise>(Promises::pending_state));
+	failing.push_back(Promises::make_pooled<Promises::Promise>(Promises::pending_state));
+
+	Promises::PROM_TYPE failed = Promises::race<int>(failing);
+	Promises::Settlement(failing[0].get()).reject(Promises::Promise_Error("first"));
+	Promises::Settlement(failing[1].get()).resolve<int>(1);
+	BOOST_CHECK_THROW(Promises::await<int>(failed), Promises::Promise_Error);
+}
+
+BOOST_AUTO_TEST_CASE(Promise_Any_Test) {
+	std::vector<Promises::PROM_TYPE> promises;
+	promises.push_back(Promises::make_pooled<Promises::Promise>(Promises::pending_state));
+	promises.push_back(Promises::make_pooled<Promises::Promise>(Promises::pending_state));
+	promises.push_back(Promises::make_pooled<Promises::Promise>(Promises::pending_state));
+
+	//rejections are skipped over until one resolves
+	Promises::PROM_TYPE prom = Promises::any<int>(promises);
+	Promises::Settlement(promises[0].get()).reject(Promises::Promise_Error("first"));
+	Promises::Settlement(promises[2].get()).resolve<int>(3);
+	Promises::Settlement(promises[1].get()).reject(Promises::Promise_Error("second"));
+	BOOST_CHECK(*Promises::await<int>(prom) == 3);
+
+	std::vector<Promises::PROM_TYPE> failing;
+	failing.push_back(Promises::Reject(Promises::Promise_Error("first")));
+	failing.push_back(Promises::make_pooled<Promises::Promise>(Promises::pending_state));
+
+	Promises::PROM_TYPE failed = Promises::any<int>(failing);
+	Promises::Settlement(failing[1].get()).reject(Promises::Promise_Error("second"));
+
+	try {
+		Promises::await<int>(failed);
+		BOOST_ERROR("any() resolved without a value");
+	} catch (const Promises::Promise_Error &ex) {
+		BOOST_CHECK(std::string(ex.what()) == "any(): every promise was rejected: first; second");
+	}
+
+	Promises::PROM_TYPE empty = Promises::any<int>(std::vector<Promises::PROM_TYPE>());
+	BOOST_CHECK_THROW(Promises::await<int>(empty), Promises::Promise_Error);
+}
+
+BOOST_AUTO_TEST_CASE(Promise_All_Settled_Test) {
+	std::vector<Promises::PROM_TYPE> promises;
+	promises.push_back(Promises::Resolve<int>(1));
+	promises.push_back(Promises::make_pooled<Promises::Promise>(Promises::pending_state));
+	promises.push_back(Promises::make_pooled<Promises::Promise>(Promises::pending_state));
+	promises.push_back(Promises::Reject(Promises::Promise_Error("fourth")));
+
+	Promises::PROM_TYPE prom = Promises::allSettled<int>(promises);
+	Promises::Settlement(promises[2].get()).reject(Promises::Promise_Error("third"));
+	Promises::Settlement(promises[1].get()).resolve<int>(2);
+
+	std::vector<std::shared_ptr<Promises::State>>* states = Promises::await<std::vector<std::shared_ptr<Promises::State>>>(prom);
+	BOOST_REQUIRE(states->size() == 4);
+
+	BOOST_CHECK(*(*states)[0] == Promises::Resolved);
+	BOOST_CHECK(*(int*)(*states)[0]->get_value() == 1);
+	BOOST_CHECK(*(*states)[1] == Promises::Resolved);
+	BOOST_CHECK(*(int*)(*states)[1]->get_value() == 2);
+	BOOST_CHECK(*(*states)[2] == Promises::Rejected);
+	BOOST_CHECK(std::string((*states)[2]->get_reason().what()) == "third");
+	BOOST_CHECK(*(*states)[3] == Promises::Rejected);
+}
+
+BOOST_AUTO_TEST_CASE(Promise_Settled_Ended_Test) {
+	//inputs whose chains end after the combinator subscribed to them
+	Promises::PROM_TYPE root = Promises::make_pooled<Promises::Promise>(Promises::pending_state);
+	std::vector<Promises::PROM_TYPE> promises;
+	promises.push_back(Promises::Resolve<int>(1));
+	promises.push_back(root->then([](int value) {
+	}));
+
+	Promises::PROM_TYPE settled = Promises::allSettled<int>(promises);
+
+	std::vector<Promises::PROM_TYPE> ending;
+	ending.push_back(root->then([](int value) {
+	}));
+	ending.push_back(root->then([](int value) {
+	}));
+
+	Promises::PROM_TYPE raced = Promises::race<int>(ending);
+	Promises::PROM_TYPE any = Promises::any<int>(ending);
+
+	Promises::Settlement(root.get()).resolve<int>(2);
+
+	std::vector<std::shared_ptr<Promises::State>>* states = Promises::await_until<std::vector<std::shared_ptr<Promises::State>>>(settled, std::chrono::steady_clock::now() + std::chrono::seconds(5));
+	BOOST_REQUIRE(states->size() == 2);
+	BOOST_CHECK(*(*states)[0] == Promises::Resolved);
+	BOOST_CHECK(*(*states)[1] == Promises::Rejected);
+	BOOST_CHECK(std::string((*states)[1]->get_reason().what()) == "allSettled(): promise ended without a value");
+
+	BOOST_CHECK(rejected_with<int>(raced) == "race(): promise ended without a value");
+	BOOST_CHECK(rejected_with<int>(any) == "any(): every promise was rejected: promise ended without a value; promise ended without a value");
+}
+
 BOOST_AUTO_TEST_CASE(Promise_Hash_Test) {
 	typedef std::pair<std::string, Promises::PROM_TYPE> prom_pair;
 	
@@ -305,4 +659,391 @@ BOOST_AUTO_TEST_CASE(Promise_Hash_Test) {
 	}
 }
 
+BOOST_AUTO_TEST_CASE(Promise_Hash_Variants_Test) {
+	const int count = 1000;
+	std::unordered_map<int, Promises::PROM_TYPE> promises;
+
+	for (int i = 0; i < count; ++i) {
+		promises[i] = Promises::make_pooled<Promises::Promise>(Promises::pending_state);
+	}
+	promises[count] = Promises::Resolve<int>(count * 2);
+
+	Promises::PROM_TYPE unordered = Promises::hash_unordered<int, int>(promises);
+	Promises::PROM_TYPE sorted = Promises::hash_sorted<int, int>(promises);
+
+	for (int i = 0; i < count; ++i) {
+		Promises::Settlement(promises[i].get()).resolve<int>(i * 2);
+	}
+
+	std::unordered_map<int, int>* map = Promises::await<std::unordered_map<int, int>>(unordered);
+	BOOST_REQUIRE(map->size() == (size_t)count + 1);
+	BOOST_CHECK((*map)[0] == 0);
+	BOOST_CHECK((*map)[count] == count * 2);
+
+	//sorted by key whatever order the range was in
+	std::vector<std::pair<int, int>>* pairs = Promises::await<std::vector<std::pair<int, int>>>(sorted);
+	BOOST_REQUIRE(pairs->size() == (size_t)count + 1);
+
+	bool ordered = true;
+	for (int i = 0; i <= count; ++i) {
+		ordered = ordered && (*pairs)[i].first == i && (*pairs)[i].second == i * 2;
+	}
+	BOOST_CHECK(ordered);
+
+	//a pending rejection rejects the lot
+	std::vector<std::pair<std::string, Promises::PROM_TYPE>> entries;
+	entries.push_back(std::make_pair(std::string("a"), Promises::Resolve<int>(1)));
+	entries.push_back(std::make_pair(std::string("b"), Promises::make_pooled<Promises::Promise>(Promises::pending_state)));
+
+	typedef std::vector<std::pair<std::string, int>> PAIRS;
+
+	Promises::PROM_TYPE failed = Promises::hash_sorted<std::string, int>(entries);
+	Promises::Settlement(entries[1].second.get()).reject(Promises::Promise_Error("b"));
+	BOOST_CHECK_THROW(Promises::await<PAIRS>(failed), Promises::Promise_Error);
+}
+
+BOOST_AUTO_TEST_CASE(Promise_Hash_Bool_Test) {
+	Promises::set_continuation_policy(Promises::Inline);
+
+	//neighbouring slots settled from different threads, over a few rounds
+	const int count = 64;
+	const int threads = 4;
+	bool matched = true;
+
+	for (int round = 0; round < 50; ++round) {
+		std::vector<std::pair<int, Promises::PROM_TYPE>> entries;
+		for (int i = 0; i < count; ++i) {
+			entries.push_back(std::make_pair(i, Promises::make_pooled<Promises::Promise>(Promises::pending_state)));
+		}
+
+		Promises::PROM_TYPE prom = Promises::hash_unordered<int, bool>(entries);
+
+		std::atomic<bool> go(false);
+		std::vector<std::thread> settlers;
+		for (int t = 0; t < threads; ++t) {
+			settlers.push_back(std::thread([&entries, &go, t]() {
+				while (!go.load()) {
+					std::this_thread::yield();
+				}
+
+				for (int i = t; i < count; i += threads) {
+					Promises::Settlement(entries[i].second.get()).resolve<bool>(i % 3 == 0);
+				}
+			}));
+		}
+
+		go.store(true);
+		for (size_t t = 0; t < settlers.size(); ++t) {
+			settlers[t].join();
+		}
+
+		std::unordered_map<int, bool>* map = Promises::await<std::unordered_map<int, bool>>(prom);
+		BOOST_REQUIRE(map->size() == (size_t)count);
+
+		for (int i = 0; i < count; ++i) {
+			matched = matched && (*map)[i] == (i % 3 == 0);
+		}
+	}
+	BOOST_CHECK(matched);
+
+	Promises::set_continuation_policy(Promises::Dispatch);
+}
+
+BOOST_AUTO_TEST_CASE(Promise_Hash_Ended_Test) {
+	//an entry whose chain ends after hash() subscribed to it
+	Promises::PROM_TYPE root = Promises::make_pooled<Promises::Promise>(Promises::pending_state);
+	std::map<std::string, Promises::PROM_TYPE> promises;
+	promises["a"] = Promises::Resolve<int>(1);
+	promises["b"] = root->then([](int value) {
+	});
+
+	Promises::PROM_TYPE prom = Promises::hash<std::string, int>(promises);
+	Promises::PROM_TYPE sorted = Promises::hash_sorted<std::string, int>(promises);
+	Promises::Settlement(root.get()).resolve<int>(2);
+
+	typedef std::map<std::string, int> MAP;
+	typedef std::vector<std::pair<std::string, int>> PAIRS;
+
+	BOOST_CHECK(rejected_with<MAP>(prom) == "hash(): promise ended without a value");
+	BOOST_CHECK(rejected_with<PAIRS>(sorted) == "hash(): promise ended without a value");
+}
+
+BOOST_AUTO_TEST_CASE(Long_Chain_Test) {
+	//far more links than the default pool has workers
+	std::vector<Promises::PROM_TYPE> links;
+	links.push_back(Promises::Resolve<int>(0));
+
+	for (int i = 0; i < 500; ++i) {
+		links.push_back(links.back()->then([](int value) {
+			return Promises::Resolve<int>(value + 1);
+		}));
+	}
+
+	int* v = Promises::await<int>(links.back());
+	BOOST_CHECK(*v == 500);
+}
+
+//recurse - each level chains onto an already settled promise
+//from inside the previous level's handler.
+static void recurse(int level, std::atomic<int> &count) {
+	Promises::Resolve<int>(level)->then([&count](int value) {
+		count.fetch_add(1);
+		if (value > 0) {
+			recurse(value - 1, count);
+		}
+	});
+}
+
+BOOST_AUTO_TEST_CASE(Inline_Continuation_Test) {
+	Promises::set_continuation_policy(Promises::Inline);
+
+	//settled parent: the handler runs before then() returns
+	bool ran = false;
+	Promises::Resolve<int>(10)->then([&ran](int value) {
+		BOOST_CHECK(value == 10);
+		ran = true;
+	});
+	BOOST_CHECK(ran);
+
+	bool caught = false;
+	Promises::Reject(Promises::Promise_Error("IUPUI"))->_catch([&caught](const std::exception &ex) {
+		BOOST_CHECK(strcmp(ex.what(), "IUPUI") == 0);
+		caught = true;
+	});
+	BOOST_CHECK(caught);
+
+	//deeper than the depth guard: overflow goes to the microtask queue
+	//and is drained before the outermost handler returns
+	std::atomic<int> count(0);
+	recurse(1000, count);
+	BOOST_CHECK(count.load() == 1001);
+
+	Promises::set_continuation_policy(Promises::Dispatch);
+	BOOST_CHECK(Promises::continuation_policy() == Promises::Dispatch);
+}
+
+BOOST_AUTO_TEST_CASE(Settle_Race_Test) {
+	Promises::PROM_TYPE prom = std::make_shared<Promises::Promise>(Promises::pending_state);
+	std::atomic<int> fired(0);
+	std::vector<Promises::PROM_TYPE> continuations[4];
+	std::vector<std::thread> threads;
+
+	//registration races against settlement, every continuation runs once
+	for (int t = 0; t < 4; ++t) {
+		threads.push_back(std::thread([&prom, &fired, &continuations, t]() {
+			for (int i = 0; i < 50; ++i) {
+				continuations[t].push_back(prom->then([&fired](int value) {
+					fired.fetch_add(1);
+				}));
+			}
+		}));
+	}
+
+	//first settlement wins
+	threads.push_back(std::thread([&prom]() {
+		Promises::Settlement(prom.get()).resolve<int>(1);
+	}));
+	threads.push_back(std::thread([&prom]() {
+		Promises::Settlement(prom.get()).resolve<int>(2);
+	}));
+
+	for (size_t i = 0; i < threads.size(); ++i) {
+		threads[i].join();
+	}
+
+	int* v = Promises::await<int>(prom);
+	BOOST_CHECK(*v == 1 || *v == 2);
+
+	//handlers are dispatched, wait for every one of them
+	for (int t = 0; t < 4; ++t) {
+		for (size_t i = 0; i < continuations[t].size(); ++i) {
+			Promises::await<void>(continuations[t][i]);
+		}
+		continuations[t].clear();
+	}
+
+	BOOST_CHECK(fired.load() == 200);
+}
+
+BOOST_AUTO_TEST_CASE(Throwing_Handler_Test) {
+	//a handler that throws rejects its promise with that exception
+	Promises::PROM_TYPE settled = promise([](Promises::Settlement settle) {
+		throw std::out_of_range("settle");
+	});
+	BOOST_CHECK_THROW(Promises::await<int>(settled), std::out_of_range);
+
+	Promises::PROM_TYPE resolved = Promises::Resolve<int>(1)->then([](int value) -> Promises::PROM_TYPE {
+		throw std::logic_error("then");
+	});
+	BOOST_CHECK_THROW(Promises::await<int>(resolved), std::logic_error);
+
+	//and the rest of the chain sees it
+	Promises::PROM_TYPE caught = resolved->_catch([](const std::exception &ex) {
+		return Promises::Resolve<std::string>(ex.what());
+	});
+	BOOST_CHECK(*Promises::await<std::string>(caught) == "then");
+
+	Promises::PROM_TYPE rethrown = Promises::Reject(std::logic_error("no"))->_catch([](const std::exception &ex) -> Promises::PROM_TYPE {
+		throw 7;
+	});
+	try {
+		Promises::await<int>(rethrown);
+		BOOST_CHECK(false);
+	} catch (int thrown) {
+		BOOST_CHECK(thrown == 7);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Release_After_Handler_Test) {
+	//dropped right after await, while the worker may still be leaving
+	//the handler; with plain new/delete a stale access is a real one
+	Promises::set_memory_resource(&Promises::new_delete_resource::instance());
+
+	for (int i = 0; i < 2000; ++i) {
+		Promises::PROM_TYPE prom = promise([i](Promises::Settlement settle) {
+			settle.resolve<int>(i);
+		});
+
+		BOOST_CHECK(*Promises::await<int>(prom) == i);
+		prom.reset();
+	}
+
+	Promises::set_memory_resource(nullptr);
+}
+
+//Tracked - counts copies, so tests can tell a move from a copy.
+struct Tracked {
+	Tracked(int v)
+		:value(v)
+	{ }
+
+	Tracked(const Tracked &other)
+		:value(other.value)
+	{
+		++copies();
+	}
+
+	Tracked(Tracked &&other)
+		:value(other.value)
+	{ }
+
+	static int& copies(void) {
+		static int count = 0;
+		return count;
+	}
+
+	int value;
+};
+
+BOOST_AUTO_TEST_CASE(Move_Only_Test) {
+	Promises::set_continuation_policy(Promises::Inline);
+
+	Promises::PROM_TYPE prom = promise([](Promises::Settlement settle) {
+		settle.resolve(std::unique_ptr<int>(new int(8)));
+	});
+
+	std::unique_ptr<int>* p = Promises::await<std::unique_ptr<int>>(prom);
+	BOOST_CHECK(**p == 8);
+
+	//a const reference handler reads the value in place
+	const std::unique_ptr<int>* address = nullptr;
+	Promises::PROM_TYPE read = prom->then([&address](const std::unique_ptr<int> &value) {
+		address = &value;
+	});
+
+	Promises::await<int>(read);
+	BOOST_CHECK(address == p);
+
+	Promises::set_continuation_policy(Promises::Dispatch);
+}
+
+BOOST_AUTO_TEST_CASE(No_Copy_Test) {
+	Promises::set_continuation_policy(Promises::Inline);
+	Tracked::copies() = 0;
+
+	int seen = 0;
+	Promises::Resolve(Tracked(5))->then([&seen](const Tracked &t) {
+		seen = t.value;
+	});
+	BOOST_CHECK(seen == 5);
+	BOOST_CHECK(Tracked::copies() == 0);
+
+	//the parent still holds the value: a by-value handler gets its own copy
+	Promises::PROM_TYPE shared = Promises::Resolve(Tracked(7));
+	shared->then([&seen](Tracked t) {
+		seen = t.value;
+	});
+	BOOST_CHECK(seen == 7);
+	BOOST_CHECK(Tracked::copies() == 1);
+
+	Promises::set_continuation_policy(Promises::Dispatch);
+}
+
+//AddOwned - a handler holding a move-only value, which C++11 lambdas cannot capture.
+struct AddOwned {
+	std::unique_ptr<int> offset;
+
+	Promises::IPROM_TYPE operator()(int value) const {
+		return Promises::Resolve<int>(value + *offset);
+	}
+};
+
+BOOST_AUTO_TEST_CASE(Move_Only_Handler_Test) {
+	//handlers are moved into the promise, never copied
+	AddOwned add;
+	add.offset.reset(new int(5));
+
+	Promises::PROM_TYPE prom = Promises::Resolve<int>(10)->then(std::move(add));
+	BOOST_CHECK(*Promises::await<int>(prom) == 15);
+}
+
+BOOST_AUTO_TEST_CASE(Mutable_Ref_Handler_Test) {
+	//T& handlers on one parent each change a value of their own
+	Promises::PROM_TYPE root = Promises::make_pooled<Promises::Promise>(Promises::pending_state);
+
+	Promises::PROM_TYPE first = root->then([](std::string &value) {
+		value += "a";
+		return Promises::Resolve<std::string>(value);
+	});
+	Promises::PROM_TYPE second = root->then([](std::string &value) {
+		value += "b";
+		return Promises::Resolve<std::string>(value);
+	});
+
+	Promises::Settlement(root.get()).resolve<std::string>(std::string("x"));
+
+	BOOST_CHECK(*Promises::await<std::string>(first) == "xa");
+	BOOST_CHECK(*Promises::await<std::string>(second) == "xb");
+	BOOST_CHECK(*Promises::await<std::string>(root) == "x");
+}
+
+BOOST_AUTO_TEST_CASE(Rejection_Type_Test) {
+	Promises::PROM_TYPE root = Promises::make_pooled<Promises::Promise>(Promises::pending_state);
+	Promises::PROM_TYPE link = root->then([](int value) {
+		return Promises::Resolve<int>(value + 1);
+	})->then([](int value) {
+		return Promises::Resolve<int>(value + 1);
+	});
+
+	bool typed = false;
+	Promises::PROM_TYPE caught = link->_catch([&typed](const std::exception &ex) {
+		typed = dynamic_cast<const std::out_of_range*>(&ex) != nullptr;
+	});
+
+	Promises::Settlement(root.get()).reject(std::out_of_range("range"));
+
+	//the rejection passes down the chain as the same state
+	BOOST_CHECK_THROW(Promises::await<int>(link), std::out_of_range);
+	BOOST_CHECK(link->get_state() == root->get_state());
+
+	Promises::await<void>(caught);
+	BOOST_CHECK(typed);
+
+	std::vector<Promises::PROM_TYPE> promises;
+	promises.push_back(Promises::make_pooled<Promises::Promise>(Promises::pending_state));
+	Promises::PROM_TYPE all = Promises::all<int>(promises);
+	Promises::Settlement(promises[0].get()).reject(std::length_error("length"));
+	BOOST_CHECK_THROW(Promises::await<std::vector<int>>(all), std::length_error);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
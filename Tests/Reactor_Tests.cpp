@@ -0,0 +1,188 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "../Reactor.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <string>
+#include <system_error>
+#include <thread>
+
+#if defined(__linux__)
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+BOOST_AUTO_TEST_SUITE(REACTOR_SUITE)
+
+static void nonblocking(int fd) {
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+}
+
+BOOST_AUTO_TEST_CASE(Pipe_Read_Test) {
+	int fds[2];
+	BOOST_REQUIRE(pipe(fds) == 0);
+	nonblocking(fds[0]);
+
+	Promises::PROM_TYPE ready = Promises::readable(fds[0]);
+	Promises::PROM_TYPE read = Promises::async_read(fds[0], 64);
+
+	//nothing to read yet
+	std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	BOOST_CHECK(*ready->get_state() == Promises::Pending);
+
+	BOOST_REQUIRE(write(fds[1], "hello", 5) == 5);
+	BOOST_CHECK(*Promises::await<int>(ready) == fds[0]);
+	BOOST_CHECK(*Promises::await<std::string>(read) == "hello");
+
+	//end of file is an empty read
+	close(fds[1]);
+	BOOST_CHECK(Promises::await<std::string>(Promises::async_read(fds[0], 64))->empty());
+
+	close(fds[0]);
+}
+
+BOOST_AUTO_TEST_CASE(Socketpair_Write_Test) {
+	int fds[2];
+	BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+	nonblocking(fds[0]);
+	nonblocking(fds[1]);
+
+	BOOST_CHECK(*Promises::await<int>(Promises::writable(fds[0])) == fds[0]);
+
+	//far more than the socket buffer, so the write has to wait on the reader
+	std::string data(4 << 20, 'x');
+	for (size_t i = 0; i < data.size(); i += 4096) {
+		data[i] = (char)('a' + (i / 4096) % 26);
+	}
+
+	Promises::PROM_TYPE written = Promises::async_write(fds[0], data);
+
+	std::string received;
+	while (received.size() < data.size()) {
+		received += *Promises::await<std::string>(Promises::async_read(fds[1], 65536));
+	}
+
+	BOOST_CHECK(*Promises::await<size_t>(written) == data.size());
+	BOOST_CHECK(received == data);
+
+	//the peer is gone: EPIPE, not SIGPIPE
+	close(fds[1]);
+	BOOST_CHECK_THROW(Promises::await<size_t>(Promises::async_write(fds[0], "late")), std::system_error);
+
+	close(fds[0]);
+}
+
+BOOST_AUTO_TEST_CASE(Loopback_Test) {
+	int listener = socket(AF_INET, SOCK_STREAM, 0);
+	BOOST_REQUIRE(listener >= 0);
+
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = 0;
+
+	BOOST_REQUIRE(bind(listener, (sockaddr*)&addr, sizeof(addr)) == 0);
+	BOOST_REQUIRE(listen(listener, 4) == 0);
+
+	socklen_t len = sizeof(addr);
+	BOOST_REQUIRE(getsockname(listener, (sockaddr*)&addr, &len) == 0);
+	nonblocking(listener);
+
+	Promises::PROM_TYPE incoming = Promises::readable(listener);
+
+	int client = socket(AF_INET, SOCK_STREAM, 0);
+	nonblocking(client);
+	int rc = connect(client, (sockaddr*)&addr, sizeof(addr));
+	BOOST_REQUIRE(rc == 0 || errno == EINPROGRESS);
+
+	//connected once writable
+	Promises::await<int>(Promises::writable(client));
+	Promises::await<int>(incoming);
+
+	int server = accept(listener, nullptr, nullptr);
+	BOOST_REQUIRE(server >= 0);
+	nonblocking(server);
+
+	Promises::PROM_TYPE request = Promises::async_read(server, 16);
+	BOOST_CHECK(*Promises::await<size_t>(Promises::async_write(client, "ping")) == 4);
+	BOOST_CHECK(*Promises::await<std::string>(request) == "ping");
+
+	Promises::PROM_TYPE reply = Promises::async_read(client, 16)->then([](const std::string &data) {
+		return Promises::Resolve<std::string>(data + "!");
+	});
+	Promises::await<size_t>(Promises::async_write(server, "pong"));
+	BOOST_CHECK(*Promises::await<std::string>(reply) == "pong!");
+
+	close(server);
+	close(client);
+	close(listener);
+}
+
+BOOST_AUTO_TEST_CASE(Forget_Test) {
+	int fds[2];
+	BOOST_REQUIRE(pipe(fds) == 0);
+	nonblocking(fds[0]);
+
+	Promises::Reactor reactor;
+	Promises::PROM_TYPE first = reactor.readable(fds[0]);
+	Promises::PROM_TYPE second = reactor.async_read(fds[0], 16);
+	BOOST_CHECK(reactor.watched() == 1);
+
+	reactor.forget(fds[0]);
+	BOOST_CHECK(reactor.watched() == 0);
+	BOOST_CHECK_THROW(Promises::await<int>(first), Promises::Cancelled);
+	BOOST_CHECK_THROW(Promises::await<std::string>(second), Promises::Cancelled);
+
+	//dropped when the reactor goes away, too
+	Promises::PROM_TYPE last;
+	{
+		Promises::Reactor scoped;
+		last = scoped.readable(fds[0]);
+	}
+	BOOST_CHECK_THROW(Promises::await<int>(last), Promises::Cancelled);
+
+	close(fds[0]);
+	close(fds[1]);
+}
+
+BOOST_AUTO_TEST_CASE(Refused_Test) {
+	//epoll does not take regular files
+	char path[] = "/tmp/reactor_test_XXXXXX";
+	int fd = mkstemp(path);
+	BOOST_REQUIRE(fd >= 0);
+	unlink(path);
+
+	try {
+		Promises::await<int>(Promises::readable(fd));
+		BOOST_CHECK(false);
+	} catch (const std::system_error &ex) {
+		BOOST_CHECK(ex.code().value() == EPERM);
+	}
+
+	close(fd);
+}
+
+BOOST_AUTO_TEST_CASE(Reactor_Executor_Test) {
+	Promises::Reactor reactor;
+	std::atomic<std::thread::id> ran_on;
+	std::atomic<bool> done(false);
+
+	reactor.submit([&ran_on, &done]() {
+		ran_on = std::this_thread::get_id();
+		done = true;
+	});
+
+	while (!done) {
+		std::this_thread::yield();
+	}
+
+	BOOST_CHECK(ran_on.load() != std::this_thread::get_id());
+	BOOST_CHECK(!reactor.try_run_pending());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+#endif
@@ -0,0 +1,125 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "../Scheduler.h"
+#include <atomic>
+#include <cstring>
+#include <memory>
+
+BOOST_AUTO_TEST_SUITE(SCHEDULER_SUITE)
+
+BOOST_AUTO_TEST_CASE(WorkDeque_Owner_Test) {
+	Promises::WorkDeque deque(2);
+	std::vector<Promises::TASK_TYPE*> tasks;
+
+	//push past the initial capacity to force a grow
+	for (int i = 0; i < 10; ++i) {
+		tasks.push_back(Promises::pool_new<Promises::TASK_TYPE>());
+		deque.push(tasks.back());
+	}
+
+	BOOST_CHECK(!deque.empty());
+
+	//owner takes newest first, thieves oldest first
+	BOOST_CHECK(deque.take() == tasks[9]);
+	BOOST_CHECK(deque.steal() == tasks[0]);
+
+	size_t taken = 2;
+	while (deque.take() != nullptr) {
+		++taken;
+	}
+
+	BOOST_CHECK(taken == tasks.size());
+	BOOST_CHECK(deque.empty());
+	BOOST_CHECK(deque.steal() == nullptr);
+
+	for (size_t i = 0; i < tasks.size(); ++i) {
+		Promises::pool_delete(tasks[i]);
+	}
+}
+
+BOOST_AUTO_TEST_CASE(WorkDeque_Steal_Test) {
+	Promises::WorkDeque deque;
+	std::atomic<int> stolen(0);
+	std::atomic<bool> done(false);
+	const int count = 100000;
+
+	std::vector<std::thread> thieves;
+	for (int i = 0; i < 3; ++i) {
+		thieves.push_back(std::thread([&]() {
+			while (!done.load() || !deque.empty()) {
+				Promises::TASK_TYPE* task = deque.steal();
+				if (task != nullptr) {
+					Promises::pool_delete(task);
+					stolen.fetch_add(1);
+				}
+			}
+		}));
+	}
+
+	int taken = 0;
+	for (int i = 0; i < count; ++i) {
+		deque.push(Promises::pool_new<Promises::TASK_TYPE>());
+
+		if (i % 3 == 0) {
+			Promises::TASK_TYPE* task = deque.take();
+			if (task != nullptr) {
+				Promises::pool_delete(task);
+				++taken;
+			}
+		}
+	}
+
+	done.store(true);
+	for (size_t i = 0; i < thieves.size(); ++i) {
+		thieves[i].join();
+	}
+
+	//every task is handed out exactly once
+	BOOST_CHECK(taken + stolen.load() == count);
+}
+
+BOOST_AUTO_TEST_CASE(WorkStealingPool_Fan_Out_Test) {
+	std::atomic<int> count(0);
+
+	{
+		Promises::WorkStealingPool pool(Promises::ExecutorConfig(4));
+		BOOST_CHECK(pool.size() == 4);
+
+		//one root task fans out onto its worker's deque,
+		//the other workers have to steal to help
+		pool.submit([&count, &pool]() {
+			for (int i = 0; i < 1000; ++i) {
+				pool.submit([&count, &pool]() {
+					pool.submit([&count]() {
+						count.fetch_add(1);
+					});
+				});
+			}
+		});
+	}
+
+	BOOST_CHECK(count.load() == 1000);
+}
+
+BOOST_AUTO_TEST_CASE(WorkStealingPool_Try_Run_Pending_Test) {
+	Promises::WorkStealingPool pool(Promises::ExecutorConfig(2));
+
+	//not a worker of this pool
+	BOOST_CHECK(!pool.try_run_pending());
+}
+
+BOOST_AUTO_TEST_CASE(Default_Executor_Test) {
+	Promises::IExecutor* exec = Promises::default_executor();
+	BOOST_CHECK(exec != nullptr);
+	BOOST_CHECK(exec == Promises::default_executor());
+
+	try {
+		Promises::set_default_executor(nullptr);
+	} catch (const std::exception &ex) {
+		BOOST_CHECK(strcmp(ex.what(), "set_default_executor(): executor is null") == 0);
+	}
+
+	BOOST_CHECK(exec == Promises::default_executor());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,6 +3,7 @@
 #include "../State.h"
 #include <cstring>
 #include <iostream>
+#include <stdexcept>
 
 BOOST_AUTO_TEST_SUITE(STATE_SUITE)
 
@@ -47,6 +48,18 @@ BOOST_AUTO_TEST_CASE(Rejected_Constructor_Test) {
     BOOST_CHECK(strcmp(rejected3.get_reason().what(), "test") == 0);
 }
 
+BOOST_AUTO_TEST_CASE(Exception_Ptr_Test) {
+	Promises::RejectedState rejected(std::make_exception_ptr(std::out_of_range("range")));
+	Promises::RejectedState copy(rejected);
+
+	BOOST_CHECK_THROW(rejected.rethrow(), std::out_of_range);
+	BOOST_CHECK(strcmp(rejected.get_reason().what(), "range") == 0);
+	BOOST_CHECK(strcmp(copy.get_reason().what(), "range") == 0);
+
+	Promises::RejectedState unknown((std::exception_ptr()));
+	BOOST_CHECK(strcmp(unknown.get_reason().what(), "unknown exception") == 0);
+}
+
 BOOST_AUTO_TEST_CASE(Copy_Constructor_Test) {
 	char c = '$';
     Promises::ResolvedState<char> resolved(c);
@@ -99,4 +112,26 @@ BOOST_AUTO_TEST_CASE(Inequality_Test) {
 	BOOST_CHECK(resolved != rejected);
 	BOOST_CHECK(rejected != resolved);
 }
+
+BOOST_AUTO_TEST_CASE(Rejected_Type_Test) {
+	Promises::RejectedState rejected(std::out_of_range("range"));
+	Promises::RejectedState copy_rejected(rejected);
+
+	//copies share one reason, still of the type it was rejected with
+	BOOST_CHECK(&copy_rejected.get_reason() == &rejected.get_reason());
+	BOOST_CHECK(dynamic_cast<const std::out_of_range*>(&rejected.get_reason()) != nullptr);
+	BOOST_CHECK_THROW(copy_rejected.rethrow(), std::out_of_range);
+
+	//a plain std::exception reference keeps its message
+	const std::exception &base = std::invalid_argument("base");
+	Promises::RejectedState sliced(base);
+	BOOST_CHECK(strcmp(sliced.get_reason().what(), "base") == 0);
+	BOOST_CHECK_THROW(sliced.rethrow(), Promises::Promise_Error);
+
+	//an exception_ptr is rethrown as is
+	Promises::RejectedState caught(std::make_exception_ptr(std::overflow_error("caught")));
+	BOOST_CHECK(strcmp(caught.get_reason().what(), "caught") == 0);
+	BOOST_CHECK_THROW(caught.rethrow(), std::overflow_error);
+	BOOST_CHECK_THROW(std::rethrow_exception(rejected.get_error()), std::out_of_range);
+}
 BOOST_AUTO_TEST_SUITE_END()
\ No newline at end of file
@@ -0,0 +1,200 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "../Promise.h"
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(TIMER_SUITE)
+
+typedef std::chrono::steady_clock test_clock;
+
+static Promises::PROM_TYPE pending(void) {
+	return Promises::make_pooled<Promises::Promise>(Promises::pending_state);
+}
+
+//Stamp - a timer that records when it fired.
+struct Stamp : public Promises::TimerNode {
+	Stamp(void)
+		:Promises::TimerNode(&Stamp::_fire),
+		fired(false)
+	{ }
+
+	std::atomic<bool> fired;
+	test_clock::time_point at;
+
+	static void _fire(Promises::TimerNode* node) {
+		Stamp* self = static_cast<Stamp*>(node);
+		self->at = test_clock::now();
+		self->fired.store(true, std::memory_order_release);
+	}
+};
+
+BOOST_AUTO_TEST_CASE(TimerWheel_Order_Test) {
+	Promises::TimerWheel wheel;
+	std::vector<Stamp> stamps(6);
+
+	//spread over level 0 and level 1, never early
+	const int ms[] = { 40, 1, 300, 0, 5, 260 };
+	test_clock::time_point start = test_clock::now();
+
+	for (size_t i = 0; i < stamps.size(); ++i) {
+		wheel.schedule(&stamps[i], start + std::chrono::milliseconds(ms[i]));
+	}
+	BOOST_CHECK(wheel.pending() == stamps.size());
+
+	for (size_t i = 0; i < stamps.size(); ++i) {
+		while (!stamps[i].fired.load(std::memory_order_acquire)) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		BOOST_CHECK(stamps[i].at >= start + std::chrono::milliseconds(ms[i]));
+	}
+
+	BOOST_CHECK(wheel.pending() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(TimerWheel_Cancel_Test) {
+	Promises::TimerWheel wheel;
+	Stamp kept;
+	Stamp dropped;
+
+	test_clock::time_point start = test_clock::now();
+	wheel.schedule(&kept, start + std::chrono::milliseconds(20));
+	wheel.schedule(&dropped, start + std::chrono::milliseconds(10));
+
+	BOOST_CHECK(wheel.cancel(&dropped));
+	BOOST_CHECK(!wheel.cancel(&dropped));
+
+	while (!kept.fired.load(std::memory_order_acquire)) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	//too late to cancel once it fired
+	BOOST_CHECK(!wheel.cancel(&kept));
+	BOOST_CHECK(!dropped.fired.load());
+}
+
+BOOST_AUTO_TEST_CASE(TimerWheel_Many_Test) {
+	//a thread per timer would never get here
+	Promises::TimerWheel wheel;
+	std::vector<Stamp> stamps(100000);
+	test_clock::time_point start = test_clock::now();
+
+	for (size_t i = 0; i < stamps.size(); ++i) {
+		wheel.schedule(&stamps[i], start + std::chrono::milliseconds(100 + (int)(i % 300)));
+	}
+
+	//cancel every other one
+	size_t cancelled = 0;
+	for (size_t i = 0; i < stamps.size(); i += 2) {
+		cancelled += wheel.cancel(&stamps[i]) ? 1 : 0;
+	}
+
+	while (wheel.pending() != 0) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
+
+	size_t fired = 0;
+	for (size_t i = 0; i < stamps.size(); ++i) {
+		fired += stamps[i].fired.load() ? 1 : 0;
+	}
+	BOOST_CHECK(fired == stamps.size() - cancelled);
+	BOOST_CHECK(cancelled > 0);
+}
+
+BOOST_AUTO_TEST_CASE(Delay_Test) {
+	test_clock::time_point start = test_clock::now();
+
+	Promises::PROM_TYPE prom = Promises::delay(std::chrono::milliseconds(20), 5);
+	BOOST_CHECK(*Promises::await<int>(prom) == 5);
+	BOOST_CHECK(test_clock::now() - start >= std::chrono::milliseconds(20));
+
+	Promises::PROM_TYPE next = Promises::delay(std::chrono::milliseconds(1))->then([](bool fired) {
+		return Promises::Resolve<int>(fired ? 1 : 0);
+	});
+	BOOST_CHECK(*Promises::await<int>(next) == 1);
+}
+
+BOOST_AUTO_TEST_CASE(Timeout_Test) {
+	//never settles in time
+	Promises::PROM_TYPE slow = pending();
+	Promises::PROM_TYPE timed = Promises::timeout<int>(slow, std::chrono::milliseconds(10));
+	BOOST_CHECK_THROW(Promises::await<int>(timed), Promises::Timeout);
+
+	//settling late changes nothing
+	Promises::Settlement(slow.get()).resolve<int>(1);
+	BOOST_CHECK_THROW(Promises::await<int>(timed), Promises::Timeout);
+
+	//settles first: the value or the rejection goes through
+	Promises::PROM_TYPE fast = pending();
+	Promises::PROM_TYPE beat = Promises::timeout<int>(fast, std::chrono::seconds(60));
+	Promises::Settlement(fast.get()).resolve<int>(7);
+	BOOST_CHECK(*Promises::await<int>(beat) == 7);
+
+	Promises::PROM_TYPE failing = pending();
+	Promises::PROM_TYPE failed = Promises::timeout<int>(failing, std::chrono::seconds(60));
+	Promises::Settlement(failing.get()).reject(std::out_of_range("no"));
+	BOOST_CHECK_THROW(Promises::await<int>(failed), std::out_of_range);
+
+	//already settled
+	BOOST_CHECK(*Promises::await<int>(Promises::timeout<int>(Promises::Resolve<int>(3), std::chrono::milliseconds(0))) == 3);
+}
+
+BOOST_AUTO_TEST_CASE(Timeout_Ended_Test) {
+	//a chain that ends after timeout() subscribed rejects it right away
+	Promises::PROM_TYPE root = pending();
+	Promises::PROM_TYPE timed = Promises::timeout<int>(root->then([](int) {
+	}), std::chrono::hours(1));
+
+	test_clock::time_point start = test_clock::now();
+	Promises::Settlement(root.get()).resolve<int>(1);
+
+	try {
+		Promises::await_until<int>(timed, start + std::chrono::seconds(5));
+		BOOST_ERROR("timeout() resolved without a value");
+	} catch (const Promises::Timeout &ex) {
+		BOOST_ERROR("timeout() waited for its deadline");
+	} catch (const Promises::Promise_Error &ex) {
+		BOOST_CHECK(std::string(ex.what()) == "timeout(): promise ended without a value");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Timeout_Disarm_Test) {
+	//a timeout beaten by its promise is off the wheel right away
+	size_t before = Promises::timers().pending();
+
+	Promises::PROM_TYPE fast = pending();
+	Promises::PROM_TYPE beat = Promises::timeout<int>(fast, std::chrono::hours(24 * 365));
+	BOOST_CHECK(Promises::timers().pending() >= before + 1);
+
+	Promises::Settlement(fast.get()).resolve<int>(2);
+	BOOST_CHECK(*Promises::await<int>(beat) == 2);
+
+	while (Promises::timers().pending() > before) {
+		std::this_thread::yield();
+	}
+	BOOST_CHECK(Promises::timers().pending() == before);
+}
+
+BOOST_AUTO_TEST_CASE(Await_For_Test) {
+	Promises::PROM_TYPE slow = pending();
+
+	test_clock::time_point start = test_clock::now();
+	BOOST_CHECK_THROW(Promises::await_for<int>(slow, std::chrono::milliseconds(20)), Promises::Timeout);
+	BOOST_CHECK(test_clock::now() - start >= std::chrono::milliseconds(20));
+
+	//slow is untouched, and can still be awaited
+	Promises::Settlement(slow.get()).resolve<int>(4);
+	BOOST_CHECK(*Promises::await_for<int>(slow, std::chrono::milliseconds(0)) == 4);
+
+	Promises::PROM_TYPE later = Promises::delay(std::chrono::milliseconds(5), 6);
+	BOOST_CHECK(*Promises::await_until<int>(later, test_clock::now() + std::chrono::seconds(60)) == 6);
+
+	Promises::PROM_TYPE failing = Promises::Reject(std::logic_error("no"));
+	BOOST_CHECK_THROW(Promises::await_for<int>(failing, std::chrono::seconds(1)), std::logic_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
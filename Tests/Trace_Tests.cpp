@@ -0,0 +1,110 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "../Trace.h"
+#include "../Typed.h"
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static size_t count_of(const std::vector<Promises::Trace::Event> &events, int kind, uint64_t id) {
+	size_t n = 0;
+
+	for (size_t i = 0; i < events.size(); ++i) {
+		if (events[i].kind == kind && events[i].id == id) {
+			++n;
+		}
+	}
+
+	return n;
+}
+
+BOOST_AUTO_TEST_SUITE(TRACE_SUITE)
+
+BOOST_AUTO_TEST_CASE(Trace_Ring_Test) {
+	Promises::Trace::clear();
+
+	uint64_t parent = Promises::Trace::created();
+	uint64_t child = Promises::Trace::created();
+	Promises::Trace::record(Promises::Trace::Chained, child, parent);
+
+	//another thread gets a ring of its own
+	std::thread other([child]() {
+		Promises::Trace::record(Promises::Trace::HandlerBegin, child);
+		Promises::Trace::record(Promises::Trace::HandlerEnd, child);
+	});
+	other.join();
+
+	Promises::Trace::record(Promises::Trace::Settled, child, 0, Promises::Resolved);
+
+	std::vector<Promises::Trace::Event> events = Promises::Trace::events();
+	BOOST_CHECK(count_of(events, Promises::Trace::Created, parent) == 1);
+	BOOST_CHECK(count_of(events, Promises::Trace::Chained, child) == 1);
+	BOOST_CHECK(count_of(events, Promises::Trace::HandlerBegin, child) == 1);
+	BOOST_CHECK(count_of(events, Promises::Trace::Settled, child) == 1);
+
+	bool ordered = true;
+	unsigned main_tid = 0;
+	unsigned other_tid = 0;
+
+	for (size_t i = 0; i < events.size(); ++i) {
+		ordered = ordered && (i == 0 || events[i - 1].time <= events[i].time);
+
+		if (events[i].kind == Promises::Trace::Chained && events[i].id == child) {
+			BOOST_CHECK(events[i].other == parent);
+			main_tid = events[i].tid;
+		} else if (events[i].kind == Promises::Trace::HandlerBegin && events[i].id == child) {
+			other_tid = events[i].tid;
+		}
+	}
+
+	BOOST_CHECK(ordered);
+	BOOST_CHECK(main_tid != other_tid);
+
+	std::ostringstream json;
+	Promises::Trace::write_chrome_trace(json);
+	BOOST_CHECK(json.str().find("{\"traceEvents\":[") == 0);
+	BOOST_CHECK(json.str().find("\"outcome\":\"resolved\"") != std::string::npos);
+
+	//cleared events stay out of later exports
+	Promises::Trace::clear();
+	BOOST_CHECK(count_of(Promises::Trace::events(), Promises::Trace::Created, parent) == 0);
+}
+
+#ifdef PROMISE_TRACE
+BOOST_AUTO_TEST_CASE(Trace_Chain_Test) {
+	Promises::Trace::clear();
+
+	Promises::PROM_TYPE root = Promises::make_pooled<Promises::Promise>(Promises::pending_state);
+	Promises::PROM_TYPE next = root->then([](int value) {
+		return Promises::Resolve<int>(value + 1);
+	});
+
+	Promises::Settlement(root.get()).resolve<int>(1);
+	Promises::await<int>(next);
+
+	Promises::Typed::Promise<int> typed = Promises::Typed::Resolve(1).then([](int value) {
+		return value + 1;
+	});
+	Promises::Typed::await(typed);
+
+	std::vector<Promises::Trace::Event> events = Promises::Trace::events();
+	size_t chained = 0;
+	size_t handled = 0;
+	size_t awaited = 0;
+
+	//a handler settles its promise before it records HandlerEnd,
+	//so await() can return first
+	for (size_t i = 0; i < events.size(); ++i) {
+		chained += (events[i].kind == Promises::Trace::Chained);
+		handled += (events[i].kind == Promises::Trace::HandlerBegin);
+		awaited += (events[i].kind == Promises::Trace::AwaitEnd);
+	}
+
+	BOOST_CHECK(chained >= 2);
+	BOOST_CHECK(handled >= 2);
+	BOOST_CHECK(awaited >= 2);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
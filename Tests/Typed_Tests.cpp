@@ -0,0 +1,209 @@
+#define BOOST_TEST_DYN_LINK
+#include <boost/test/unit_test.hpp>
+#include "../Typed.h"
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+BOOST_AUTO_TEST_SUITE(TYPED_SUITE)
+
+BOOST_AUTO_TEST_CASE(Then_Test) {
+	Promises::Typed::Promise<int> root = Promises::Typed::promise<int>([](Promises::Typed::Settlement<int> settle) {
+		settle.resolve(20);
+	});
+
+	Promises::Typed::Promise<std::string> prom = root.then([](int value) {
+		return value + 1;
+	}).then([](int value) {
+		return std::to_string(value * 2);
+	});
+
+	static_assert(std::is_same<decltype(prom), Promises::Typed::Promise<std::string>>::value, "then() deduces the next type");
+
+	std::string* v = Promises::Typed::await(prom);
+	BOOST_CHECK(*v == "42");
+}
+
+BOOST_AUTO_TEST_CASE(Unwrap_Test) {
+	Promises::Typed::Promise<double> prom = Promises::Typed::Resolve(2).then([](int value) {
+		return Promises::Typed::promise<double>([value](Promises::Typed::Settlement<double> settle) {
+			settle.resolve(value * 1.5);
+		});
+	});
+
+	double* v = Promises::Typed::await(prom);
+	BOOST_CHECK(*v == 3.0);
+}
+
+BOOST_AUTO_TEST_CASE(Void_Test) {
+	int seen = 0;
+
+	Promises::Typed::Promise<void> prom = Promises::Typed::Resolve(5).then([&seen](int value) {
+		seen = value;
+	});
+
+	Promises::Typed::Promise<int> after = prom.then([&seen]() {
+		return seen + 1;
+	});
+
+	BOOST_CHECK(*Promises::Typed::await(after) == 6);
+	BOOST_CHECK(seen == 5);
+}
+
+BOOST_AUTO_TEST_CASE(Reject_Test) {
+	Promises::Typed::Promise<int> failed = Promises::Typed::Resolve(1).then([](int) -> int {
+		throw Promises::Promise_Error("handler failed");
+	}).then([](int value) {
+		//skipped, the rejection passes through
+		return value + 100;
+	});
+
+	BOOST_CHECK_THROW(Promises::Typed::await(failed), Promises::Promise_Error);
+
+	Promises::Typed::Promise<int> recovered = failed._catch([](const std::exception &ex) {
+		return std::string(ex.what()) == "handler failed" ? 7 : 0;
+	});
+
+	BOOST_CHECK(*Promises::Typed::await(recovered) == 7);
+}
+
+BOOST_AUTO_TEST_CASE(Reject_Type_Test) {
+	//a rejection comes back as the type it was rejected with
+	BOOST_CHECK_THROW(Promises::Typed::await(Promises::Typed::Reject<int>(std::out_of_range("range"))), std::out_of_range);
+
+	Promises::Typed::Promise<int> prom = Promises::Typed::promise<int>([](Promises::Typed::Settlement<int> settle) {
+		settle.reject(std::length_error("length"));
+	});
+	BOOST_CHECK_THROW(Promises::Typed::await(prom), std::length_error);
+
+	//behind a plain std::exception reference only the message is kept
+	const std::exception &base = std::logic_error("base");
+	Promises::Typed::Promise<void> done = Promises::Typed::promise<void>([&base](Promises::Typed::Settlement<void> settle) {
+		settle.reject(base);
+	});
+
+	try {
+		Promises::Typed::await(done);
+		BOOST_CHECK(false);
+	} catch (const Promises::Promise_Error &ex) {
+		BOOST_CHECK(std::string(ex.what()) == "base");
+	}
+}
+
+BOOST_AUTO_TEST_CASE(Then_Reject_Test) {
+	Promises::Typed::Promise<std::string> prom = Promises::Typed::Reject<int>(Promises::Promise_Error("no")).then([](int) {
+		return std::string("resolved");
+	}, [](const std::exception &ex) {
+		return std::string("rejected: ") + ex.what();
+	});
+
+	BOOST_CHECK(*Promises::Typed::await(prom) == "rejected: no");
+}
+
+BOOST_AUTO_TEST_CASE(Finally_Test) {
+	bool ran = false;
+
+	Promises::Typed::Promise<int> prom = Promises::Typed::Resolve(3).finally([&ran]() {
+		ran = true;
+	});
+
+	BOOST_CHECK(*Promises::Typed::await(prom) == 3);
+	BOOST_CHECK(ran);
+
+	BOOST_CHECK_THROW(Promises::Typed::Promise<int>().then([](int value) {
+		return value;
+	}), Promises::Promise_Error);
+}
+
+BOOST_AUTO_TEST_CASE(Typed_Chain_Test) {
+	const int depth = 500;
+	Promises::Typed::Promise<int> prom = Promises::Typed::Resolve(0);
+
+	for (int i = 0; i < depth; ++i) {
+		prom = prom.then([](int value) {
+			return value + 1;
+		});
+	}
+
+	BOOST_CHECK(*Promises::Typed::await(prom) == depth);
+}
+
+BOOST_AUTO_TEST_CASE(Mutable_Ref_Test) {
+	//T& handlers on one parent each change a value of their own
+	Promises::CorePtr<std::string> root = Promises::make_core<std::string>();
+	Promises::Typed::Promise<std::string> prom(root);
+
+	Promises::Typed::Promise<std::string> first = prom.then([](std::string &value) {
+		value += "a";
+		return value;
+	});
+	Promises::Typed::Promise<std::string> second = prom.then([](std::string &value) {
+		value += "b";
+		return value;
+	});
+
+	root->resolve(std::string("x"));
+
+	BOOST_CHECK(*Promises::Typed::await(first) == "xa");
+	BOOST_CHECK(*Promises::Typed::await(second) == "xb");
+	BOOST_CHECK(*Promises::Typed::await(prom) == "x");
+}
+
+BOOST_AUTO_TEST_CASE(Move_Only_Test) {
+	typedef std::unique_ptr<int> Box;
+
+	//each link is the only reader of its parent, so the box moves down the chain
+	Promises::Typed::Promise<Box> prom = Promises::Typed::Resolve(Box(new int(1))).then([](Box box) {
+		*box += 1;
+		return box;
+	}).then([](Box box) {
+		*box += 1;
+		return Promises::Typed::Resolve(std::move(box));
+	});
+
+	BOOST_CHECK(**Promises::Typed::await(prom) == 3);
+
+	//const reference handlers read it in place
+	int seen = 0;
+	Promises::Typed::Promise<void> done = prom.then([&seen](const Box &box) {
+		seen = *box;
+	});
+
+	Promises::Typed::await(done);
+	BOOST_CHECK(seen == 3);
+
+	//prom still holds the box, it cannot be handed over
+	Promises::Typed::Promise<int> taken = prom.then([](Box box) {
+		return *box;
+	});
+
+	BOOST_CHECK_THROW(Promises::Typed::await(taken), Promises::Promise_Error);
+}
+
+//Settler - a move-only handler with a non-const call operator.
+struct Settler {
+	explicit Settler(int v)
+		:value(new int(v))
+	{ }
+
+	void operator () (Promises::Typed::Settlement<int> settle) {
+		*value += 1;
+		settle.resolve(*value);
+	}
+
+	std::unique_ptr<int> value;
+};
+
+BOOST_AUTO_TEST_CASE(Handler_Move_Test) {
+	Promises::Typed::Promise<int> owned = Promises::Typed::promise<int>(Settler(4));
+	BOOST_CHECK(*Promises::Typed::await(owned) == 5);
+
+	int calls = 0;
+	Promises::Typed::Promise<int> counted = Promises::Typed::promise<int>([calls](Promises::Typed::Settlement<int> settle) mutable {
+		settle.resolve(++calls);
+	});
+	BOOST_CHECK(*Promises::Typed::await(counted) == 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,285 @@
+#include "Promise_Error.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+
+#ifndef TIMER_H
+#define TIMER_H
+
+//microseconds per wheel tick. A timer never fires early,
+//and late by at most one tick plus scheduling.
+#ifndef TIMER_TICK_US
+#define TIMER_TICK_US 1000
+#endif
+
+namespace Promises {
+
+	//Timeout - what timeout() rejects with, and await_for() throws.
+	class Timeout : public Promise_Error {
+	public:
+		Timeout(void)
+			:Promise_Error("timed out")
+		{ }
+	};
+
+	typedef std::chrono::steady_clock timer_clock;
+
+	//TimerNode - an intrusive entry in a TimerWheel. Unlinked nodes have
+	//a null next. fire runs once, on the timer thread, with no lock held.
+	struct TimerNode {
+		explicit TimerNode(void (*f)(TimerNode*) = nullptr)
+			:prev(nullptr),
+			next(nullptr),
+			deadline(0),
+			fire(f)
+		{ }
+
+		TimerNode* prev;
+		TimerNode* next;
+		uint64_t deadline;
+		void (*fire)(TimerNode* self);
+	};
+
+	//TimerWheel - a hierarchical timing wheel driven by one thread.
+	//Four levels of 256 slots cover 2^32 ticks, about 49 days at 1ms;
+	//later deadlines wait in the top level and go round again.
+	//Scheduling and cancelling are O(1) under one lock, and a timer moves
+	//down a level at most three times, so millions of pending timers
+	//cost one node each and no thread of their own.
+	class TimerWheel {
+	public:
+		static const size_t Levels = 4;
+		static const size_t SlotBits = 8;
+		static const size_t Slots = size_t(1) << SlotBits;
+
+		TimerWheel(void)
+			:_epoch(timer_clock::now()),
+			_now(0),
+			_count(0),
+			_firing(nullptr),
+			_sleeping_until(0),
+			_stop(false)
+		{
+			for (size_t l = 0; l < Levels; ++l) {
+				for (size_t s = 0; s < Slots; ++s) {
+					_slots[l][s].prev = &_slots[l][s];
+					_slots[l][s].next = &_slots[l][s];
+				}
+			}
+
+			_thread = std::thread(&TimerWheel::_work, this);
+		}
+
+		//timers still pending when the wheel goes away never fire
+		~TimerWheel(void) {
+			{
+				std::unique_lock<std::mutex> lock(_lock);
+				_stop = true;
+				_wake.notify_one();
+			}
+
+			_thread.join();
+		}
+
+		TimerWheel(const TimerWheel&) = delete;
+		TimerWheel& operator = (const TimerWheel&) = delete;
+
+		//schedule - fire node at when, or on the next tick if that has passed.
+		//node must not be scheduled already, and must outlive its firing or cancel().
+		void schedule(TimerNode* node, timer_clock::time_point when) {
+			std::unique_lock<std::mutex> lock(_lock);
+
+			node->deadline = _tick_of(when);
+			_insert(node);
+			++_count;
+
+			if (node->deadline < _sleeping_until) {
+				_wake.notify_one();
+			}
+		}
+
+		//cancel - true if node was taken off the wheel before firing.
+		//If it is firing right now, waits for that to finish, so the caller
+		//may free node afterwards. Never call it from node's own fire.
+		bool cancel(TimerNode* node) {
+			std::unique_lock<std::mutex> lock(_lock);
+			bool removed = node->next != nullptr;
+
+			if (removed) {
+				_unlink(node);
+				--_count;
+			}
+
+			while (_firing == node) {
+				_fired.wait(lock);
+			}
+
+			return removed;
+		}
+
+		size_t pending(void) {
+			std::unique_lock<std::mutex> lock(_lock);
+			return _count;
+		}
+
+	private:
+		timer_clock::time_point _epoch;
+
+		//_now is the next tick to process; every earlier one has fired
+		uint64_t _now;
+		size_t _count;
+		TimerNode* _firing;
+		uint64_t _sleeping_until;
+		bool _stop;
+
+		std::mutex _lock;
+		std::condition_variable _wake;
+		std::condition_variable _fired;
+		std::thread _thread;
+
+		//list heads, each slot a circular list through its sentinel
+		TimerNode _slots[Levels][Slots];
+
+		//_tick_of - the first tick at or after when, so nothing fires early.
+		uint64_t _tick_of(timer_clock::time_point when) const {
+			if (when <= _epoch) {
+				return 0;
+			}
+
+			uint64_t us = (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(when - _epoch).count();
+			return (us + TIMER_TICK_US - 1) / TIMER_TICK_US;
+		}
+
+		uint64_t _current_tick(void) const {
+			return (uint64_t)std::chrono::duration_cast<std::chrono::microseconds>(timer_clock::now() - _epoch).count() / TIMER_TICK_US;
+		}
+
+		//_insert - the lowest level whose span covers the time left,
+		//in the slot that level reaches at the deadline.
+		void _insert(TimerNode* node) {
+			uint64_t deadline = (node->deadline < _now) ? _now : node->deadline;
+			uint64_t delta = deadline - _now;
+			size_t level = 0;
+
+			while (level + 1 < Levels && delta >= (uint64_t(1) << (SlotBits * (level + 1)))) {
+				++level;
+			}
+
+			//beyond the top level's reach: park as far out as it goes
+			if (delta >= (uint64_t(1) << (SlotBits * Levels))) {
+				deadline = _now + (uint64_t(1) << (SlotBits * Levels)) - 1;
+			}
+
+			TimerNode* head = &_slots[level][(deadline >> (SlotBits * level)) & (Slots - 1)];
+
+			node->prev = head;
+			node->next = head->next;
+			head->next->prev = node;
+			head->next = node;
+		}
+
+		void _unlink(TimerNode* node) {
+			node->prev->next = node->next;
+			node->next->prev = node->prev;
+			node->prev = nullptr;
+			node->next = nullptr;
+		}
+
+		//_cascade - move the level's slot due at _now down to lower levels.
+		void _cascade(size_t level) {
+			TimerNode* head = &_slots[level][(_now >> (SlotBits * level)) & (Slots - 1)];
+
+			while (head->next != head) {
+				TimerNode* node = head->next;
+				_unlink(node);
+				_insert(node);
+			}
+		}
+
+		//_advance - process every tick up to and including target.
+		void _advance(std::unique_lock<std::mutex> &lock, uint64_t target) {
+			while (_now <= target && !_stop) {
+				//nothing pending: the levels are empty, skip straight there
+				if (_count == 0) {
+					_now = target + 1;
+					return;
+				}
+
+				for (size_t l = 1; l < Levels; ++l) {
+					if ((_now & ((uint64_t(1) << (SlotBits * l)) - 1)) != 0) {
+						break;
+					}
+
+					_cascade(l);
+				}
+
+				//one at a time, so a timer cancelled meanwhile is never fired
+				TimerNode* head = &_slots[0][_now & (Slots - 1)];
+
+				while (head->next != head) {
+					TimerNode* node = head->next;
+					_unlink(node);
+					--_count;
+					_firing = node;
+
+					lock.unlock();
+					node->fire(node);
+					lock.lock();
+
+					_firing = nullptr;
+					_fired.notify_all();
+				}
+
+				++_now;
+			}
+		}
+
+		//_next_wake - the next tick with work: a level 0 slot in use,
+		//or the next cascade. Looks at most one turn of level 0.
+		uint64_t _next_wake(void) const {
+			for (uint64_t t = _now; ; ++t) {
+				if ((t & (Slots - 1)) == 0) {
+					return t;
+				}
+
+				const TimerNode* head = &_slots[0][t & (Slots - 1)];
+				if (head->next != head) {
+					return t;
+				}
+			}
+		}
+
+		void _work(void) {
+			std::unique_lock<std::mutex> lock(_lock);
+
+			while (!_stop) {
+				_advance(lock, _current_tick());
+
+				if (_stop) {
+					break;
+				}
+
+				if (_count == 0) {
+					_sleeping_until = ~uint64_t(0);
+					_wake.wait(lock);
+				} else {
+					_sleeping_until = _next_wake();
+					_wake.wait_until(lock, _epoch + std::chrono::microseconds(_sleeping_until * TIMER_TICK_US));
+				}
+
+				_sleeping_until = 0;
+			}
+		}
+	};
+
+	//timers - the wheel delay(), timeout() and friends share, started on first use.
+	//Never destroyed, timers may still be scheduled while statics are torn down.
+	inline TimerWheel& timers(void) {
+		static TimerWheel* wheel = new TimerWheel();
+		return *wheel;
+	}
+}
+
+#endif // !TIMER_H
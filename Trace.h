@@ -0,0 +1,256 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <vector>
+
+#ifndef TRACE_H
+#define TRACE_H
+
+//events each thread keeps before the oldest are overwritten.
+#ifndef TRACE_RING_SIZE
+#define TRACE_RING_SIZE 16384
+#endif
+
+//Compile with PROMISE_TRACE defined to record promise lifecycle events.
+//Without it every hook below expands to nothing and promises carry no trace id.
+#ifdef PROMISE_TRACE
+#define PROMISE_TRACE_EVENT(kind, id, other, arg) ::Promises::Trace::record(::Promises::Trace::kind, (id), (other), (arg))
+#else
+#define PROMISE_TRACE_EVENT(kind, id, other, arg) ((void)0)
+#endif
+
+namespace Promises {
+namespace Trace {
+
+	//Kind - what happened to promise id. other and arg by kind:
+	//Chained: other is the parent. Settled: arg is the outcome.
+	enum Kind {
+		Created,
+		Chained,
+		Scheduled,
+		HandlerBegin,
+		HandlerEnd,
+		Settled,
+		AwaitBegin,
+		AwaitEnd
+	};
+
+	struct Event {
+		uint64_t time;
+		uint64_t id;
+		uint64_t other;
+		int kind;
+		int arg;
+		unsigned tid;
+	};
+
+	//now - nanoseconds since the first call.
+	inline uint64_t now(void) {
+		static const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+	}
+
+	//Ring - one thread's events. Only the owning thread writes, and it
+	//publishes each event by bumping _head, so recording takes no lock.
+	//A reader sees every event published before it loaded _head;
+	//read while threads are still recording and the oldest may be torn.
+	class Ring {
+	public:
+		explicit Ring(unsigned tid)
+			:_events(TRACE_RING_SIZE),
+			_head(0),
+			_tid(tid)
+		{ }
+
+		void push(Event e) {
+			uint64_t head = _head.load(std::memory_order_relaxed);
+
+			e.tid = _tid;
+			_events[head % TRACE_RING_SIZE] = e;
+			_head.store(head + 1, std::memory_order_release);
+		}
+
+		void read(std::vector<Event> &out) const {
+			uint64_t head = _head.load(std::memory_order_acquire);
+			uint64_t begin = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+
+			for (uint64_t i = begin; i < head; ++i) {
+				out.push_back(_events[i % TRACE_RING_SIZE]);
+			}
+		}
+
+	private:
+		std::vector<Event> _events;
+		std::atomic<uint64_t> _head;
+		unsigned _tid;
+	};
+
+	//Registry - every ring ever created. Rings outlive their threads,
+	//so a pool torn down before the export still shows up in it.
+	class Registry {
+	public:
+		Registry(void)
+			:_ids(0),
+			_since(0)
+		{ }
+
+		Ring* add(void) {
+			std::unique_lock<std::mutex> lock(_lock);
+			_rings.push_back(std::unique_ptr<Ring>(new Ring((unsigned)_rings.size() + 1)));
+			return _rings.back().get();
+		}
+
+		uint64_t next_id(void) {
+			return _ids.fetch_add(1, std::memory_order_relaxed) + 1;
+		}
+
+		void clear(void) {
+			_since.store(now(), std::memory_order_release);
+		}
+
+		//events - everything recorded since the last clear(), oldest first.
+		std::vector<Event> events(void) {
+			std::vector<Event> all;
+			uint64_t since = _since.load(std::memory_order_acquire);
+
+			{
+				std::unique_lock<std::mutex> lock(_lock);
+				for (size_t i = 0; i < _rings.size(); ++i) {
+					_rings[i]->read(all);
+				}
+			}
+
+			all.erase(std::remove_if(all.begin(), all.end(), [since](const Event &e) {
+				return e.time < since;
+			}), all.end());
+
+			std::stable_sort(all.begin(), all.end(), [](const Event &a, const Event &b) {
+				return a.time < b.time;
+			});
+
+			return all;
+		}
+
+	private:
+		std::mutex _lock;
+		std::vector<std::unique_ptr<Ring>> _rings;
+		std::atomic<uint64_t> _ids;
+		std::atomic<uint64_t> _since;
+	};
+
+	//never destroyed, workers may still record while statics are torn down
+	inline Registry& registry(void) {
+		static Registry* reg = new Registry();
+		return *reg;
+	}
+
+	//local_ring - the calling thread's ring, registered on first use.
+	inline Ring& local_ring(void) {
+		static thread_local Ring* ring = registry().add();
+		return *ring;
+	}
+
+	inline void record(Kind kind, uint64_t id, uint64_t other = 0, int arg = 0) {
+		Event e;
+		e.time = now();
+		e.id = id;
+		e.other = other;
+		e.kind = kind;
+		e.arg = arg;
+		e.tid = 0;
+
+		local_ring().push(e);
+	}
+
+	//created - a fresh promise id, recorded as Created.
+	inline uint64_t created(void) {
+		uint64_t id = registry().next_id();
+		record(Created, id);
+		return id;
+	}
+
+	inline std::vector<Event> events(void) {
+		return registry().events();
+	}
+
+	//clear - leave out everything recorded so far from later exports.
+	inline void clear(void) {
+		registry().clear();
+	}
+
+	inline const char* _outcome(int arg) {
+		switch (arg) {
+			case 1: return "resolved";
+			case 2: return "rejected";
+			default: return "ended";
+		}
+	}
+
+	//write_chrome_trace - the events as Chrome trace JSON, for chrome://tracing
+	//or ui.perfetto.dev. Each promise is an async slice from created to settled.
+	//Handlers and awaits are slices on their thread, and a flow arrow runs
+	//from scheduling a handler to it starting, which is its time in the queue.
+	inline void write_chrome_trace(std::ostream &out) {
+		std::vector<Event> all = events();
+
+		out << "{\"traceEvents\":[";
+
+		for (size_t i = 0; i < all.size(); ++i) {
+			const Event &e = all[i];
+
+			std::ostringstream head;
+			head << std::fixed << std::setprecision(3)
+				<< "\"pid\":1,\"tid\":" << e.tid << ",\"ts\":" << (double)e.time / 1000.0;
+
+			if (i != 0) {
+				out << ",";
+			}
+			out << "\n";
+
+			switch (e.kind) {
+				case Created:
+					out << "{\"name\":\"promise\",\"cat\":\"promise\",\"ph\":\"b\",\"id\":" << e.id << "," << head.str() << "}";
+					break;
+				case Chained:
+					out << "{\"name\":\"then\",\"cat\":\"promise\",\"ph\":\"i\",\"s\":\"t\"," << head.str()
+						<< ",\"args\":{\"promise\":" << e.id << ",\"parent\":" << e.other << "}}";
+					break;
+				case Scheduled:
+					out << "{\"name\":\"scheduled\",\"cat\":\"promise\",\"ph\":\"i\",\"s\":\"t\"," << head.str()
+						<< ",\"args\":{\"promise\":" << e.id << "}},\n"
+						<< "{\"name\":\"queued\",\"cat\":\"promise\",\"ph\":\"s\",\"id\":" << e.id << "," << head.str() << "}";
+					break;
+				case HandlerBegin:
+					out << "{\"name\":\"handler\",\"cat\":\"promise\",\"ph\":\"B\"," << head.str()
+						<< ",\"args\":{\"promise\":" << e.id << "}},\n"
+						<< "{\"name\":\"queued\",\"cat\":\"promise\",\"ph\":\"f\",\"bp\":\"e\",\"id\":" << e.id << "," << head.str() << "}";
+					break;
+				case HandlerEnd:
+					out << "{\"name\":\"handler\",\"cat\":\"promise\",\"ph\":\"E\"," << head.str() << "}";
+					break;
+				case Settled:
+					out << "{\"name\":\"promise\",\"cat\":\"promise\",\"ph\":\"e\",\"id\":" << e.id << "," << head.str()
+						<< ",\"args\":{\"outcome\":\"" << _outcome(e.arg) << "\"}}";
+					break;
+				case AwaitBegin:
+					out << "{\"name\":\"await\",\"cat\":\"promise\",\"ph\":\"B\"," << head.str()
+						<< ",\"args\":{\"promise\":" << e.id << "}}";
+					break;
+				default:
+					out << "{\"name\":\"await\",\"cat\":\"promise\",\"ph\":\"E\"," << head.str() << "}";
+					break;
+			}
+		}
+
+		out << "\n]}\n";
+	}
+}
+}
+
+#endif // !TRACE_H
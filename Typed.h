@@ -0,0 +1,579 @@
+#include "Core.h"
+#include "Promise_Error.h"
+#include "Scheduler.h"
+#include <exception>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#ifndef TYPED_H
+#define TYPED_H
+
+namespace Promises {
+namespace Typed {
+
+	//Promise<T> - a promise whose value type is known at compile time.
+	//Values live inside the chain link (see Core.h), handlers are called
+	//directly with the stored value, and then() deduces the type of the next link,
+	//so there is no State, no void* and no virtual call on the value path.
+	template <typename T>
+	class Promise;
+
+	//unwrap - the value type of the link a handler returning R produces.
+	template <typename R>
+	struct unwrap {
+		typedef R type;
+	};
+
+	template <typename U>
+	struct unwrap<Promise<U>> {
+		typedef U type;
+	};
+
+	//callable_with - F can be called with an ARG.
+	template <typename F, typename ARG>
+	struct callable_with {
+		template <typename G>
+		static auto test(int) -> decltype(std::declval<G&>()(std::declval<ARG>()), std::true_type());
+
+		template <typename G>
+		static std::false_type test(...);
+
+		typedef decltype(test<F>(0)) type;
+	};
+
+	//handler_arg - what apply passes a handler: const T& to those that
+	//can take one, an lvalue of its own to T& handlers, T&& to the rest.
+	template <typename F, typename T>
+	struct handler_arg {
+		typedef typename std::conditional<callable_with<F, const T&>::type::value, const T&,
+			typename std::conditional<callable_with<F, T&>::type::value, T&, T&&>::type>::type type;
+	};
+
+	//apply - call a handler with the value of a resolved parent.
+	//const T& handlers read it in place. By-value and T&& handlers get it
+	//moved when the parent has no other reader (sole), copied otherwise,
+	//and so do T& handlers, which may change what they are given.
+	template <typename T>
+	struct apply {
+		template <typename F>
+		static auto call(F &f, CoreBase* parent, bool sole) -> decltype(f(std::declval<typename handler_arg<F, T>::type>())) {
+			T &value = static_cast<Core<T>*>(parent)->value();
+
+			return _call(f, value, sole, typename callable_with<F, const T&>::type(), typename callable_with<F, T&&>::type());
+		}
+
+	private:
+		template <typename F>
+		static auto _call(F &f, T &value, bool sole, std::true_type, std::true_type) -> decltype(f(value)) {
+			if (sole) {
+				return f(std::move(value));
+			}
+
+			return f(value);
+		}
+
+		template <typename F>
+		static auto _call(F &f, T &value, bool, std::true_type, std::false_type) -> decltype(f(value)) {
+			return f(value);
+		}
+
+		template <typename F>
+		static auto _call(F &f, T &value, bool sole, std::false_type, std::true_type) -> decltype(f(std::move(value))) {
+			if (sole) {
+				return f(std::move(value));
+			}
+
+			return f(copy_value(value));
+		}
+
+		template <typename F>
+		static auto _call(F &f, T &value, bool sole, std::false_type, std::false_type) -> decltype(f(value)) {
+			T own = own_value(value, sole);
+			return f(own);
+		}
+	};
+
+	template <>
+	struct apply<void> {
+		template <typename F>
+		static auto call(F &f, CoreBase*, bool) -> decltype(f()) {
+			return f();
+		}
+	};
+
+	//result_of_then - what a resolve handler F returns for a Promise<T>.
+	template <typename F, typename T>
+	struct result_of_then {
+		typedef decltype(apply<T>::call(std::declval<F&>(), nullptr, false)) type;
+	};
+
+	//then_type - the promise then(F) returns on a Promise<T>.
+	template <typename F, typename T>
+	struct then_type {
+		typedef Promise<typename unwrap<typename result_of_then<F, T>::type>::type> type;
+	};
+
+	//settle_with - settle self with whatever thunk() returns:
+	//a value resolves it, void resolves a Promise<void>,
+	//and a Promise<U> is adopted once it settles.
+	template <typename R>
+	struct settle_with {
+		template <typename THUNK>
+		static void run(Core<R>* self, THUNK thunk) {
+			self->resolve(thunk());
+		}
+	};
+
+	template <>
+	struct settle_with<void> {
+		template <typename THUNK>
+		static void run(Core<void>* self, THUNK thunk) {
+			thunk();
+			self->resolve();
+		}
+	};
+
+	template <typename U>
+	struct settle_with<Promise<U>> {
+		template <typename THUNK>
+		static void run(Core<U>* self, THUNK thunk) {
+			Promise<U> next = thunk();
+
+			if (!next.valid()) {
+				throw Promise_Error("Promise.then(): handler returned an empty promise");
+			}
+
+			//nothing else reads through the returned handle
+			adopt(self, next.detach().detach());
+		}
+	};
+
+	//forward - pass a parent's value through to self unchanged,
+	//moving it when the parent has no other reader.
+	template <typename T>
+	struct forward {
+		static void run(Core<T>* self, CoreBase* parent, bool sole) {
+			T &value = static_cast<Core<T>*>(parent)->value();
+
+			if (sole) {
+				self->resolve(std::move(value));
+			} else {
+				self->resolve(copy_value(value));
+			}
+		}
+	};
+
+	template <>
+	struct forward<void> {
+		static void run(Core<void>* self, CoreBase*, bool) {
+			self->resolve();
+		}
+	};
+
+	//with_reason - call g with the rejection as a std::exception.
+	template <typename G>
+	auto with_reason(G &g, std::exception_ptr error) -> decltype(g(std::declval<const std::exception&>())) {
+		try {
+			std::rethrow_exception(error);
+		} catch (const std::exception &ex) {
+			return g(ex);
+		} catch (...) {
+			return g(Promise_Error("unknown exception"));
+		}
+	}
+
+	template <typename T, typename F>
+	class ThenHandler {
+	public:
+		typedef typename result_of_then<F, T>::type result_type;
+		typedef typename unwrap<result_type>::type value_type;
+
+		explicit ThenHandler(F f)
+			:_f(std::move(f))
+		{ }
+
+		void operator () (CoreBase* parent, Core<value_type>* self, bool sole) {
+			if (parent->status() == Rejected) {
+				self->reject(parent->error());
+				return;
+			}
+
+			F &f = _f;
+			settle_with<result_type>::run(self, [&f, parent, sole]() {
+				return apply<T>::call(f, parent, sole);
+			});
+		}
+
+	private:
+		F _f;
+	};
+
+	template <typename T, typename F, typename G>
+	class ThenCatchHandler {
+	public:
+		typedef typename result_of_then<F, T>::type result_type;
+		typedef typename unwrap<result_type>::type value_type;
+
+		ThenCatchHandler(F f, G g)
+			:_f(std::move(f)),
+			_g(std::move(g))
+		{ }
+
+		void operator () (CoreBase* parent, Core<value_type>* self, bool sole) {
+			F &f = _f;
+			G &g = _g;
+
+			if (parent->status() == Rejected) {
+				std::exception_ptr error = parent->error();
+				settle_with<result_type>::run(self, [&g, error]() {
+					return with_reason(g, error);
+				});
+			} else {
+				settle_with<result_type>::run(self, [&f, parent, sole]() {
+					return apply<T>::call(f, parent, sole);
+				});
+			}
+		}
+
+	private:
+		F _f;
+		G _g;
+	};
+
+	template <typename T, typename G>
+	class CatchHandler {
+	public:
+		typedef decltype(with_reason(std::declval<G&>(), std::exception_ptr())) result_type;
+
+		explicit CatchHandler(G g)
+			:_g(std::move(g))
+		{ }
+
+		void operator () (CoreBase* parent, Core<T>* self, bool sole) {
+			if (parent->status() == Resolved) {
+				forward<T>::run(self, parent, sole);
+				return;
+			}
+
+			G &g = _g;
+			std::exception_ptr error = parent->error();
+			settle_with<result_type>::run(self, [&g, error]() {
+				return with_reason(g, error);
+			});
+		}
+
+	private:
+		G _g;
+	};
+
+	template <typename T, typename F>
+	class FinallyHandler {
+	public:
+		explicit FinallyHandler(F f)
+			:_f(std::move(f))
+		{ }
+
+		void operator () (CoreBase* parent, Core<T>* self, bool sole) {
+			_f();
+
+			if (parent->status() == Resolved) {
+				forward<T>::run(self, parent, sole);
+			} else {
+				self->reject(parent->error());
+			}
+		}
+
+	private:
+		F _f;
+	};
+
+	template <typename T>
+	class Promise {
+	public:
+		typedef T value_type;
+
+		Promise(void) { }
+
+		explicit Promise(CorePtr<T> core)
+			:_core(std::move(core))
+		{ }
+
+		//then - f is called with the value, see apply (nothing for Promise<void>).
+		//If f returns a Promise<U>, the result is a Promise<U> that
+		//settles with it, otherwise a Promise of what f returns.
+		//A rejection skips f and passes straight through.
+		//On an rvalue (a temporary, or std::move(p)) the handle is consumed,
+		//so f can be given the value itself instead of a copy.
+		template <typename F>
+		typename then_type<F, T>::type then(F f) const & {
+			return _then(_checked("then"), false, std::move(f));
+		}
+
+		template <typename F>
+		typename then_type<F, T>::type then(F f) && {
+			return _then(_consume("then"), true, std::move(f));
+		}
+
+		//then - g is called with the rejection reason instead,
+		//it must produce the same type as f.
+		template <typename F, typename G>
+		typename then_type<F, T>::type then(F f, G g) const & {
+			return _then(_checked("then"), false, std::move(f), std::move(g));
+		}
+
+		template <typename F, typename G>
+		typename then_type<F, T>::type then(F f, G g) && {
+			return _then(_consume("then"), true, std::move(f), std::move(g));
+		}
+
+		//_catch - recover from a rejection with g(const std::exception&),
+		//which must produce a T. A resolved value passes through.
+		template <typename G>
+		Promise<T> _catch(G g) const & {
+			return _recover(_checked("_catch"), false, std::move(g));
+		}
+
+		template <typename G>
+		Promise<T> _catch(G g) && {
+			return _recover(_consume("_catch"), true, std::move(g));
+		}
+
+		//finally - f() runs either way, the settlement passes through.
+		template <typename F>
+		Promise<T> finally(F f) const & {
+			return Promise<T>(continue_with<T>(_checked("finally"), FinallyHandler<T, F>(std::move(f))));
+		}
+
+		template <typename F>
+		Promise<T> finally(F f) && {
+			return Promise<T>(continue_with<T>(_consume("finally"), FinallyHandler<T, F>(std::move(f)), true));
+		}
+
+		void Join(void) const {
+			_checked("Join")->wait();
+		}
+
+		Status status(void) const {
+			return _checked("status")->status();
+		}
+
+		bool valid(void) const {
+			return static_cast<bool>(_core);
+		}
+
+		const CorePtr<T>& core(void) const {
+			return _core;
+		}
+
+		//detach - give up the handle, leaving the promise empty.
+		CorePtr<T> detach(void) {
+			return std::move(_core);
+		}
+
+	private:
+		CorePtr<T> _core;
+
+		Core<T>* _checked(const char* method) const {
+			if (!_core) {
+				throw Promise_Error(std::string("Promise.") + method + "(): promise is empty");
+			}
+
+			return _core.get();
+		}
+
+		//_consume - like _checked, but the caller takes over the reference.
+		Core<T>* _consume(const char* method) {
+			_checked(method);
+			return _core.detach();
+		}
+
+		template <typename F>
+		static typename then_type<F, T>::type _then(Core<T>* parent, bool consume, F f) {
+			typedef ThenHandler<T, F> handler_type;
+			typedef typename handler_type::value_type next_type;
+
+			return Promise<next_type>(continue_with<next_type>(parent, handler_type(std::move(f)), consume));
+		}
+
+		template <typename F, typename G>
+		static typename then_type<F, T>::type _then(Core<T>* parent, bool consume, F f, G g) {
+			typedef ThenCatchHandler<T, F, G> handler_type;
+			typedef typename handler_type::value_type next_type;
+			typedef typename unwrap<decltype(with_reason(std::declval<G&>(), std::exception_ptr()))>::type rejected_type;
+
+			static_assert(std::is_same<next_type, rejected_type>::value,
+				"Promise.then(): resolve and reject handlers must produce the same type");
+
+			return Promise<next_type>(continue_with<next_type>(parent, handler_type(std::move(f), std::move(g)), consume));
+		}
+
+		template <typename G>
+		static Promise<T> _recover(Core<T>* parent, bool consume, G g) {
+			typedef CatchHandler<T, G> handler_type;
+			typedef typename unwrap<typename handler_type::result_type>::type recovered_type;
+
+			static_assert(std::is_same<T, recovered_type>::value,
+				"Promise._catch(): handler must produce the promise's type");
+
+			return Promise<T>(continue_with<T>(parent, handler_type(std::move(g)), consume));
+		}
+	};
+
+	//Settlement - given to the handler of promise<T>().
+	template <typename T>
+	class Settlement {
+	public:
+		explicit Settlement(CorePtr<T> core)
+			:_core(std::move(core))
+		{ }
+
+		template <typename U>
+		void resolve(U &&value) {
+			_core->resolve(std::forward<U>(value));
+		}
+
+		//reject - e is kept as its own type, which await() rethrows.
+		template <typename E, typename = typename std::enable_if<std::is_base_of<std::exception, E>::value>::type>
+		void reject(const E &e) {
+			_core->reject(std::make_exception_ptr(typename reason_type<E>::type(e)));
+		}
+
+		void reject(const std::string &msg) {
+			_core->reject(std::make_exception_ptr(Promise_Error(msg)));
+		}
+
+		void reject(std::exception_ptr error) {
+			_core->reject(error);
+		}
+
+	private:
+		CorePtr<T> _core;
+	};
+
+	template <>
+	class Settlement<void> {
+	public:
+		explicit Settlement(CorePtr<void> core)
+			:_core(std::move(core))
+		{ }
+
+		void resolve(void) {
+			_core->resolve();
+		}
+
+		//reject - e is kept as its own type, which await() rethrows.
+		template <typename E, typename = typename std::enable_if<std::is_base_of<std::exception, E>::value>::type>
+		void reject(const E &e) {
+			_core->reject(std::make_exception_ptr(typename reason_type<E>::type(e)));
+		}
+
+		void reject(const std::string &msg) {
+			_core->reject(std::make_exception_ptr(Promise_Error(msg)));
+		}
+
+		void reject(std::exception_ptr error) {
+			_core->reject(error);
+		}
+
+	private:
+		CorePtr<void> _core;
+	};
+
+	//SettleTask - promise()'s handler and the core it settles. It owns
+	//itself until it has run, so the handler is moved in, never copied,
+	//and may be mutable or move-only.
+	template <typename T, typename LAMBDA>
+	class SettleTask {
+	public:
+		SettleTask(CorePtr<T> core, LAMBDA handler)
+			:_core(std::move(core)),
+			_handler(std::move(handler))
+		{ }
+
+		static void run(SettleTask* self) {
+			PROMISE_TRACE_EVENT(HandlerBegin, self->_core->trace_id(), 0, 0);
+
+			try {
+				self->_handler(Settlement<T>(self->_core));
+			} catch (...) {
+				self->_core->reject(std::current_exception());
+			}
+
+			PROMISE_TRACE_EVENT(HandlerEnd, self->_core->trace_id(), 0, 0);
+
+			pool_delete(self);
+		}
+
+	private:
+		CorePtr<T> _core;
+		LAMBDA _handler;
+	};
+
+	//promise - run handler(Settlement<T>) on the default executor.
+	//If the handler throws before settling, the promise is rejected.
+	template <typename T, typename LAMBDA>
+	Promise<T> promise(LAMBDA handler) {
+		CorePtr<T> core = make_core<T>();
+
+		PROMISE_TRACE_EVENT(Scheduled, core->trace_id(), 0, 0);
+
+		SettleTask<T, LAMBDA>* task = pool_new<SettleTask<T, LAMBDA>>(core, std::move(handler));
+		default_executor()->submit([task]() {
+			SettleTask<T, LAMBDA>::run(task);
+		});
+
+		return Promise<T>(core);
+	}
+
+	template <typename T>
+	Promise<typename std::decay<T>::type> Resolve(T &&value) {
+		typedef typename std::decay<T>::type value_type;
+
+		CorePtr<value_type> core = make_core<value_type>();
+		core->resolve(std::forward<T>(value));
+
+		return Promise<value_type>(core);
+	}
+
+	inline Promise<void> Resolve(void) {
+		CorePtr<void> core = make_core<void>();
+		core->resolve();
+
+		return Promise<void>(core);
+	}
+
+	template <typename T, typename E, typename = typename std::enable_if<std::is_base_of<std::exception, E>::value>::type>
+	Promise<T> Reject(const E &e) {
+		CorePtr<T> core = make_core<T>();
+		core->reject(std::make_exception_ptr(typename reason_type<E>::type(e)));
+
+		return Promise<T>(core);
+	}
+
+	//await - block until prom settles. Returns a pointer to the value,
+	//which lives as long as prom does; a rejection is rethrown as is.
+	template <typename T>
+	T* await(const Promise<T> &prom) {
+		prom.Join();
+
+		Core<T>* core = prom.core().get();
+		if (core->status() == Rejected) {
+			std::rethrow_exception(core->error());
+		}
+
+		return &core->value();
+	}
+
+	inline void await(const Promise<void> &prom) {
+		prom.Join();
+
+		Core<void>* core = prom.core().get();
+		if (core->status() == Rejected) {
+			std::rethrow_exception(core->error());
+		}
+	}
+}
+}
+
+#endif // !TYPED_H